@@ -0,0 +1,683 @@
+#include <vector>
+#include <iostream>
+#include <cstring>
+#include <cstdlib>
+#include <memory>
+
+#include "include/util.h"
+#include "include/cpu_backend.h"
+#include "include/bench_util.h"
+#include "include/results_store.h"
+#include "include/trace.h"
+#include "include/memory_budget.h"
+#include "include/low_rank.h"
+#include "include/weight_cache.h"
+
+// Benchmark suite for the CPU backend.
+//
+//   DX12VectorAddBench [--samples N] [--threads N] [--pin] [--quick]
+//                      [--no-sweep] [--no-scaling] [--no-sparse] [--no-epilogue]
+//                      [--no-typed] [--no-train] [--no-residency] [--no-precision]
+//                      [--no-lowrank] [--no-weightcache]
+//                      [--save] [--store DIR] [--rev REV] [--trace FILE]
+//   DX12VectorAddBench --compare BASE_REV [--candidate REV] [--store DIR]
+//                      [--alpha P] [--threshold FRACTION]
+//
+// The sweep prints one CSV line per (variant, shape, type); the scaling
+// section reruns one shape with 1..N threads and reports the parallel
+// efficiency T(1) / (n * T(n)). The sparse section compares the dense GEMV
+// with the 2:4 structured-sparse one on the same pruned matrix; the
+// epilogue section compares a fused scale + ReLU + F16 store with a GEMV
+// followed by a separate pass over the output; the typed section compares
+// the runtime-DataType GEMV with the compile-time typed views of
+// linalg_host.h on the same buffers; the train section reports MLP
+// training throughput (mlp_training.h) in samples per second; the
+// residency section runs layers whose weights do not all fit in a device
+// budget (memory_budget.h), evicting and re-uploading them; the precision
+// section compares per-operand type configs (F16 weights and activations,
+// E4M3 weights, I8 with I32 accumulation) against F32; the lowrank section
+// runs a layer factored to increasing ranks (low_rank.h) against the dense
+// GEMV: weight bytes, time and output error; the weightcache section
+// updates a fraction of the rows of a model each step, like fine-tuning,
+// and compares uploading every layer with the dirty-row uploads of the
+// weight residency cache (weight_cache.h). Every problem
+// is charged to one memory account whose report closes the output. --save
+// stores every measured point in the results store (default
+// ./bench_results) under the current git revision. --trace records every
+// section and dispatch into a Chrome trace (trace.h); the rings keep the
+// most recent spans of each thread.
+// --compare checks a stored candidate (default: current revision) against a
+// stored baseline and exits with 1 when a point regressed significantly.
+
+// Memory of every BenchProblem, reported at the end of the run
+static MemoryAccount benchMemory;
+
+struct BenchProblem {
+    DataType dt;
+    uint32_t M, K, strideK, batch;
+    std::vector<uint8_t> input, matrix, bias, output;
+    MemoryCharge weightsCharge, activationsCharge;
+
+    BenchProblem(DataType dt_, uint32_t M_, uint32_t K_, uint32_t batch_)
+        : dt(dt_), M(M_), K(K_), batch(batch_)
+    {
+        strideK = (SizeofType(dt) * K + 31) & ~31u;
+        input.resize(uint64_t(SizeofType(dt)) * K * batch);
+        matrix.resize(uint64_t(strideK) * M);
+        bias.resize(SizeofType(dt) * M);
+        output.resize(uint64_t(SizeofType(dt)) * M * batch);
+        weightsCharge = MemoryCharge(benchMemory, MEMORY_POOL_DEVICE, MEMORY_WEIGHTS, matrix.size() + bias.size(), "problem weights");
+        activationsCharge = MemoryCharge(benchMemory, MEMORY_POOL_DEVICE, MEMORY_ACTIVATIONS, input.size() + output.size(), "problem activations");
+        for (uint32_t k = 0; k < K * batch; ++k) {
+            SetDataFloat(input.data(), dt, 0, k, float(k % 7) * 0.25f);
+        }
+        for (uint32_t m = 0; m < M; ++m) {
+            for (uint32_t k = 0; k < K; ++k) {
+                SetDataFloat(matrix.data(), dt, m * strideK, k, float((m + k) % 5) * 0.125f);
+            }
+            SetDataFloat(bias.data(), dt, 0, m, 1.0f);
+        }
+    }
+
+    // One dispatch of the variant: "gemv" is VectorMulAdd.hlsl (one thread
+    // per row, batch 1), "batched" is CoopVectorMulAdd.hlsl with one thread
+    // per input vector.
+    void Run(ThreadPool &pool, std::string const &variant)
+    {
+        if (variant == "gemv") {
+            VectorMulAddKernel kernel = { dt, output.data(), matrix.data(), input.data(), bias.data(), M, K, strideK };
+            CpuDispatch(pool, kernel, CpuGroupCount(M, VectorMulAddKernel::NumThreads.x), 1, 1);
+        } else {
+            CoopVectorMulAddKernel kernel = { dt, output.data(), matrix.data(), input.data(), bias.data(), M, K, strideK,
+                                              batch, SizeofType(dt) * K, SizeofType(dt) * M };
+            // One vector per group-chunk keeps the batch spread over all cores.
+            CpuDispatch(pool, kernel, CpuGroupCount(batch, CoopVectorMulAddKernel::NumThreads.x), 1, 1, 1);
+        }
+    }
+};
+
+// Runtime-DataType GEMV vs TypedVectorMulAddKernel for one compile-time
+// shape. Prints one line, returns false when the outputs differ.
+template <DataType DT, uint32_t M, uint32_t K>
+static bool BenchTyped(ThreadPool &pool, uint32_t samples, std::vector<SweepRecord> &records)
+{
+    using Matrix = linalg::MatrixView<DT, M, K, linalg::MATRIX_LAYOUT_ROW_MAJOR>;
+    using Kernel = TypedVectorMulAddKernel<Matrix, DT, DT, DT>;
+
+    BenchProblem problem(DT, M, K, 1);
+    std::vector<uint8_t> typedOutput(problem.output.size());
+    Kernel kernel = { { typedOutput.data(), 0 }, { problem.matrix.data(), 0, problem.strideK },
+                      { problem.input.data(), 0 }, { problem.bias.data(), 0 } };
+
+    SweepRecord runtime = { "cpu", "gemv", M, K, 1, DataTypeName(DT), pool.NumThreads(), {} };
+    runtime.samplesMs = MeasureMs(samples, [&] { problem.Run(pool, "gemv"); });
+    SweepRecord typed = { "cpu", "gemv_typed", M, K, 1, DataTypeName(DT), pool.NumThreads(), {} };
+    typed.samplesMs = MeasureMs(samples, [&] { CpuDispatch(pool, kernel, CpuGroupCount(M, Kernel::NumThreads.x), 1, 1); });
+    records.push_back(typed);
+
+    double r = Median(runtime.samplesMs), t = Median(typed.samplesMs);
+    std::cout << M << "," << K << "," << DataTypeName(DT) << "," << r << "," << t << "," << (t > 0.0 ? r / t : 0.0) << std::endl;
+    return problem.output == typedOutput;
+}
+
+// One MLP training step (TrainStep + OptimizerStep dispatch) per sample
+// of the measurement.
+template <typename Shape>
+static void BenchTrain(ThreadPool &pool, uint32_t samples, uint32_t batch, std::vector<SweepRecord> &records)
+{
+    std::vector<float> data(uint64_t(batch) * Shape::SampleFloats);
+    for (size_t i = 0; i < data.size(); ++i) data[i] = float(i % 11) * 0.1f - 0.5f;
+    std::vector<float> params, grads(Shape::ParamWords, 0.0f), momentum(Shape::ParamWords, 0.0f), losses(batch);
+    MlpInitParams<Shape>(params);
+    MlpOptimizerParams opt;
+
+    SweepRecord r = { "cpu", "train_step", Shape::Hiddens, Shape::Inputs, batch, "F32", pool.NumThreads(), {} };
+    r.samplesMs = MeasureMs(samples, [&] {
+        MlpTrainStepKernel<Shape> train = { params.data(), grads.data(), data.data(), losses.data(), batch };
+        CpuDispatch(pool, train, CpuGroupCount(batch, MlpTrainStepKernel<Shape>::NumThreads.x), 1, 1);
+        MlpOptimizerKernel update = { params.data(), grads.data(), momentum.data(), Shape::ParamWords, batch, opt };
+        CpuDispatch(pool, update, CpuGroupCount(Shape::ParamWords, MlpOptimizerKernel::NumThreads.x), 1, 1);
+    });
+    records.push_back(r);
+
+    double ms = Median(r.samplesMs);
+    double perSecond = ms > 0.0 ? batch / (ms / 1000.0) : 0.0;
+    std::cout << Shape::Inputs << "-" << Shape::Hiddens << "-" << Shape::Outputs << "," << batch << "," << ms << ","
+              << perSecond << "," << perSecond * Shape::MacsPerSample / 1e9 << std::endl;
+}
+
+// GEMV with per-operand types (MatMulAddTypes) against the all-F32 one on
+// the same values: bytes moved, time, and the largest output error. The
+// values are fractions whose spread decays along K, so every narrow type
+// rounds them; integer operands are quantized symmetrically to their
+// largest magnitude, and an integer output is scaled back before the
+// comparison. The input is converted to its interpretation once per
+// dispatch.
+static void BenchPrecision(ThreadPool &pool, uint32_t samples, uint32_t M, uint32_t K, std::vector<SweepRecord> &records)
+{
+    struct Config {
+        const char *name;
+        MatMulAddTypes types;
+    };
+    const Config configs[] = {
+        { "F32", MatMulAddTypes::Uniform(DATA_TYPE_FLOAT32) },
+        { "F16", MatMulAddTypes::Uniform(DATA_TYPE_FLOAT16) },
+        { "F16/E4M3->F32", { DATA_TYPE_FLOAT16, DATA_TYPE_FLOAT8_E4M3, DATA_TYPE_FLOAT8_E4M3, DATA_TYPE_FLOAT16, DATA_TYPE_FLOAT32 } },
+        { "I8/I8->I32", { DATA_TYPE_SINT8, DATA_TYPE_SINT8, DATA_TYPE_SINT8, DATA_TYPE_SINT32, DATA_TYPE_SINT32 } },
+    };
+
+    std::vector<float> inputValues(K), matrixValues(uint64_t(M) * K), biasValues(M);
+    float inputMax = 0.0f, matrixMax = 0.0f;
+    for (uint32_t k = 0; k < K; ++k) {
+        float spread = 1.0f / (1.0f + k / 16.0f);
+        inputValues[k] = (float((k * 37) % 101) / 101.0f - 0.5f) * 2.0f * spread;
+        inputMax = std::max(inputMax, std::fabs(inputValues[k]));
+        for (uint32_t m = 0; m < M; ++m) {
+            float w = (float((m * 7 + k * 13) % 97) / 97.0f - 0.5f) * spread;
+            matrixValues[uint64_t(m) * K + k] = w;
+            matrixMax = std::max(matrixMax, std::fabs(w));
+        }
+    }
+    for (uint32_t m = 0; m < M; ++m) biasValues[m] = float(m % 11) / 11.0f - 0.3f;
+
+    std::vector<float> reference(M);
+    double referenceMs = 0.0;
+    uint64_t referenceBytes = 0;
+    for (Config const &config : configs) {
+        MatMulAddTypes const &t = config.types;
+        uint32_t strideK = (SizeofType(t.matrix) * K + 31) & ~31u;
+        std::vector<uint8_t> input(SizeofType(t.input) * K), matrix(uint64_t(strideK) * M), bias(SizeofType(t.bias) * M),
+            output(SizeofType(t.output) * M);
+        const float inputScale = IsIntegerType(t.input) ? inputMax / 127.0f : 1.0f;
+        const float matrixScale = IsIntegerType(t.matrix) ? matrixMax / 127.0f : 1.0f;
+        const float biasScale = IsIntegerType(t.bias) ? inputScale * matrixScale : 1.0f;
+        const float outputScale = IsIntegerType(t.output) ? inputScale * matrixScale : 1.0f;
+        for (uint32_t k = 0; k < K; ++k) SetDataFloat(input.data(), t.input, 0, k, inputValues[k] / inputScale);
+        for (uint32_t m = 0; m < M; ++m) {
+            for (uint32_t k = 0; k < K; ++k) SetDataFloat(matrix.data(), t.matrix, m * strideK, k, matrixValues[uint64_t(m) * K + k] / matrixScale);
+            SetDataFloat(bias.data(), t.bias, 0, m, biasValues[m] / biasScale);
+        }
+        uint64_t bytes = input.size() + matrix.size() + bias.size() + output.size();
+        MemoryCharge charge(benchMemory, MEMORY_POOL_DEVICE, MEMORY_WEIGHTS, matrix.size() + bias.size(), "precision weights");
+
+        std::vector<float> interpreted(K);
+        SweepRecord r = { "cpu", "gemv_precision", M, K, 1, config.name, pool.NumThreads(), {} };
+        r.samplesMs = MeasureMs(samples, [&] {
+            LoadInterpretedInput(t, input.data(), K, interpreted.data());
+            MixedVectorMulAddKernel kernel = { t, output.data(), matrix.data(), interpreted.data(), bias.data(), M, K, strideK };
+            CpuDispatch(pool, kernel, CpuGroupCount(M, MixedVectorMulAddKernel::NumThreads.x), 1, 1);
+        });
+        records.push_back(r);
+
+        double ms = Median(r.samplesMs);
+        float maxError = 0.0f;
+        for (uint32_t m = 0; m < M; ++m) {
+            float v = GetDataFloat(output.data(), t.output, 0, m) * outputScale;
+            if (&config == configs) reference[m] = v;
+            maxError = std::max(maxError, std::fabs(v - reference[m]));
+        }
+        if (&config == configs) {
+            referenceMs = ms;
+            referenceBytes = bytes;
+        }
+        std::cout << M << "," << K << "," << config.name << "," << bytes << "," << ms << "," << double(bytes) / referenceBytes << ","
+                  << (ms > 0.0 ? referenceMs / ms : 0.0) << "," << maxError << std::endl;
+    }
+}
+
+// Dense F32 GEMV vs the two chained MulAdds of its rank-r factors, for
+// every rank in ranks. The layer has a decaying spectrum plus noise
+// (FillLowRankTestMatrix), so the error falls with the rank; it is
+// factored once, to the largest rank, and truncated from there.
+static void BenchLowRank(ThreadPool &pool, uint32_t samples, uint32_t M, uint32_t K, std::vector<uint32_t> const &ranks,
+                         std::vector<SweepRecord> &records)
+{
+    BenchProblem dense(DATA_TYPE_FLOAT32, M, K, 1);
+    FillLowRankTestMatrix(reinterpret_cast<float *>(dense.matrix.data()), M, K, dense.strideK, 64, 0.002f);
+    SweepRecord denseRecord = { "cpu", "gemv", M, K, 1, "F32", pool.NumThreads(), {} };
+    denseRecord.samplesMs = MeasureMs(samples, [&] { dense.Run(pool, "gemv"); });
+    double denseMs = Median(denseRecord.samplesMs);
+    const uint64_t denseBytes = dense.matrix.size();
+
+    LowRankFactors factors = FactorizeLowRank(reinterpret_cast<float const *>(dense.matrix.data()), M, K, dense.strideK,
+                                              *std::max_element(ranks.begin(), ranks.end()));
+    double normSq = 0.0;
+    for (uint32_t m = 0; m < M; ++m) normSq += double(GetDataFloat(dense.output.data(), DATA_TYPE_FLOAT32, 0, m)) * GetDataFloat(dense.output.data(), DATA_TYPE_FLOAT32, 0, m);
+
+    for (uint32_t rank : ranks) {
+        LowRankFactors cut = factors;
+        cut.Truncate(rank);
+        LowRankLayout layout = MakeLowRankLayout(DATA_TYPE_FLOAT32, M, K, cut.rank);
+        std::vector<uint8_t> u(layout.UBytes()), v(layout.VBytes()), intermediate(4 * cut.rank), output(dense.output.size());
+        StoreLowRankFactors(cut, layout, u.data(), v.data());
+        MemoryCharge charge(benchMemory, MEMORY_POOL_DEVICE, MEMORY_WEIGHTS, u.size() + v.size(), "low-rank factors");
+
+        SweepRecord r = { "cpu", "gemv_lowrank_" + std::to_string(cut.rank), M, K, 1, "F32", pool.NumThreads(), {} };
+        r.samplesMs = MeasureMs(samples, [&] {
+            CpuLowRankVectorMulAdd(pool, layout, output.data(), u.data(), v.data(), dense.input.data(), dense.bias.data(), intermediate.data());
+        });
+        records.push_back(r);
+
+        double errSq = 0.0;
+        for (uint32_t m = 0; m < M; ++m) {
+            double d = GetDataFloat(output.data(), DATA_TYPE_FLOAT32, 0, m) - GetDataFloat(dense.output.data(), DATA_TYPE_FLOAT32, 0, m);
+            errSq += d * d;
+        }
+        double ms = Median(r.samplesMs);
+        std::cout << M << "," << K << "," << cut.rank << "," << layout.BytesMoved() << "," << double(layout.BytesMoved()) / denseBytes << ","
+                  << denseMs << "," << ms << "," << (ms > 0.0 ? denseMs / ms : 0.0) << "," << cut.RelativeError(cut.rank) << ","
+                  << (normSq > 0.0 ? std::sqrt(errSq / normSq) : 0.0) << std::endl;
+    }
+}
+
+// A stack of GEMV layers whose weights live in host memory and are made
+// resident in a device budget of a fraction of their total. Every pass runs
+// the layers forward, then backward, like a training step; a layer whose
+// weights were evicted is uploaded (copied) again before its dispatch, and
+// the least recently used resident layers make room for it.
+static void BenchResidency(ThreadPool &pool, uint32_t samples, bool quick, std::vector<SweepRecord> &records)
+{
+    const uint32_t numLayers = 8;
+    const uint32_t M = quick ? 256 : 1024, K = quick ? 256 : 1024;
+    std::vector<std::unique_ptr<BenchProblem>> layers;
+    for (uint32_t l = 0; l < numLayers; ++l) layers.emplace_back(new BenchProblem(DATA_TYPE_FLOAT16, M, K, 1));
+    const uint64_t layerBytes = layers[0]->matrix.size();
+
+    for (uint32_t resident : { numLayers, numLayers * 3 / 4, numLayers / 2 }) {
+        MemoryAccount device;
+        device.SetBudget(MEMORY_POOL_DEVICE, layerBytes * resident);
+        std::vector<std::vector<uint8_t>> deviceWeights(numLayers);
+        std::vector<MemoryCharge> charges(numLayers);
+        uint64_t uploads = 0;
+
+        auto Run = [&](uint32_t l) {
+            BenchProblem &layer = *layers[l];
+            if (charges[l].Ok()) {
+                charges[l].Touch();
+            } else {
+                charges[l] = MemoryCharge(device, MEMORY_POOL_DEVICE, MEMORY_WEIGHTS, layerBytes, "layer weights", [&, l] {
+                    deviceWeights[l].clear();
+                    deviceWeights[l].shrink_to_fit();
+                });
+                deviceWeights[l] = layer.matrix;
+                uploads++;
+            }
+            VectorMulAddKernel kernel = { layer.dt, layer.output.data(), deviceWeights[l].data(), layer.input.data(), layer.bias.data(),
+                                          layer.M, layer.K, layer.strideK };
+            CpuDispatch(pool, kernel, CpuGroupCount(layer.M, VectorMulAddKernel::NumThreads.x), 1, 1);
+        };
+        SweepRecord r = { "cpu", "residency_" + std::to_string(resident) + "of" + std::to_string(numLayers), M, K, numLayers,
+                          DataTypeName(DATA_TYPE_FLOAT16), pool.NumThreads(), {} };
+        // Uploads and evictions are counted from the end of the warm-up pass
+        uint32_t pass = 0;
+        uint64_t warmUploads = 0, warmEvictions = 0;
+        r.samplesMs = MeasureMs(samples, [&] {
+            if (pass++ == 1) {
+                warmUploads = uploads;
+                warmEvictions = device.Evictions(MEMORY_POOL_DEVICE);
+            }
+            for (uint32_t l = 0; l < numLayers; ++l) Run(l);
+            for (uint32_t l = numLayers; l-- > 0;) Run(l);
+        });
+        records.push_back(r);
+
+        std::cout << resident << "/" << numLayers << "," << device.Budget(MEMORY_POOL_DEVICE) / 1024 << "," << Median(r.samplesMs) << ","
+                  << double(uploads - warmUploads) / samples << "," << double(device.Evictions(MEMORY_POOL_DEVICE) - warmEvictions) / samples << ","
+                  << device.Peak(MEMORY_POOL_DEVICE) / 1024 << std::endl;
+    }
+}
+
+// A model of layers updated in place each step (fine-tuning): a fraction
+// of their 8-row blocks is rewritten, then the device copies are brought up
+// to date, either by uploading every layer again or through the weight
+// cache, which copies the dirty rows only. Only the upload is timed, the
+// rewrite is not; delta_ms includes the rehash of the dirty blocks, which
+// is also reported on its own. A second instance of the model
+// is loaded first: its layers are content hits, and the model is detached
+// from it (one full upload per layer) before the measured steps.
+static void BenchWeightCache(uint32_t samples, bool quick, std::vector<SweepRecord> &records)
+{
+    const uint32_t numLayers = 8, blockRows = 8;
+    const uint32_t M = quick ? 256 : 1024, K = quick ? 256 : 1024;
+    std::vector<std::unique_ptr<BenchProblem>> layers;
+    for (uint32_t l = 0; l < numLayers; ++l) {
+        layers.emplace_back(new BenchProblem(DATA_TYPE_FLOAT16, M, K, 1));
+        for (uint32_t m = 0; m < M; ++m) SetDataFloat(layers[l]->matrix.data(), DATA_TYPE_FLOAT16, m * layers[l]->strideK, 0, float(l));
+    }
+    const uint32_t rowBytes = layers[0]->strideK;
+    const uint64_t layerBytes = layers[0]->matrix.size();
+
+    std::vector<std::vector<uint8_t>> deviceWeights(numLayers, std::vector<uint8_t>(layerBytes));
+    SweepRecord full = { "cpu", "upload_full", M, K, numLayers, DataTypeName(DATA_TYPE_FLOAT16), 1, {} };
+    full.samplesMs = MeasureMs(samples, [&] {
+        for (uint32_t l = 0; l < numLayers; ++l) memcpy(deviceWeights[l].data(), layers[l]->matrix.data(), layerBytes);
+    });
+    records.push_back(full);
+    double fullMs = Median(full.samplesMs);
+
+    for (uint32_t percent : { 1u, 10u, 50u }) {
+        MemoryAccount device;
+        CpuWeightBackend backend;
+        WeightResidencyCache<CpuWeightBackend> cache(backend, device);
+        std::vector<WeightResidencyCache<CpuWeightBackend>::Handle> model(numLayers), instance(numLayers);
+        for (uint32_t l = 0; l < numLayers; ++l) {
+            model[l] = cache.Acquire("layer", layers[l]->matrix.data(), layerBytes, rowBytes);
+            instance[l] = cache.Acquire("layer", layers[l]->matrix.data(), layerBytes, rowBytes);
+        }
+        const uint64_t loadSkipped = cache.GetStats().skippedBytes;
+        // The first update detaches each layer from the other instance
+        for (uint32_t l = 0; l < numLayers; ++l) {
+            cache.MarkDirty(model[l], 0, 1);
+            cache.Sync(model[l], layers[l]->matrix.data());
+        }
+
+        // Rewrites a share of the 8-row blocks of every layer; untimed
+        uint32_t step = 0;
+        auto Update = [&] {
+            step++;
+            for (uint32_t l = 0; l < numLayers; ++l) {
+                BenchProblem &layer = *layers[l];
+                for (uint32_t block = 0; block * blockRows < M; ++block) {
+                    uint32_t seed[] = { block, step, l };
+                    if (ContentHash64(seed, sizeof(seed)) % 100 >= percent) continue;
+                    uint32_t end = std::min(M, (block + 1) * blockRows);
+                    for (uint32_t m = block * blockRows; m < end; ++m)
+                        SetDataFloat(layer.matrix.data(), layer.dt, m * layer.strideK, 1, float(step % 16));
+                    cache.MarkDirty(model[l], block * blockRows, end);
+                }
+            }
+        };
+        // Counted from the end of the warm-up step
+        WeightResidencyCache<CpuWeightBackend>::Stats warm = {};
+        SweepRecord r = { "cpu", "upload_delta_" + std::to_string(percent), M, K, numLayers, DataTypeName(DATA_TYPE_FLOAT16), 1, {} };
+        r.samplesMs = MeasurePreparedMs(samples, Update, [&] {
+            if (step == 2) warm = cache.GetStats();
+            for (uint32_t l = 0; l < numLayers; ++l) cache.Sync(model[l], layers[l]->matrix.data());
+        });
+        records.push_back(r);
+
+        double ms = Median(r.samplesMs);
+        WeightResidencyCache<CpuWeightBackend>::Stats const &stats = cache.GetStats();
+        std::cout << percent << "," << fullMs << "," << ms << "," << (ms > 0.0 ? fullMs / ms : 0.0) << ","
+                  << double(stats.uploadedBytes - warm.uploadedBytes) / samples / 1024 << ","
+                  << double(stats.skippedBytes - warm.skippedBytes) / samples / 1024 << ","
+                  << double(stats.hashedBytes - warm.hashedBytes) / samples / 1024 << "," << (stats.hashMs - warm.hashMs) / samples << ","
+                  << loadSkipped / 1024 << std::endl;
+        for (uint32_t l = 0; l < numLayers; ++l) {
+            cache.Release(model[l]);
+            cache.Release(instance[l]);
+        }
+    }
+}
+
+static int CompareRevisions(ResultsStore const &store, std::string const &baselineRev, std::string const &candidateRev,
+                            double alpha, double threshold)
+{
+    std::map<std::string, SweepRecord> baseline, candidate;
+    if (!store.Load(baselineRev, baseline)) {
+        std::cerr << "No stored results for baseline " << baselineRev << " (" << store.PathFor(baselineRev) << ")" << std::endl;
+        return EXIT_FAILURE;
+    }
+    if (!store.Load(candidateRev, candidate)) {
+        std::cerr << "No stored results for candidate " << candidateRev << " (" << store.PathFor(candidateRev) << ")" << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    std::cout << "compare " << candidateRev << " against " << baselineRev
+              << " (alpha " << alpha << ", threshold " << threshold * 100 << "%)" << std::endl;
+    std::cout << "backend,variant,M,K,batch,type,threads,base_ms,cand_ms,ratio,ci_low,ci_high,p,verdict" << std::endl;
+    int regressions = 0;
+    for (Comparison const &c : CompareResults(baseline, candidate, alpha, threshold)) {
+        std::cout << c.key << "," << c.baselineMs << "," << c.candidateMs << "," << c.ci.ratio << ","
+                  << c.ci.low << "," << c.ci.high << "," << c.pValue << ","
+                  << (c.regression ? "REGRESSION" : "ok") << std::endl;
+        regressions += c.regression;
+    }
+    std::cout << regressions << " significant regression(s)" << std::endl;
+    return regressions ? 1 : 0;
+}
+
+int main(int argc, char** argv) {
+    uint32_t samples = 10;
+    uint32_t maxThreads = 0;
+    bool pin = false;
+    bool quick = false;
+    bool sweep = true;
+    bool scaling = true;
+    bool sparse = true;
+    bool epilogue = true;
+    bool typedViews = true;
+    bool train = true;
+    bool residency = true;
+    bool precision = true;
+    bool lowRank = true;
+    bool weightCache = true;
+    bool save = false;
+    std::string storeDir = "bench_results";
+    std::string revision;
+    std::string candidate;
+    std::string compareBaseline;
+    std::string tracePath;
+    double alpha = 0.01;
+    double threshold = 0.05;
+    for (int i = 1; i < argc; ++i) {
+        if (strcmp(argv[i], "--samples") == 0 && i + 1 < argc) samples = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc) maxThreads = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--pin") == 0) pin = true;
+        else if (strcmp(argv[i], "--quick") == 0) quick = true;
+        else if (strcmp(argv[i], "--no-sweep") == 0) sweep = false;
+        else if (strcmp(argv[i], "--no-scaling") == 0) scaling = false;
+        else if (strcmp(argv[i], "--no-sparse") == 0) sparse = false;
+        else if (strcmp(argv[i], "--no-epilogue") == 0) epilogue = false;
+        else if (strcmp(argv[i], "--no-typed") == 0) typedViews = false;
+        else if (strcmp(argv[i], "--no-train") == 0) train = false;
+        else if (strcmp(argv[i], "--no-residency") == 0) residency = false;
+        else if (strcmp(argv[i], "--no-precision") == 0) precision = false;
+        else if (strcmp(argv[i], "--no-lowrank") == 0) lowRank = false;
+        else if (strcmp(argv[i], "--no-weightcache") == 0) weightCache = false;
+        else if (strcmp(argv[i], "--save") == 0) save = true;
+        else if (strcmp(argv[i], "--store") == 0 && i + 1 < argc) storeDir = argv[++i];
+        else if (strcmp(argv[i], "--rev") == 0 && i + 1 < argc) revision = argv[++i];
+        else if (strcmp(argv[i], "--candidate") == 0 && i + 1 < argc) candidate = argv[++i];
+        else if (strcmp(argv[i], "--compare") == 0 && i + 1 < argc) compareBaseline = argv[++i];
+        else if (strcmp(argv[i], "--alpha") == 0 && i + 1 < argc) alpha = atof(argv[++i]);
+        else if (strcmp(argv[i], "--threshold") == 0 && i + 1 < argc) threshold = atof(argv[++i]);
+        else if (strcmp(argv[i], "--trace") == 0 && i + 1 < argc) tracePath = argv[++i];
+    }
+
+    ResultsStore store(storeDir);
+    if (revision.empty()) revision = GetGitRevision();
+    if (!compareBaseline.empty()) {
+        return CompareRevisions(store, compareBaseline, candidate.empty() ? revision : candidate, alpha, threshold);
+    }
+    std::vector<SweepRecord> records;
+
+    TraceSession traceSession(tracePath);
+    std::unique_ptr<ThreadPool> pool(new ThreadPool(maxThreads, pin));
+    maxThreads = pool->NumThreads();
+
+    if (sweep) {
+        TRACE_SCOPE("sweep section");
+        std::vector<std::pair<uint32_t, uint32_t>> shapes = { { 64, 64 }, { 256, 256 }, { 1024, 1024 } };
+        if (!quick) shapes.push_back({ 4096, 1024 });
+        const DataType types[] = { DATA_TYPE_FLOAT32, DATA_TYPE_FLOAT16, DATA_TYPE_FLOAT8_E4M3 };
+        const char *variants[] = { "gemv", "batched" };
+
+        PrintSweepHeader(std::cout);
+        for (const char *variant : variants) {
+            for (auto &shape : shapes) {
+                for (DataType dt : types) {
+                    uint32_t batch = strcmp(variant, "batched") == 0 ? 8 : 1;
+                    BenchProblem problem(dt, shape.first, shape.second, batch);
+                    SweepRecord r = { "cpu", variant, shape.first, shape.second, batch, DataTypeName(dt), maxThreads, {} };
+                    r.samplesMs = MeasureMs(samples, [&] { problem.Run(*pool, variant); });
+                    PrintSweepRecord(std::cout, r);
+                    records.push_back(r);
+                }
+            }
+        }
+    }
+
+    if (sparse) {
+        TRACE_SCOPE("sparse section");
+        std::vector<std::pair<uint32_t, uint32_t>> shapes = { { 256, 256 }, { 1024, 1024 } };
+        if (!quick) shapes.push_back({ 4096, 1024 });
+        const DataType types[] = { DATA_TYPE_FLOAT32, DATA_TYPE_FLOAT16 };
+
+        std::cout << std::endl << "sparse: dense vs 2:4 GEMV" << std::endl;
+        std::cout << "M,K,type,dense_bytes,sparse_bytes,dense_macs,sparse_macs,dense_ms,sparse_ms,speedup" << std::endl;
+        for (auto &shape : shapes) {
+            for (DataType dt : types) {
+                BenchProblem problem(dt, shape.first, shape.second, 1);
+                Sparse24Matrix sp = PackSparse24(dt, problem.matrix.data(), problem.M, problem.K, problem.strideK, 32);
+                UnpackSparse24(sp, problem.matrix.data(), problem.strideK);
+
+                SweepRecord dense = { "cpu", "gemv", problem.M, problem.K, 1, DataTypeName(dt), maxThreads, {} };
+                dense.samplesMs = MeasureMs(samples, [&] { problem.Run(*pool, "gemv"); });
+                SweepRecord sparse24 = { "cpu", "sparse24", problem.M, problem.K, 1, DataTypeName(dt), maxThreads, {} };
+                sparse24.samplesMs = MeasureMs(samples, [&] {
+                    SparseVectorMulAddKernel kernel = { dt, problem.output.data(), &sp, problem.input.data(), problem.bias.data() };
+                    CpuDispatch(*pool, kernel, CpuGroupCount(problem.M, SparseVectorMulAddKernel::NumThreads.x), 1, 1);
+                });
+                records.push_back(sparse24);
+
+                double denseMs = Median(dense.samplesMs), sparseMs = Median(sparse24.samplesMs);
+                std::cout << problem.M << "," << problem.K << "," << DataTypeName(dt) << ","
+                          << problem.matrix.size() << "," << sp.SizeInBytes() << ","
+                          << uint64_t(problem.M) * problem.K << "," << uint64_t(problem.M) * Sparse24Groups(problem.K) * 2 << ","
+                          << denseMs << "," << sparseMs << "," << (sparseMs > 0.0 ? denseMs / sparseMs : 0.0) << std::endl;
+            }
+        }
+    }
+
+    if (epilogue) {
+        TRACE_SCOPE("epilogue section");
+        using ScaleRelu = Epilogue<EpilogueRowScale, EpilogueRelu>;
+        std::vector<std::pair<uint32_t, uint32_t>> shapes = { { 1024, 256 }, { 4096, 64 } };
+        if (!quick) shapes.push_back({ 16384, 64 });
+
+        std::cout << std::endl << "epilogue: scale + relu + F16 store, separate pass vs fused" << std::endl;
+        std::cout << "M,K,type,unfused_ms,fused_ms,speedup" << std::endl;
+        for (auto &shape : shapes) {
+            BenchProblem problem(DATA_TYPE_FLOAT32, shape.first, shape.second, 1);
+            std::vector<float> scale(problem.M, 0.5f);
+            std::vector<uint8_t> converted(SizeofType(DATA_TYPE_FLOAT16) * problem.M);
+            EpilogueParams params;
+            params.rowScale = scale.data();
+
+            SweepRecord unfused = { "cpu", "epilogue_separate", problem.M, problem.K, 1, "F32", maxThreads, {} };
+            unfused.samplesMs = MeasureMs(samples, [&] {
+                problem.Run(*pool, "gemv");
+                pool->ParallelFor(problem.M, 0, [&](uint64_t begin, uint64_t end) {
+                    for (uint32_t m = uint32_t(begin); m < end; ++m) {
+                        float v = GetDataFloat(problem.output.data(), DATA_TYPE_FLOAT32, 0, m);
+                        SetDataFloat(converted.data(), DATA_TYPE_FLOAT16, 0, m, ScaleRelu::Apply(v, m, params));
+                    }
+                });
+            });
+            SweepRecord fusedRecord = { "cpu", "epilogue_fused", problem.M, problem.K, 1, "F32", maxThreads, {} };
+            fusedRecord.samplesMs = MeasureMs(samples, [&] {
+                FusedVectorMulAddKernel<ScaleRelu> kernel = { problem.dt, DATA_TYPE_FLOAT16, converted.data(), problem.matrix.data(),
+                                                              problem.input.data(), problem.bias.data(), problem.M, problem.K, problem.strideK, params };
+                CpuDispatch(*pool, kernel, CpuGroupCount(problem.M, 4), 1, 1);
+            });
+            records.push_back(unfused);
+            records.push_back(fusedRecord);
+
+            double u = Median(unfused.samplesMs), f = Median(fusedRecord.samplesMs);
+            std::cout << problem.M << "," << problem.K << ",F32," << u << "," << f << "," << (f > 0.0 ? u / f : 0.0) << std::endl;
+        }
+    }
+
+    if (typedViews) {
+        TRACE_SCOPE("typed section");
+        std::cout << std::endl << "typed: runtime DataType vs typed views" << std::endl;
+        std::cout << "M,K,type,runtime_ms,typed_ms,speedup" << std::endl;
+        bool match = true;
+        match &= BenchTyped<DATA_TYPE_FLOAT32, 256, 256>(*pool, samples, records);
+        match &= BenchTyped<DATA_TYPE_FLOAT16, 256, 256>(*pool, samples, records);
+        match &= BenchTyped<DATA_TYPE_FLOAT8_E4M3, 256, 256>(*pool, samples, records);
+        match &= BenchTyped<DATA_TYPE_FLOAT32, 1024, 1024>(*pool, samples, records);
+        match &= BenchTyped<DATA_TYPE_FLOAT16, 1024, 1024>(*pool, samples, records);
+        match &= BenchTyped<DATA_TYPE_FLOAT8_E4M3, 1024, 1024>(*pool, samples, records);
+        if (!match) {
+            std::cerr << "typed views produced different results than the runtime path" << std::endl;
+            return EXIT_FAILURE;
+        }
+    }
+
+    if (train) {
+        TRACE_SCOPE("train section");
+        uint32_t batch = quick ? 1024 : 4096;
+        std::cout << std::endl << "train: MLP training step" << std::endl;
+        std::cout << "shape,batch,median_ms,samples_per_s,gmacs" << std::endl;
+        BenchTrain<MlpShape<16, 32, 8>>(*pool, samples, batch, records);
+        BenchTrain<MlpShape<64, 64, 16>>(*pool, samples, batch, records);
+        if (!quick) BenchTrain<MlpShape<128, 128, 32>>(*pool, samples, batch, records);
+    }
+
+    if (residency) {
+        TRACE_SCOPE("residency section");
+        std::cout << std::endl << "residency: layers forward + backward in a device budget, LRU eviction" << std::endl;
+        std::cout << "resident_layers,budget_kb,median_ms,uploads_per_pass,evictions_per_pass,peak_kb" << std::endl;
+        BenchResidency(*pool, samples, quick, records);
+    }
+
+    if (precision) {
+        TRACE_SCOPE("precision section");
+        std::cout << std::endl << "precision: per-operand types vs F32" << std::endl;
+        std::cout << "M,K,config,bytes,median_ms,bytes_ratio,speedup,max_error" << std::endl;
+        BenchPrecision(*pool, samples, 256, 256, records);
+        if (!quick) BenchPrecision(*pool, samples, 2048, 1024, records);
+    }
+
+    if (lowRank) {
+        TRACE_SCOPE("lowrank section");
+        std::cout << std::endl << "lowrank: W ~ U V, two chained MulAdds vs the dense GEMV" << std::endl;
+        std::cout << "M,K,rank,bytes,bytes_ratio,dense_ms,lowrank_ms,speedup,matrix_error,output_error" << std::endl;
+        if (quick) BenchLowRank(*pool, samples, 512, 256, { 8, 16, 32, 64 }, records);
+        else BenchLowRank(*pool, samples, 2048, 1024, { 8, 16, 32, 64, 128 }, records);
+    }
+
+    if (weightCache) {
+        TRACE_SCOPE("weightcache section");
+        std::cout << std::endl << "weightcache: in-place updates, full re-upload vs dirty rows through the weight cache" << std::endl;
+        std::cout << "dirty_pct,full_ms,delta_ms,speedup,uploaded_kb_per_step,skipped_kb_per_step,hashed_kb_per_step,hash_ms_per_step,"
+                     "load_skipped_kb"
+                  << std::endl;
+        BenchWeightCache(samples, quick, records);
+    }
+
+    if (scaling) {
+        TRACE_SCOPE("scaling section");
+        uint32_t M = quick ? 512 : 2048;
+        uint32_t K = quick ? 512 : 1024;
+        BenchProblem problem(DATA_TYPE_FLOAT16, M, K, 1);
+        std::cout << std::endl << "scaling: gemv " << M << "x" << K << " F16" << std::endl;
+        std::cout << "threads,median_ms,speedup,efficiency,steals" << std::endl;
+        pool.reset();
+        double t1 = 0.0;
+        for (uint32_t n = 1; n <= maxThreads; ++n) {
+            ThreadPool scaled(n, pin);
+            SweepRecord r = { "cpu", "gemv", M, K, 1, DataTypeName(DATA_TYPE_FLOAT16), n, {} };
+            r.samplesMs = MeasureMs(samples, [&] { problem.Run(scaled, "gemv"); });
+            records.push_back(r);
+            double t = Median(r.samplesMs);
+            if (n == 1) t1 = t;
+            double speedup = t > 0.0 ? t1 / t : 0.0;
+            std::cout << n << "," << t << "," << speedup << "," << speedup / n << "," << scaled.StealCount() << std::endl;
+        }
+    }
+
+    std::cout << std::endl;
+    benchMemory.Report(std::cout);
+
+    if (save) {
+        if (!store.Save(revision, records)) {
+            std::cerr << "Failed to write " << store.PathFor(revision) << std::endl;
+            return EXIT_FAILURE;
+        }
+        std::cout << "saved " << records.size() << " points to " << store.PathFor(revision) << std::endl;
+    }
+    return 0;
+}
@@ -0,0 +1,692 @@
+#include <vector>
+#include <iostream>
+#include <cstring>
+#include <cstdlib>
+#include <cmath>
+#include <algorithm>
+
+#include "include/util.h"
+#include "include/grouped_gemv.h"
+#include "include/cpu_backend.h"
+#include "include/upload_util.h"
+#include "include/trace.h"
+#include "include/startup_graph.h"
+#include "include/memory_budget.h"
+#include "include/compute_graph.h"
+#include "include/low_rank.h"
+#include "include/weight_cache.h"
+
+// CPU-backend counterpart of main.cpp: same buffers, same verification,
+// but the shader is emulated on the CPU so it runs without a D3D12 device.
+//
+//   CpuVectorMulAdd [--grouped | --sparse | --fused | --typed | --tiled BUDGET_BYTES | --train | --graph
+//                    | --low-rank RANK | --weight-cache | --split DEVICES [--split-runs N]]
+//                   [--threads N] [--pin] [--size M K] [--budget BYTES] [--trace FILE]
+//
+// --fused runs the row-scale + ReLU epilogue permutation with F16 output.
+// --typed runs the kernel on compile-time typed views (linalg_host.h) with
+// the shader's fixed 8x8 shape.
+// --tiled streams the matrix through a two-slot row-tile window sized so
+// that window + vectors fit in BUDGET_BYTES (tiled_gemv.h).
+// --train checks the MLP training step (mlp_training.h): gradients against
+// central differences, one backend step against the CPU reference, and
+// that a short training run reduces the loss.
+// --graph runs two chained layers as a compute graph (compute_graph.h),
+// once with plain and once with split barriers, checks the output and
+// that no op ran in a state its barriers did not produce, and reports the
+// barriers against hand-written transitions.
+// --low-rank factors a synthetic rank-16 layer of --size M K to RANK
+// (low_rank.h), runs the two chained dispatches against their CPU
+// reference and reports the error against the dense layer, which must be
+// tiny when RANK >= 16.
+// --weight-cache checks the weight residency cache (weight_cache.h): the
+// content hash against reference values, that identical layers share one
+// upload, that an in-place row update copies and rehashes only around the
+// dirty rows, that updating a shared layer leaves the other holder intact
+// (and is refused when the budget has no room to detach it), and that
+// released layers are evicted under --budget (default: three layers) and
+// uploaded again when needed.
+// --split splits the rows across several CPU "devices" (row_split.h), e.g.
+// --split 2,1x3 is a device with 2 threads and one with 1 thread that runs
+// every dispatch 3 times; the slices are rebalanced after each of the
+// --split-runs runs (default 4).
+// --budget caps the emulated device memory (memory_budget.h): the
+// dispatch buffers are charged to it, and a dense matrix that does not fit
+// next to the vectors runs tiled in what the budget leaves. The memory
+// report at the end lists current and peak usage per category.
+// --trace writes a Chrome trace_event JSON of the run (trace.h).
+//
+// Dense modes generate the matrix straight into the dispatch buffer and
+// build the golden on the same pass (upload_util.h), so the matrix is
+// neither copied nor read a second time for verification.
+
+// Regression samples for the --train check: a fixed smooth function of the
+// input, so the MLP has something learnable.
+template <typename Shape>
+static std::vector<float> MakeMlpSamples(uint32_t batch)
+{
+    std::vector<float> samples(uint64_t(batch) * Shape::SampleFloats);
+    for (uint32_t s = 0; s < batch; ++s) {
+        float* x = &samples[uint64_t(s) * Shape::SampleFloats];
+        for (uint32_t i = 0; i < Shape::Inputs; ++i) x[i] = float((s * 7 + i * 13) % 17) / 8.0f - 1.0f;
+        for (uint32_t o = 0; o < Shape::Outputs; ++o) {
+            float dot = 0.0f;
+            for (uint32_t i = 0; i < Shape::Inputs; ++i) dot += x[i] * float((o + i) % 5 - 2) * 0.25f;
+            x[Shape::Inputs + o] = std::sin(dot);
+        }
+    }
+    return samples;
+}
+
+static int RunTrainCheck(ThreadPool& pool)
+{
+    using Shape = MlpShape<16, 32, 8>;
+    const uint32_t batch = 256;
+    const MlpOptimizerParams opt;
+    std::vector<float> samples = MakeMlpSamples<Shape>(batch);
+    std::vector<float> params;
+    MlpInitParams<Shape>(params);
+
+    TraceScope checkSpan("gradient check");
+    float gradError = MlpGradientCheck<Shape>(params, samples.data(), 16);
+    checkSpan.End();
+    std::cout << "Gradient check: max relative error " << gradError << std::endl;
+    if (gradError > 1e-2f) return EXIT_FAILURE;
+
+    std::vector<float> refParams = params, refGrads(Shape::ParamWords, 0.0f), refMomentum(Shape::ParamWords, 0.0f);
+    std::vector<float> grads(Shape::ParamWords, 0.0f), momentum(Shape::ParamWords, 0.0f), losses(batch);
+    auto Step = [&] {
+        TRACE_SCOPE("train step");
+        MlpTrainStepKernel<Shape> train = { params.data(), grads.data(), samples.data(), losses.data(), batch };
+        CpuDispatch(pool, train, CpuGroupCount(batch, MlpTrainStepKernel<Shape>::NumThreads.x), 1, 1);
+        MlpOptimizerKernel update = { params.data(), grads.data(), momentum.data(), Shape::ParamWords, batch, opt };
+        CpuDispatch(pool, update, CpuGroupCount(Shape::ParamWords, MlpOptimizerKernel::NumThreads.x), 1, 1);
+        float loss = 0.0f;
+        for (float l : losses) loss += l;
+        return loss / batch;
+    };
+
+    // One step on the backend vs the reference; atomics change the
+    // summation order, so compare with a tolerance.
+    float firstLoss = Step();
+    MlpTrainStepReference<Shape>(refParams, refGrads, refMomentum, samples.data(), batch, opt);
+    float maxDiff = 0.0f;
+    for (uint32_t w = 0; w < Shape::ParamWords; ++w) maxDiff = std::max(maxDiff, std::fabs(params[w] - refParams[w]));
+    std::cout << "Backend vs reference step: max parameter difference " << maxDiff << std::endl;
+    if (maxDiff > 1e-5f) return EXIT_FAILURE;
+
+    float loss = firstLoss;
+    for (uint32_t i = 0; i < 200; ++i) loss = Step();
+    std::cout << "Training loss " << firstLoss << " -> " << loss << " after 200 steps" << std::endl;
+    if (!(loss < firstLoss * 0.5f)) return EXIT_FAILURE;
+
+    std::cout << "CPU backend executed successfully and results are correct!" << std::endl;
+    return 0;
+}
+
+// hidden = W1 x + b1, output = W2 hidden + b2 (F32, M x K then M x M) on
+// "device" buffers: uploads and readbacks are copies, the layers
+// dispatches. The ops are added in the order a hand-written harness would
+// issue them; the graph finds the barriers and the overlap.
+static int RunGraphCheck(ThreadPool& pool, uint32_t M, uint32_t K, bool splitBarriers)
+{
+    const DataType dt = DATA_TYPE_FLOAT32;
+    const uint32_t stride1 = (K * 4 + 31) & ~31u, stride2 = (M * 4 + 31) & ~31u;
+    std::vector<uint8_t> hostInput(K * 4), hostMatrix1(uint64_t(stride1) * M), hostBias1(M * 4), hostMatrix2(uint64_t(stride2) * M),
+        hostBias2(M * 4);
+    for (uint32_t k = 0; k < K; ++k) SetDataFloat(hostInput.data(), dt, 0, k, float(k % 5) - 2.0f);
+    for (uint32_t m = 0; m < M; ++m) {
+        for (uint32_t k = 0; k < K; ++k) SetDataFloat(hostMatrix1.data(), dt, m * stride1, k, float((m + 2 * k) % 7) * 0.125f);
+        for (uint32_t k = 0; k < M; ++k) SetDataFloat(hostMatrix2.data(), dt, m * stride2, k, float((3 * m + k) % 5) * 0.0625f);
+        SetDataFloat(hostBias1.data(), dt, 0, m, 1.0f);
+        SetDataFloat(hostBias2.data(), dt, 0, m, -0.5f);
+    }
+
+    std::vector<uint8_t> input(hostInput.size()), matrix1(hostMatrix1.size()), bias1(hostBias1.size()), hidden(M * 4),
+        matrix2(hostMatrix2.size()), bias2(hostBias2.size()), output(M * 4), hiddenReadback(M * 4), outputReadback(M * 4);
+
+    ComputeGraph graph;
+    graph.SetSplitBarriers(splitBarriers);
+    auto inputRes = graph.AddResource("input", GRAPH_STATE_COMMON);
+    auto matrix1Res = graph.AddResource("matrix1", GRAPH_STATE_COMMON);
+    auto bias1Res = graph.AddResource("bias1", GRAPH_STATE_COMMON);
+    auto hiddenRes = graph.AddResource("hidden", GRAPH_STATE_COMMON);
+    auto matrix2Res = graph.AddResource("matrix2", GRAPH_STATE_COMMON);
+    auto bias2Res = graph.AddResource("bias2", GRAPH_STATE_COMMON);
+    auto outputRes = graph.AddResource("output", GRAPH_STATE_COMMON);
+
+    auto Upload = [&](const char* name, ComputeGraph::ResourceId res, std::vector<uint8_t>& dst, std::vector<uint8_t> const& src) {
+        graph.AddOp(name, { GraphWrite(res, GRAPH_STATE_COPY_DEST) }, [&dst, &src] { std::copy(src.begin(), src.end(), dst.begin()); });
+    };
+    auto Readback = [&](const char* name, ComputeGraph::ResourceId res, std::vector<uint8_t>& dst, std::vector<uint8_t> const& src) {
+        graph.AddOp(name, { GraphRead(res, GRAPH_STATE_COPY_SOURCE) }, [&dst, &src] { std::copy(src.begin(), src.end(), dst.begin()); });
+    };
+    auto Layer = [&](const char* name, ComputeGraph::ResourceId in, ComputeGraph::ResourceId mat, ComputeGraph::ResourceId bias,
+                     ComputeGraph::ResourceId out, VectorMulAddKernel kernel) {
+        graph.AddOp(name, { GraphRead(in, GRAPH_STATE_SHADER_READ), GraphRead(mat, GRAPH_STATE_SHADER_READ), GraphRead(bias, GRAPH_STATE_SHADER_READ),
+                            GraphWrite(out, GRAPH_STATE_UNORDERED_ACCESS) },
+                    [&pool, kernel] { CpuDispatch(pool, kernel, CpuGroupCount(kernel.M, VectorMulAddKernel::NumThreads.x), 1, 1); });
+    };
+
+    Upload("upload input", inputRes, input, hostInput);
+    Upload("upload matrix1", matrix1Res, matrix1, hostMatrix1);
+    Upload("upload bias1", bias1Res, bias1, hostBias1);
+    Layer("layer1", inputRes, matrix1Res, bias1Res, hiddenRes, { dt, hidden.data(), matrix1.data(), input.data(), bias1.data(), M, K, stride1 });
+    Upload("upload matrix2", matrix2Res, matrix2, hostMatrix2);
+    Upload("upload bias2", bias2Res, bias2, hostBias2);
+    Layer("layer2", hiddenRes, matrix2Res, bias2Res, outputRes, { dt, output.data(), matrix2.data(), hidden.data(), bias2.data(), M, M, stride2 });
+    Readback("readback hidden", hiddenRes, hiddenReadback, hidden);
+    Readback("readback output", outputRes, outputReadback, output);
+
+    uint64_t barriers = 0;
+    graph.Execute([&](std::vector<GraphBarrier> const& batch) {
+        barriers += batch.size();
+        for (GraphBarrier const& b : batch) {
+            std::cout << "   " << graph.ResourceName(b.resource) << ": "
+                      << (b.type == GRAPH_BARRIER_UAV ? "uav" : GraphStateName(b.before) + " -> " + GraphStateName(b.after))
+                      << (b.split == GRAPH_BARRIER_BEGIN_ONLY ? " (begin)" : b.split == GRAPH_BARRIER_END_ONLY ? " (end)" : "") << std::endl;
+        }
+        std::cout << "   -- batch of " << batch.size() << std::endl;
+    });
+    graph.Report(std::cout);
+
+    std::vector<uint8_t> goldenHidden(M * 4), goldenOutput(M * 4);
+    MatMulAdd(dt, goldenHidden.data(), hostMatrix1.data(), hostInput.data(), hostBias1.data(), M, K, stride1);
+    MatMulAdd(dt, goldenOutput.data(), hostMatrix2.data(), goldenHidden.data(), hostBias2.data(), M, M, stride2);
+    bool match = hiddenReadback == goldenHidden && outputReadback == goldenOutput;
+    std::cout << (splitBarriers ? "Split" : "Plain") << " barriers: " << barriers << " barrier entries, results "
+              << (match ? "match" : "DIFFER") << std::endl;
+    return match && graph.Stats().invalidAccesses == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+static int RunLowRankCheck(ThreadPool& pool, uint32_t M, uint32_t K, uint32_t rank)
+{
+    const DataType dt = DATA_TYPE_FLOAT32;
+    const uint32_t trueRank = 16;
+    const uint32_t strideK = (K * 4 + 31) & ~31u;
+    std::vector<uint8_t> matrix(uint64_t(strideK) * M), input(K * 4), bias(M * 4), dense(M * 4), output(M * 4), reference(M * 4);
+    FillLowRankTestMatrix(reinterpret_cast<float*>(matrix.data()), M, K, strideK, trueRank, 0.0f);
+    for (uint32_t k = 0; k < K; ++k) SetDataFloat(input.data(), dt, 0, k, float(k % 9) / 4.0f - 1.0f);
+    for (uint32_t m = 0; m < M; ++m) SetDataFloat(bias.data(), dt, 0, m, 0.5f);
+
+    LowRankFactors factors;
+    {
+        TRACE_SCOPE("factorize");
+        factors = FactorizeLowRank(reinterpret_cast<float const*>(matrix.data()), M, K, strideK, rank);
+    }
+    LowRankLayout layout = MakeLowRankLayout(dt, M, K, factors.rank);
+    std::vector<uint8_t> u(layout.UBytes()), v(layout.VBytes()), intermediate(SizeofType(dt) * layout.rank);
+    StoreLowRankFactors(factors, layout, u.data(), v.data());
+
+    CpuLowRankVectorMulAdd(pool, layout, output.data(), u.data(), v.data(), input.data(), bias.data(), intermediate.data());
+    LowRankMatMulAdd(layout, reference.data(), u.data(), v.data(), input.data(), bias.data());
+    MatMulAdd(dt, dense.data(), matrix.data(), input.data(), bias.data(), M, K, strideK);
+
+    bool match = output == reference;
+    double errSq = 0.0, normSq = 0.0;
+    for (uint32_t m = 0; m < M; ++m) {
+        double d = GetDataFloat(dense.data(), dt, 0, m), o = GetDataFloat(output.data(), dt, 0, m);
+        errSq += (o - d) * (o - d);
+        normSq += d * d;
+    }
+    double outputError = normSq > 0.0 ? std::sqrt(errSq / normSq) : 0.0;
+    std::cout << "Rank " << layout.rank << " of " << std::min(M, K) << ": matrix error " << factors.RelativeError(layout.rank) << ", output error "
+              << outputError << ", " << layout.UBytes() + layout.VBytes() << " of " << matrix.size() << " weight bytes" << std::endl;
+    if (!match) {
+        std::cout << "Low-rank dispatches differ from the CPU reference" << std::endl;
+        return EXIT_FAILURE;
+    }
+    if (layout.rank >= trueRank && outputError > 1e-4) {
+        std::cout << "Rank " << layout.rank << " should reproduce the rank-" << trueRank << " layer" << std::endl;
+        return EXIT_FAILURE;
+    }
+    std::cout << "Low-rank layer executed successfully and matches its reference!" << std::endl;
+    return 0;
+}
+
+static int RunWeightCacheCheck(ThreadPool& pool, uint32_t M, uint32_t K, uint64_t deviceBudget)
+{
+    const DataType dt = DATA_TYPE_FLOAT32;
+    const uint32_t strideK = (K * 4 + 31) & ~31u;
+    const uint64_t layerBytes = uint64_t(strideK) * M;
+    bool ok = true;
+    auto Expect = [&ok](bool condition, const char* what) {
+        if (!condition) std::cout << "Weight cache: " << what << std::endl;
+        ok = ok && condition;
+    };
+
+    Expect(ContentHash64("", 0) == 0xEF46DB3751D8E999ull, "XXH64 of \"\" differs from the reference");
+    Expect(ContentHash64("abc", 3) == 0x44BC2CF5AD770999ull, "XXH64 of \"abc\" differs from the reference");
+    DirtyRows rows;
+    rows.Add(5, 6);
+    rows.Add(1, 3);
+    rows.Add(2, 4);
+    Expect(rows.Ranges().size() == 2 && rows.Rows() == 4, "dirty rows [1,3) [2,4) [5,6) do not merge to [1,4) [5,6)");
+
+    auto MakeLayer = [&](uint32_t seed) {
+        std::vector<uint8_t> layer(layerBytes);
+        for (uint32_t m = 0; m < M; ++m)
+            for (uint32_t k = 0; k < K; ++k) SetDataFloat(layer.data(), dt, m * strideK, k, float((m * 3 + k + seed) % 11) * 0.125f - 0.5f);
+        return layer;
+    };
+    std::vector<std::vector<uint8_t>> layers = { MakeLayer(0), MakeLayer(0), MakeLayer(1), MakeLayer(2) };
+    std::vector<uint8_t> input(K * 4), bias(M * 4), output(M * 4), golden(M * 4);
+    for (uint32_t k = 0; k < K; ++k) SetDataFloat(input.data(), dt, 0, k, float(k % 5) - 2.0f);
+    for (uint32_t m = 0; m < M; ++m) SetDataFloat(bias.data(), dt, 0, m, 0.25f);
+
+    MemoryAccount memory;
+    memory.SetBudget(MEMORY_POOL_DEVICE, deviceBudget ? deviceBudget : 3 * layerBytes);
+    CpuWeightBackend backend;
+    WeightResidencyCache<CpuWeightBackend> cache(backend, memory);
+    using Handle = WeightResidencyCache<CpuWeightBackend>::Handle;
+    auto Resident = [&](Handle h, size_t layer) { return cache.DeviceBuffer(h) == layers[layer]; };
+
+    Handle w0 = cache.Acquire("layer0", layers[0].data(), layerBytes, strideK);
+    Handle w1 = cache.Acquire("layer1", layers[1].data(), layerBytes, strideK);
+    Handle w2 = cache.Acquire("layer2", layers[2].data(), layerBytes, strideK);
+    if (!w0 || !w1 || !w2) {
+        std::cout << "Weight cache: --budget does not hold two " << layerBytes << "-byte layers" << std::endl;
+        return EXIT_FAILURE;
+    }
+    Expect(cache.Shares(w0, w1) && !cache.Shares(w0, w2) && cache.ResidentTensors() == 2, "identical layers are not shared");
+    Expect(cache.GetStats().uploadedBytes == 2 * layerBytes && cache.GetStats().skippedBytes == layerBytes, "identical layer uploaded twice");
+
+    // Fine-tune rows of layer 2 in place: only those rows are copied
+    const uint32_t updated[] = { 1, 2, M / 2, M - 1 };
+    DirtyRows expected;
+    for (uint32_t m : updated) {
+        if (m >= M) continue;
+        SetDataFloat(layers[2].data(), dt, m * strideK, 0, 4.0f + m);
+        cache.MarkDirty(w2, m, m + 1);
+        expected.Add(m, m + 1);
+    }
+    uint64_t before = cache.GetStats().uploadedBytes, hashedBefore = cache.GetStats().hashedBytes;
+    cache.Sync(w2, layers[2].data());
+    Expect(Resident(w2, 2), "updated layer differs from its host copy");
+    Expect(cache.GetStats().uploadedBytes - before == expected.Rows() * strideK, "update copied more than the dirty rows");
+    const uint64_t blockBytes = TensorHashBlockBytes(strideK);
+    Expect(cache.GetStats().hashedBytes - hashedBefore <=
+               expected.Rows() * strideK + expected.Ranges().size() * 2 * blockBytes + TensorHashBlockCount(layerBytes, blockBytes) * 8,
+           "update rehashed more than the blocks of its dirty rows");
+    Expect(cache.Hash(w2) == TensorContentHash(layers[2].data(), layerBytes, strideK), "updated layer keeps its old content hash");
+
+    // Updating layer 1 detaches it from layer 0, which keeps its content
+    SetDataFloat(layers[1].data(), dt, 0, 0, -3.0f);
+    cache.MarkDirty(w1, 0, 1);
+    Expect(cache.Sync(w1, layers[1].data()), "detach of a shared layer was refused");
+    Expect(!cache.Shares(w0, w1) && Resident(w0, 0) && Resident(w1, 1), "update of a shared layer leaked into the other holder");
+
+    // A shared layer the budget has no room to detach is refused, not
+    // updated in place under the other holder
+    {
+        MemoryAccount tight;
+        tight.SetBudget(MEMORY_POOL_DEVICE, layerBytes);
+        WeightResidencyCache<CpuWeightBackend> shared(backend, tight);
+        Handle a = shared.Acquire("layer0", layers[0].data(), layerBytes, strideK);
+        Handle b = shared.Acquire("layer0", layers[0].data(), layerBytes, strideK);
+        std::vector<uint8_t> tuned = layers[0];
+        SetDataFloat(tuned.data(), dt, 0, 0, -3.0f);
+        Expect(a && b, "a one-layer budget does not hold a shared layer");
+        if (a && b) {
+            shared.MarkDirty(a, 0, 1);
+            Expect(!shared.Sync(a, tuned.data()), "detach beyond the budget was not refused");
+            Expect(shared.Shares(a, b) && shared.DeviceBuffer(a) == layers[0], "refused detach changed the shared layer");
+        }
+    }
+
+    {
+        VectorMulAddKernel kernel = { dt, output.data(), cache.DeviceBuffer(w2).data(), input.data(), bias.data(), M, K, strideK };
+        CpuDispatch(pool, kernel, CpuGroupCount(M, VectorMulAddKernel::NumThreads.x), 1, 1);
+        MatMulAdd(dt, golden.data(), layers[2].data(), input.data(), bias.data(), M, K, strideK);
+        Expect(output == golden, "dispatch from the cached layer differs from the golden");
+    }
+
+    // Released layers stay cached until a new one needs the room
+    cache.Release(w0);
+    cache.Release(w1);
+    cache.Release(w2);
+    Handle w3 = cache.Acquire("layer3", layers[3].data(), layerBytes, strideK);
+    Expect(w3 && cache.GetStats().evictions == 1, "a released layer was not evicted for a new one");
+    uint64_t misses = cache.GetStats().misses;
+    Handle again = cache.Acquire("layer0", layers[0].data(), layerBytes, strideK);
+    Expect(again && Resident(again, 0), "evicted layer is not uploaded again");
+    std::cout << "layer0 reacquired: " << (cache.GetStats().misses > misses ? "miss" : "hit") << std::endl;
+
+    cache.Report(std::cout);
+    memory.Report(std::cout);
+    if (!ok) return EXIT_FAILURE;
+    std::cout << "Weight cache shared, updated and evicted its layers correctly!" << std::endl;
+    return 0;
+}
+
+int main(int argc, char** argv) {
+    bool grouped = false;
+    bool sparse = false;
+    bool fused = false;
+    bool typed = false;
+    bool train = false;
+    bool graph = false;
+    uint32_t lowRank = 0;
+    bool weightCache = false;
+    uint64_t tileBudget = 0;
+    uint64_t deviceBudget = 0;
+    bool pin = false;
+    uint32_t threads = 0;
+    uint32_t M = 8;
+    uint32_t K = 8;
+    const char* tracePath = "";
+    const char* splitSpec = nullptr;
+    uint32_t splitRuns = 4;
+    for (int i = 1; i < argc; ++i) {
+        if (strcmp(argv[i], "--grouped") == 0) grouped = true;
+        else if (strcmp(argv[i], "--sparse") == 0) sparse = true;
+        else if (strcmp(argv[i], "--fused") == 0) fused = true;
+        else if (strcmp(argv[i], "--typed") == 0) typed = true;
+        else if (strcmp(argv[i], "--train") == 0) train = true;
+        else if (strcmp(argv[i], "--graph") == 0) graph = true;
+        else if (strcmp(argv[i], "--low-rank") == 0 && i + 1 < argc) lowRank = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--weight-cache") == 0) weightCache = true;
+        else if (strcmp(argv[i], "--tiled") == 0 && i + 1 < argc) tileBudget = strtoull(argv[++i], nullptr, 10);
+        else if (strcmp(argv[i], "--split") == 0 && i + 1 < argc) splitSpec = argv[++i];
+        else if (strcmp(argv[i], "--split-runs") == 0 && i + 1 < argc) splitRuns = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--budget") == 0 && i + 1 < argc) deviceBudget = strtoull(argv[++i], nullptr, 10);
+        else if (strcmp(argv[i], "--pin") == 0) pin = true;
+        else if (strcmp(argv[i], "--trace") == 0 && i + 1 < argc) tracePath = argv[++i];
+        else if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc) threads = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--size") == 0 && i + 2 < argc) {
+            M = atoi(argv[++i]);
+            K = atoi(argv[++i]);
+        }
+    }
+
+    // The typed views carry the shape in their type, like the shader.
+    constexpr uint32_t TYPED_M = 8, TYPED_K = 8;
+    if (typed && (M != TYPED_M || K != TYPED_K)) {
+        std::cout << "--typed runs the fixed " << TYPED_M << "x" << TYPED_K << " shape" << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    // Before the pool, so its workers have joined when the trace is written
+    TraceSession traceSession(tracePath);
+    ThreadPool pool(threads, pin);
+    std::cout << "CPU backend with " << pool.NumThreads() << " threads" << std::endl;
+    if (train) return RunTrainCheck(pool);
+    if (lowRank) return RunLowRankCheck(pool, M, K, lowRank);
+    if (weightCache) return RunWeightCacheCheck(pool, M, K, deviceBudget);
+    if (graph) {
+        if (RunGraphCheck(pool, M, K, false) != EXIT_SUCCESS) return EXIT_FAILURE;
+        return RunGraphCheck(pool, M, K, true);
+    }
+
+    auto AlignTo = [](uint32_t size, uint32_t alignment) {
+        return (size + alignment - 1) & ~(alignment - 1);
+    };
+    auto InitilizeBuffer = [](DataType dt, std::vector<uint8_t>& buffer, uint32_t M, uint32_t K, uint32_t stride_align_bytes, float initValue = 1.0f) {
+        for (uint32_t m = 0; m < M; ++m) {
+            for (uint32_t k = 0; k < K; ++k) {
+                SetDataFloat(buffer.data(), dt, m * stride_align_bytes, k, initValue);
+            }
+        }
+    };
+
+    DataType dt = DATA_TYPE_FLOAT32;
+    constexpr uint32_t STRIDE_ALIGH_BYTES = 32;
+    uint32_t strideK = AlignTo(SizeofType(dt) * K, STRIDE_ALIGH_BYTES);
+
+    uint32_t inputVectorBufferSize = SizeofType(dt) * K;
+    uint32_t matrixBufferSize = strideK * M;
+    uint32_t biasBufferSize = SizeofType(dt) * M;
+    uint32_t outputVectorBufferSize = SizeofType(dt) * M;
+
+    std::vector<GemvGroupEntry> groupEntries;
+    std::vector<GemvGroupTile> groupTiles;
+    if (grouped) {
+        const uint32_t shapes[][2] = { { 64, 8 }, { 8, 64 }, { 16, 16 }, { 200, 24 }, { 3, 5 } };
+        for (auto& shape : shapes) {
+            GemvGroupEntry e = {};
+            e.M = shape[0];
+            e.K = shape[1];
+            groupEntries.push_back(e);
+        }
+        GemvGroupBufferSizes sizes = AssignGemvGroupOffsets(dt, groupEntries, STRIDE_ALIGH_BYTES);
+        inputVectorBufferSize = sizes.input;
+        matrixBufferSize = sizes.matrix;
+        biasBufferSize = sizes.bias;
+        outputVectorBufferSize = sizes.output;
+        groupTiles = BuildGemvGroupTiles(groupEntries, ChooseGemvGroupTileCost(groupEntries, 16));
+        M = outputVectorBufferSize / SizeofType(dt);
+    }
+
+    // Memory accounting: the dispatch buffers are the emulated device's
+    // memory. A plain dense matrix that the budget refuses moves to host
+    // memory (the upload heap of main.cpp) and is streamed through the
+    // tiled window instead.
+    MemoryAccount memory;
+    if (deviceBudget) memory.SetBudget(MEMORY_POOL_DEVICE, deviceBudget);
+    MemoryCharge inputCharge(memory, MEMORY_POOL_DEVICE, MEMORY_ACTIVATIONS, inputVectorBufferSize, "input vector");
+    MemoryCharge biasCharge(memory, MEMORY_POOL_DEVICE, MEMORY_ACTIVATIONS, biasBufferSize, "bias vector");
+    MemoryCharge outputCharge(memory, MEMORY_POOL_DEVICE, MEMORY_ACTIVATIONS, outputVectorBufferSize, "output vector");
+    if (!inputCharge.Ok() || !biasCharge.Ok() || !outputCharge.Ok()) {
+        std::cout << "Budget of " << deviceBudget << " bytes cannot hold the vectors" << std::endl;
+        return EXIT_FAILURE;
+    }
+    const bool plainDense = !grouped && !sparse && !fused && !typed && !splitSpec;
+    MemoryCharge matrixCharge = tileBudget ? MemoryCharge(memory, MEMORY_POOL_HOST, MEMORY_UPLOAD, matrixBufferSize, "matrix")
+                                           : MemoryCharge(memory, MEMORY_POOL_DEVICE, MEMORY_WEIGHTS, matrixBufferSize, "matrix");
+    if (!matrixCharge.Ok()) {
+        if (!plainDense) {
+            std::cout << "Budget of " << deviceBudget << " bytes cannot hold the " << matrixBufferSize << " byte matrix" << std::endl;
+            return EXIT_FAILURE;
+        }
+        matrixCharge = MemoryCharge(memory, MEMORY_POOL_HOST, MEMORY_UPLOAD, matrixBufferSize, "matrix");
+        tileBudget = memory.Budget(MEMORY_POOL_DEVICE);
+        std::cout << "Matrix does not fit the " << deviceBudget << " byte budget, running tiled" << std::endl;
+    }
+
+    std::vector<uint8_t> inputVectorData(inputVectorBufferSize, 0);
+    std::vector<uint8_t> matrixData(matrixBufferSize, 0);
+    std::vector<uint8_t> biasData(biasBufferSize, 0);
+    std::vector<uint8_t> outputData(outputVectorBufferSize, 0);
+
+    const bool zeroCopy = !grouped && !sparse;
+    GemvGoldenStream goldenStream(dt, nullptr, 0, 0);
+    Sparse24Matrix sparseMatrix = {};
+    using FusedEpilogue = Epilogue<EpilogueRowScale, EpilogueRelu>;
+    DataType outputType = fused ? DATA_TYPE_FLOAT16 : dt;
+    std::vector<float> rowScale;
+    EpilogueParams epilogueParams;
+
+    // The host side of main.cpp's startup graph (startup_graph.h): vectors,
+    // matrix and epilogue tables are independent stages, and the matrix is
+    // generated on all executors.
+    StartupGraph startup;
+    StartupGraph::StageId inputStage = startup.Add("input vector", {}, [&] {
+        if (grouped) {
+            for (uint32_t i = 0; i < groupEntries.size(); ++i) {
+                for (uint32_t k = 0; k < groupEntries[i].K; ++k) {
+                    SetDataFloat(inputVectorData.data(), dt, groupEntries[i].inputOffset, k, 1.0f + i);
+                }
+            }
+        } else {
+            InitilizeBuffer(dt, inputVectorData, 1, K, strideK, 4.0f);
+        }
+    });
+    StartupGraph::StageId biasStage = startup.Add("bias vector", {}, [&] {
+        if (grouped) {
+            for (uint32_t i = 0; i < groupEntries.size(); ++i) {
+                for (uint32_t m = 0; m < groupEntries[i].M; ++m) {
+                    SetDataFloat(biasData.data(), dt, groupEntries[i].biasOffset, m, float(i));
+                }
+            }
+        } else {
+            InitilizeBuffer(dt, biasData, 1, M, strideK, 3.0f);
+        }
+    });
+    startup.Add("matrix", { inputStage }, [&] {
+        if (grouped) {
+            for (const GemvGroupEntry& e : groupEntries) {
+                for (uint32_t m = 0; m < e.M; ++m) {
+                    for (uint32_t k = 0; k < e.K; ++k) {
+                        SetDataFloat(matrixData.data(), dt, e.matrixOffset + m * e.strideK, k, float((m + k) % 4));
+                    }
+                }
+            }
+        } else if (sparse) {
+            // Sparse mode: run on the 2:4 packed matrix, verify against the
+            // pruned dense matrix.
+            for (uint32_t m = 0; m < M; ++m) {
+                for (uint32_t k = 0; k < K; ++k) {
+                    SetDataFloat(matrixData.data(), dt, m * strideK, k, float((m * 3 + k) % 5));
+                }
+            }
+            sparseMatrix = PackSparse24(dt, matrixData.data(), M, K, strideK, STRIDE_ALIGH_BYTES);
+            UnpackSparse24(sparseMatrix, matrixData.data(), strideK);
+        } else {
+            goldenStream = GemvGoldenStream(dt, inputVectorData.data(), M, K);
+            ParallelStreamRows(pool, matrixData.data(), M, strideK, strideK,
+                [&](uint32_t, uint8_t* row) {
+                    for (uint32_t k = 0; k < K; ++k) SetDataFloat(row, dt, 0, k, 2.0f);
+                },
+                [&](uint32_t m, uint8_t const* row) { goldenStream.Row(m, row); });
+        }
+    });
+    // Fused mode: per-row dequant scale, then ReLU, stored as F16. Odd rows
+    // get a large negative bias so the ReLU has something to clamp.
+    startup.Add("epilogue params", { biasStage }, [&] {
+        if (!fused) return;
+        for (uint32_t m = 0; m < M; ++m) {
+            rowScale.push_back(0.5f + 0.25f * (m % 4));
+            SetDataFloat(biasData.data(), dt, 0, m, m % 2 ? -1000.0f : 3.0f);
+        }
+        epilogueParams.rowScale = rowScale.data();
+    });
+    startup.Run(pool);
+    startup.Report(std::cout);
+
+    if (sparse) {
+        std::cout << "2:4 sparse matrix: " << sparseMatrix.SizeInBytes() << " bytes instead of " << matrixData.size()
+                  << ", " << sparseMatrix.prunedNonZeros << " nonzeros pruned" << std::endl;
+    }
+
+    // Dispatch on the CPU backend
+    TraceScope dispatchSpan("dispatch");
+    if (grouped) {
+        GroupedVectorMulAddKernel kernel = { dt, outputData.data(), matrixData.data(), inputVectorData.data(), biasData.data(),
+                                             groupEntries.data(), groupTiles.data() };
+        CpuDispatch(pool, kernel, uint32_t(groupTiles.size()), 1, 1);
+    } else if (sparse) {
+        SparseVectorMulAddKernel kernel = { dt, outputData.data(), &sparseMatrix, inputVectorData.data(), biasData.data() };
+        CpuDispatch(pool, kernel, CpuGroupCount(M, SparseVectorMulAddKernel::NumThreads.x), 1, 1);
+    } else if (fused) {
+        FusedVectorMulAddKernel<FusedEpilogue> kernel = { dt, outputType, outputData.data(), matrixData.data(), inputVectorData.data(), biasData.data(),
+                                                          M, K, strideK, epilogueParams };
+        CpuDispatch(pool, kernel, CpuGroupCount(M, FusedVectorMulAddKernel<FusedEpilogue>::NumThreads.x), 1, 1);
+    } else if (tileBudget) {
+        uint64_t residentBytes = uint64_t(inputVectorBufferSize) + biasBufferSize + outputVectorBufferSize;
+        RowTilePlan plan = PlanRowTiles(M, strideK, residentBytes, tileBudget);
+        if (plan.numTiles == 0) {
+            std::cout << "Budget of " << tileBudget << " bytes cannot hold " << residentBytes << " resident bytes plus two matrix rows" << std::endl;
+            return EXIT_FAILURE;
+        }
+        std::cout << "Tiled: " << plan.numTiles << " tiles of " << plan.rowsPerTile << " rows, "
+                  << plan.WindowBytes() << " byte window for a " << matrixData.size() << " byte matrix" << std::endl;
+        MemoryCharge windowCharge(memory, MEMORY_POOL_DEVICE, MEMORY_WEIGHTS, plan.WindowBytes(), "tile window");
+        if (!windowCharge.Ok()) {
+            std::cout << "Budget of " << deviceBudget << " bytes cannot hold the " << plan.WindowBytes() << " byte tile window" << std::endl;
+            return EXIT_FAILURE;
+        }
+        std::vector<uint8_t> window(plan.WindowBytes());
+        CpuTiledVectorMulAdd(pool, plan, dt, outputData.data(), matrixData.data(), inputVectorData.data(), biasData.data(), K, window.data());
+    } else if (splitSpec) {
+        // "T[xS],T[xS],...": threads and slowdown of every device
+        std::vector<CpuSplitDevice> devices;
+        for (const char* p = splitSpec; *p;) {
+            char* next;
+            uint32_t deviceThreads = uint32_t(strtoul(p, &next, 10));
+            if (next == p) break;
+            CpuSplitDevice device;
+            device.pool.reset(new ThreadPool(deviceThreads, pin));
+            if (*next == 'x') device.slowdown = std::max(1u, uint32_t(strtoul(next + 1, &next, 10)));
+            devices.push_back(std::move(device));
+            p = *next == ',' ? next + 1 : next;
+        }
+        if (devices.empty()) {
+            std::cout << "--split needs a device list such as 2,1x3" << std::endl;
+            return EXIT_FAILURE;
+        }
+        RowSplitBalancer balancer(uint32_t(devices.size()));
+        std::vector<uint8_t> firstOutput;
+        for (uint32_t run = 0; run < splitRuns; ++run) {
+            std::vector<RowSlice> slices = balancer.Split(M, VectorMulAddKernel::NumThreads.x);
+            std::vector<double> ms = CpuRowSplitVectorMulAdd(devices, slices, dt, outputData.data(), matrixData.data(),
+                                                             inputVectorData.data(), biasData.data(), K, strideK);
+            std::cout << "Split run " << run << ":";
+            for (size_t d = 0; d < devices.size(); ++d) {
+                balancer.Record(uint32_t(d), slices[d].Rows(), ms[d]);
+                std::cout << " [" << slices[d].begin << ", " << slices[d].end << ") " << ms[d] << " ms;";
+            }
+            std::cout << " imbalance " << RowSplitBalancer::Imbalance(ms) << std::endl;
+            if (run == 0) firstOutput = outputData;
+            else if (outputData != firstOutput) {
+                std::cout << "Split run " << run << " differs from run 0" << std::endl;
+                return EXIT_FAILURE;
+            }
+        }
+    } else if (typed) {
+        using Matrix = linalg::MatrixView<DATA_TYPE_FLOAT32, TYPED_M, TYPED_K, linalg::MATRIX_LAYOUT_ROW_MAJOR>;
+        using Kernel = TypedVectorMulAddKernel<Matrix, DATA_TYPE_FLOAT32, DATA_TYPE_FLOAT32, DATA_TYPE_FLOAT32>;
+        Kernel kernel = { { outputData.data(), 0 }, { matrixData.data(), 0, strideK }, { inputVectorData.data(), 0 }, { biasData.data(), 0 } };
+        CpuDispatch(pool, kernel, CpuGroupCount(M, Kernel::NumThreads.x), 1, 1);
+    } else {
+        VectorMulAddKernel kernel = { dt, outputData.data(), matrixData.data(), inputVectorData.data(), biasData.data(),
+                                      M, K, strideK };
+        CpuDispatch(pool, kernel, CpuGroupCount(M, VectorMulAddKernel::NumThreads.x), 1, 1);
+    }
+
+    dispatchSpan.End();
+
+    // Verify results
+    {
+        TRACE_SCOPE("verify");
+        MemoryCharge goldenCharge(memory, MEMORY_POOL_HOST, MEMORY_READBACK, outputVectorBufferSize, "golden");
+        std::vector<uint8_t> goldenData(outputVectorBufferSize, 0);
+        if (grouped) {
+            GroupedMatMulAdd(dt, goldenData.data(), matrixData.data(), inputVectorData.data(), biasData.data(), groupEntries);
+        } else if (fused) {
+            goldenStream.Finish<FusedEpilogue>(goldenData.data(), outputType, biasData.data(), epilogueParams);
+        } else if (zeroCopy) {
+            goldenStream.Finish(goldenData.data(), outputType, biasData.data());
+        } else {
+            MatMulAdd(dt, goldenData.data(), matrixData.data(), inputVectorData.data(), biasData.data(), M, K, strideK);
+        }
+
+        int err = 0;
+        for (size_t i = 0; i < M; ++i) {
+            float v = GetDataFloat(outputData.data(), outputType, 0, i);
+            float golden = GetDataFloat(goldenData.data(), outputType, 0, i);
+
+            if (v != golden) {
+                std::cout << "Output[" << i << "] = " << v << "; ";
+                std::cout << "Golden[" << i << "] = " << golden << std::endl;
+                err ++;
+            }
+        }
+        if (err != 0) return EXIT_FAILURE;
+
+        // The dense golden runs on the unpacked matrix; the sparse reference
+        // also checks the packed layout the kernel reads.
+        if (sparse) {
+            std::vector<uint8_t> sparseReference(outputVectorBufferSize, 0);
+            SparseMatMulAdd(dt, sparseReference.data(), sparseMatrix, inputVectorData.data(), biasData.data());
+            if (sparseReference != outputData) {
+                std::cout << "Sparse dispatch differs from the CPU sparse reference" << std::endl;
+                return EXIT_FAILURE;
+            }
+        }
+    }
+
+    std::cout << "CPU backend executed successfully and results are correct!" << std::endl;
+    memory.Report(std::cout);
+    std::cout << "Peak host memory: " << PeakHostMemoryBytes() / (1024 * 1024) << " MB" << std::endl;
+    return 0;
+}
@@ -0,0 +1,584 @@
+#include <vector>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <cstring>
+#include <cstdlib>
+#include <cmath>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <random>
+#include <thread>
+
+#include <csignal>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "include/gemv_service.h"
+#include "include/trace.h"
+
+// Persistent GEMV service on the CPU backend (gemv_service.h), with its
+// clients. POSIX only: the segment is a shm_open mapping, the control
+// channel a Unix socket.
+//
+//   GemvService --serve [--name NAME] [--threads N] [--pin] [--batch N] [--batch-us US] [--trace FILE]
+//   GemvService --client [--name NAME] [--jobs N] [--inflight N] [--vectors N] [--model ID]
+//   GemvService --demo [--clients N] [+ the options of both]
+//   GemvService --stats | --shutdown [--name NAME]
+//
+// --serve keeps a MulAdd model (1024x256, id 0) and an MLP (16-32-8, id 1)
+// resident until --shutdown or SIGINT. --client registers over the control
+// socket, gets its region of the segment, keeps --inflight jobs of
+// --vectors vectors each in the ring and checks every result against a
+// host reference of the same model; --model picks one model, default is
+// both in turn. --demo forks --clients clients (default 4) against a
+// server in this process and reports how the jobs were batched.
+//
+// The control protocol is one text line per request:
+//   HELLO     -> CLIENT id token shm_name region_offset region_bytes | BUSY
+//   MODELS    -> MODEL id kind inputs outputs seed ..., then END
+//   STATS     -> STATS jobs vectors batches dispatches failed
+//   SHUTDOWN  -> BYE
+// Closing the connection gives the region back and revokes the token. A
+// client must not close it with jobs in flight: the region may go to the
+// next client. The token is random, so a client cannot guess the token of
+// another region.
+
+static std::string ShmName(std::string const &name) { return "/gemv_service_" + name; }
+static std::string SocketPath(std::string const &name) { return "/tmp/gemv_service_" + name + ".sock"; }
+
+static bool SendLine(int fd, std::string const &line)
+{
+    std::string data = line + "\n";
+    size_t sent = 0;
+    while (sent < data.size()) {
+        ssize_t n = send(fd, data.data() + sent, data.size() - sent, MSG_NOSIGNAL);
+        if (n <= 0) return false;
+        sent += size_t(n);
+    }
+    return true;
+}
+
+// Blocking read of one line; the control channel is not on any hot path.
+static bool ReadLine(int fd, std::string &line)
+{
+    line.clear();
+    char c;
+    for (;;) {
+        ssize_t n = recv(fd, &c, 1, 0);
+        if (n <= 0) return false;
+        if (c == '\n') return true;
+        line += c;
+    }
+}
+
+static int ConnectControl(std::string const &name)
+{
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    sockaddr_un addr = {};
+    addr.sun_family = AF_UNIX;
+    strncpy(addr.sun_path, SocketPath(name).c_str(), sizeof(addr.sun_path) - 1);
+    if (fd < 0 || connect(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0) {
+        std::cerr << "Cannot connect to " << SocketPath(name) << ": " << strerror(errno) << std::endl;
+        if (fd >= 0) close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+// Server side: the segment, the listening socket and the client registry.
+class ServiceHost {
+public:
+    ~ServiceHost()
+    {
+        for (Connection& c : connections_) close(c.fd);
+        if (listenFd_ >= 0) {
+            close(listenFd_);
+            unlink(SocketPath(name_).c_str());
+        }
+        if (segment_) {
+            munmap(segment_, bytes_);
+            shm_unlink(ShmName(name_).c_str());
+        }
+    }
+
+    // Creates the segment and starts listening; clients may connect from
+    // here on, they are answered once Control runs. A previous server of
+    // the same name that did not clean up is replaced.
+    bool Create(std::string const& name, GemvServiceConfig const& config)
+    {
+        name_ = name;
+        bytes_ = InitServiceSegment(nullptr, config);
+        shm_unlink(ShmName(name).c_str());
+        int shm = shm_open(ShmName(name).c_str(), O_CREAT | O_EXCL | O_RDWR, 0600);
+        if (shm < 0 || ftruncate(shm, off_t(bytes_)) != 0) {
+            std::cerr << "Cannot create shared memory " << ShmName(name) << ": " << strerror(errno) << std::endl;
+            if (shm >= 0) close(shm);
+            return false;
+        }
+        void* mapping = mmap(nullptr, bytes_, PROT_READ | PROT_WRITE, MAP_SHARED, shm, 0);
+        close(shm);
+        if (mapping == MAP_FAILED) {
+            std::cerr << "Cannot map shared memory: " << strerror(errno) << std::endl;
+            return false;
+        }
+        segment_ = mapping;
+        InitServiceSegment(segment_, config);
+        clients_.assign(config.maxClients, false);
+
+        listenFd_ = socket(AF_UNIX, SOCK_STREAM, 0);
+        sockaddr_un addr = {};
+        addr.sun_family = AF_UNIX;
+        strncpy(addr.sun_path, SocketPath(name).c_str(), sizeof(addr.sun_path) - 1);
+        unlink(addr.sun_path);
+        if (listenFd_ < 0 || bind(listenFd_, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0 ||
+            chmod(addr.sun_path, 0600) != 0 || listen(listenFd_, 64) != 0) {
+            std::cerr << "Cannot listen on " << SocketPath(name) << ": " << strerror(errno) << std::endl;
+            return false;
+        }
+        return true;
+    }
+
+    void* Segment() const { return segment_; }
+
+    // Answers control requests until running is cleared (by SHUTDOWN or
+    // by the caller).
+    void Control(GemvService& service, std::atomic<bool>& running)
+    {
+        ServiceHeader const& header = *static_cast<ServiceHeader const*>(segment_);
+        while (running.load()) {
+            std::vector<pollfd> fds(1, pollfd{ listenFd_, POLLIN, 0 });
+            for (Connection const& c : connections_) fds.push_back(pollfd{ c.fd, POLLIN, 0 });
+            if (poll(fds.data(), fds.size(), 100) <= 0) continue;
+            if (fds[0].revents & POLLIN) {
+                int fd = accept(listenFd_, nullptr, nullptr);
+                if (fd >= 0) connections_.push_back({ fd, -1 });
+            }
+            for (size_t i = 1; i < fds.size(); ++i) {
+                if (!(fds[i].revents & (POLLIN | POLLHUP | POLLERR))) continue;
+                Connection& c = connections_[i - 1];
+                std::string line;
+                bool open = ReadLine(c.fd, line);
+                if (open && line == "HELLO") {
+                    auto free = std::find(clients_.begin(), clients_.end(), false);
+                    if (c.client >= 0 || free == clients_.end()) {
+                        open = SendLine(c.fd, "BUSY");
+                    } else {
+                        c.client = int(free - clients_.begin());
+                        *free = true;
+                        uint32_t token = 0;
+                        while (!token) token = random_();
+                        service.SetClientToken(uint32_t(c.client), token);
+                        std::ostringstream reply;
+                        reply << "CLIENT " << c.client << " " << token << " " << ShmName(name_) << " " << ServiceRegionOffset(header, c.client)
+                              << " " << header.regionBytes;
+                        open = SendLine(c.fd, reply.str());
+                    }
+                } else if (open && line == "MODELS") {
+                    for (GemvModelInfo const& m : service.Models()) {
+                        std::ostringstream reply;
+                        reply << "MODEL " << m.id << " " << m.kind << " " << m.inputs << " " << m.outputs << " " << m.seed;
+                        open = open && SendLine(c.fd, reply.str());
+                    }
+                    open = open && SendLine(c.fd, "END");
+                } else if (open && line == "STATS") {
+                    GemvService::Stats s = service.GetStats();
+                    std::ostringstream reply;
+                    reply << "STATS " << s.jobs << " " << s.vectors << " " << s.batches << " " << s.dispatches << " " << s.failed;
+                    open = SendLine(c.fd, reply.str());
+                } else if (open && line == "SHUTDOWN") {
+                    SendLine(c.fd, "BYE");
+                    running.store(false);
+                } else if (open) {
+                    open = SendLine(c.fd, "ERROR unknown request");
+                }
+                if (!open) {
+                    if (c.client >= 0) {
+                        service.SetClientToken(uint32_t(c.client), 0);
+                        clients_[c.client] = false;
+                    }
+                    close(c.fd);
+                    c.fd = -1;
+                }
+            }
+            connections_.erase(std::remove_if(connections_.begin(), connections_.end(), [](Connection const& c) { return c.fd < 0; }),
+                               connections_.end());
+        }
+    }
+
+private:
+    struct Connection {
+        int fd;
+        int client; // -1 until HELLO
+    };
+
+    std::string name_;
+    void* segment_ = nullptr;
+    uint64_t bytes_ = 0;
+    int listenFd_ = -1;
+    std::vector<Connection> connections_;
+    std::vector<bool> clients_;
+    std::random_device random_;
+};
+
+// Client side: the control connection, the mapped segment and the region.
+class GemvClient {
+public:
+    ~GemvClient()
+    {
+        if (segment_) munmap(segment_, header_.totalBytes);
+        if (fd_ >= 0) close(fd_);
+    }
+
+    bool Connect(std::string const& name)
+    {
+        fd_ = ConnectControl(name);
+        std::string line;
+        if (fd_ < 0 || !SendLine(fd_, "HELLO") || !ReadLine(fd_, line)) return false;
+        std::istringstream reply(line);
+        std::string tag, shmName;
+        reply >> tag >> client_ >> token_ >> shmName >> regionOffset_ >> regionBytes_;
+        if (tag != "CLIENT") {
+            std::cerr << "Service refused the client: " << line << std::endl;
+            return false;
+        }
+
+        int shm = shm_open(shmName.c_str(), O_RDWR, 0);
+        if (shm < 0) {
+            std::cerr << "Cannot open shared memory " << shmName << ": " << strerror(errno) << std::endl;
+            return false;
+        }
+        ServiceHeader header;
+        void* mapping = MAP_FAILED;
+        if (pread(shm, &header, sizeof(header), 0) == ssize_t(sizeof(header)) && header.magic == GEMV_SERVICE_MAGIC &&
+            header.version == GEMV_SERVICE_VERSION) {
+            mapping = mmap(nullptr, header.totalBytes, PROT_READ | PROT_WRITE, MAP_SHARED, shm, 0);
+        }
+        close(shm);
+        if (mapping == MAP_FAILED) {
+            std::cerr << "Cannot map the service segment" << std::endl;
+            return false;
+        }
+        segment_ = static_cast<uint8_t*>(mapping);
+        header_ = header;
+        ring_ = JobRing<GemvJob>::Attach(segment_ + header_.ringOffset);
+
+        if (!SendLine(fd_, "MODELS")) return false;
+        while (ReadLine(fd_, line) && line != "END") {
+            std::istringstream model(line);
+            GemvModelInfo info;
+            uint32_t kind;
+            model >> tag >> info.id >> kind >> info.inputs >> info.outputs >> info.seed;
+            info.kind = GemvModelKind(kind);
+            models_.push_back(info);
+        }
+        return line == "END";
+    }
+
+    uint32_t Client() const { return client_; }
+    uint64_t RegionOffset() const { return regionOffset_; }
+    uint64_t RegionBytes() const { return regionBytes_; }
+    std::vector<GemvModelInfo> const& Models() const { return models_; }
+
+    template <typename T>
+    T* At(uint64_t offset) const { return reinterpret_cast<T*>(segment_ + offset); }
+
+    // Marks the job pending, stamps the token and pushes it, waiting while
+    // the ring is full.
+    void Submit(GemvJob job)
+    {
+        job.token = token_;
+        ServiceJobStatus(segment_, job.statusOffset).store(GEMV_JOB_PENDING, std::memory_order_relaxed);
+        while (!ring_.TryPush(job)) std::this_thread::yield();
+    }
+
+    GemvJobStatus Status(GemvJob const& job) const
+    {
+        return GemvJobStatus(ServiceJobStatus(segment_, job.statusOffset).load(std::memory_order_acquire));
+    }
+
+private:
+    int fd_ = -1;
+    uint8_t* segment_ = nullptr;
+    ServiceHeader header_ = {};
+    JobRing<GemvJob> ring_;
+    uint32_t client_ = 0;
+    uint32_t token_ = 0;
+    uint64_t regionOffset_ = 0, regionBytes_ = 0;
+    std::vector<GemvModelInfo> models_;
+};
+
+// Host reference of a model, built from its seed like the service does.
+class ModelReference {
+public:
+    explicit ModelReference(GemvModelInfo const& info) : info_(info)
+    {
+        if (info.kind == GEMV_MODEL_MULADD) {
+            strideK_ = (info.inputs * 4 + 31) & ~31u;
+            weights_.resize(uint64_t(strideK_) * info.outputs);
+            bias_.resize(info.outputs);
+            FillServiceLayer(info.seed, info.outputs, info.inputs, strideK_, weights_.data(), bias_.data());
+        } else {
+            MlpInitParams<ServiceMlp>(params_, info.seed);
+        }
+    }
+
+    void Run(float const* input, float* output) const
+    {
+        if (info_.kind == GEMV_MODEL_MLP) {
+            MlpActivations<ServiceMlp> a = MlpForward<ServiceMlp>(params_.data(), input);
+            std::copy(a.y.begin(), a.y.end(), output);
+            return;
+        }
+        for (uint32_t m = 0; m < info_.outputs; ++m) {
+            float const* row = reinterpret_cast<float const*>(weights_.data() + uint64_t(m) * strideK_);
+            float sum = 0.0f;
+            for (uint32_t k = 0; k < info_.inputs; ++k) sum += input[k] * row[k];
+            output[m] = sum + bias_[m];
+        }
+    }
+
+private:
+    GemvModelInfo info_;
+    uint32_t strideK_ = 0;
+    std::vector<uint8_t> weights_;
+    std::vector<float> bias_, params_;
+};
+
+struct ClientOptions {
+    uint32_t jobs = 1000;
+    uint32_t inflight = 4;
+    uint32_t vectors = 1;
+    int model = -1; // -1: every model in turn
+};
+
+// Keeps opts.inflight jobs in the ring, checks each result as it completes
+// and resubmits the slot until opts.jobs are done.
+static int RunClient(std::string const& name, ClientOptions const& opts)
+{
+    GemvClient client;
+    if (!client.Connect(name)) return EXIT_FAILURE;
+    std::vector<GemvModelInfo> models;
+    for (GemvModelInfo const& info : client.Models()) {
+        if (opts.model < 0 || int(info.id) == opts.model) models.push_back(info);
+    }
+    if (models.empty()) {
+        std::cerr << "No such model " << opts.model << std::endl;
+        return EXIT_FAILURE;
+    }
+    std::vector<ModelReference> references;
+    uint32_t maxFloats = 0;
+    for (GemvModelInfo const& info : models) {
+        references.emplace_back(info);
+        maxFloats = std::max(maxFloats, std::max(info.inputs, info.outputs));
+    }
+
+    // A slot of the region per job in flight: status word, inputs, outputs
+    const uint64_t vectorBytes = (uint64_t(maxFloats) * 4 * opts.vectors + 63) & ~63ull;
+    const uint64_t slotBytes = 64 + 2 * vectorBytes;
+    const uint32_t inflight = std::max(1u, opts.inflight);
+    if (slotBytes * inflight > client.RegionBytes()) {
+        std::cerr << "--inflight x --vectors does not fit the " << client.RegionBytes() << " byte region" << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    struct Slot {
+        GemvJob job;
+        uint32_t modelIndex;
+        std::chrono::steady_clock::time_point submitted;
+        bool busy;
+    };
+    std::vector<Slot> slots(inflight);
+    uint32_t submitted = 0, completed = 0, failed = 0;
+    float maxError = 0.0f;
+    double latencySumUs = 0.0;
+    std::vector<float> expected(maxFloats);
+    auto start = std::chrono::steady_clock::now();
+
+    auto SubmitSlot = [&](uint32_t s) {
+        Slot& slot = slots[s];
+        slot.modelIndex = submitted % uint32_t(models.size());
+        GemvModelInfo const& info = models[slot.modelIndex];
+        uint64_t base = client.RegionOffset() + slotBytes * s;
+        slot.job = { client.Client(), info.id, opts.vectors, 0, base + 64, base + 64 + vectorBytes, base };
+        float* input = client.At<float>(slot.job.inputOffset);
+        for (uint32_t v = 0; v < opts.vectors; ++v) {
+            for (uint32_t k = 0; k < info.inputs; ++k) {
+                input[v * info.inputs + k] = float(int((submitted * 31 + v * 5 + k * 7) % 13) - 6) / 6.0f;
+            }
+        }
+        slot.submitted = std::chrono::steady_clock::now();
+        slot.busy = true;
+        client.Submit(slot.job);
+        submitted++;
+    };
+
+    for (uint32_t s = 0; s < inflight && submitted < opts.jobs; ++s) SubmitSlot(s);
+    while (completed < opts.jobs) {
+        bool progress = false;
+        for (uint32_t s = 0; s < inflight; ++s) {
+            Slot& slot = slots[s];
+            if (!slot.busy) continue;
+            GemvJobStatus status = client.Status(slot.job);
+            if (status == GEMV_JOB_PENDING) continue;
+            latencySumUs += std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - slot.submitted).count();
+            GemvModelInfo const& info = models[slot.modelIndex];
+            if (status == GEMV_JOB_DONE) {
+                float const* input = client.At<float>(slot.job.inputOffset);
+                float const* output = client.At<float>(slot.job.outputOffset);
+                for (uint32_t v = 0; v < opts.vectors; ++v) {
+                    references[slot.modelIndex].Run(input + v * info.inputs, expected.data());
+                    for (uint32_t o = 0; o < info.outputs; ++o) {
+                        maxError = std::max(maxError, std::fabs(output[v * info.outputs + o] - expected[o]));
+                    }
+                }
+            } else {
+                failed++;
+            }
+            slot.busy = false;
+            completed++;
+            progress = true;
+            if (submitted < opts.jobs) SubmitSlot(s);
+        }
+        if (!progress) std::this_thread::yield();
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    std::cout << "client " << client.Client() << ": " << completed << " jobs, " << failed << " failed, max error " << maxError
+              << ", mean latency " << latencySumUs / completed << " us, " << completed / seconds << " jobs/s" << std::endl;
+    return failed == 0 && maxError <= 1e-4f ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+static std::atomic<bool> serviceRunning(true);
+
+static void StopService(int) { serviceRunning.store(false); }
+
+// Runs the batches until serviceRunning is cleared. Spins while jobs keep
+// coming, then backs off to short sleeps so an idle service stays cheap.
+static void ServeLoop(GemvService& service)
+{
+    uint32_t idle = 0;
+    while (serviceRunning.load(std::memory_order_relaxed)) {
+        if (service.RunBatch()) {
+            idle = 0;
+        } else if (++idle < 1024) {
+            std::this_thread::yield();
+        } else {
+            std::this_thread::sleep_for(std::chrono::microseconds(50));
+        }
+    }
+}
+
+static int ControlRequest(std::string const& name, const char* request)
+{
+    int fd = ConnectControl(name);
+    std::string line;
+    if (fd < 0 || !SendLine(fd, request) || !ReadLine(fd, line)) {
+        if (fd >= 0) close(fd);
+        return EXIT_FAILURE;
+    }
+    std::cout << line << std::endl;
+    close(fd);
+    return EXIT_SUCCESS;
+}
+
+int main(int argc, char** argv) {
+    bool serve = false, client = false, demo = false, stats = false, shutdown = false, pin = false;
+    std::string name = "default";
+    uint32_t threads = 0, clients = 4;
+    const char* tracePath = "";
+    GemvServiceConfig config;
+    ClientOptions clientOptions;
+    for (int i = 1; i < argc; ++i) {
+        if (strcmp(argv[i], "--serve") == 0) serve = true;
+        else if (strcmp(argv[i], "--client") == 0) client = true;
+        else if (strcmp(argv[i], "--demo") == 0) demo = true;
+        else if (strcmp(argv[i], "--stats") == 0) stats = true;
+        else if (strcmp(argv[i], "--shutdown") == 0) shutdown = true;
+        else if (strcmp(argv[i], "--name") == 0 && i + 1 < argc) name = argv[++i];
+        else if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc) threads = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--pin") == 0) pin = true;
+        else if (strcmp(argv[i], "--batch") == 0 && i + 1 < argc) config.maxBatch = std::max(1, atoi(argv[++i]));
+        else if (strcmp(argv[i], "--batch-us") == 0 && i + 1 < argc) config.batchWindowUs = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--trace") == 0 && i + 1 < argc) tracePath = argv[++i];
+        else if (strcmp(argv[i], "--clients") == 0 && i + 1 < argc) clients = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--jobs") == 0 && i + 1 < argc) clientOptions.jobs = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--inflight") == 0 && i + 1 < argc) clientOptions.inflight = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--vectors") == 0 && i + 1 < argc) clientOptions.vectors = std::max(1, atoi(argv[++i]));
+        else if (strcmp(argv[i], "--model") == 0 && i + 1 < argc) clientOptions.model = atoi(argv[++i]);
+        else {
+            std::cerr << "Unknown argument " << argv[i] << std::endl;
+            return EXIT_FAILURE;
+        }
+    }
+    if (serve + client + demo + stats + shutdown != 1) {
+        std::cerr << "Pick one of --serve, --client, --demo, --stats, --shutdown" << std::endl;
+        return EXIT_FAILURE;
+    }
+    if (client) return RunClient(name, clientOptions);
+    if (stats) return ControlRequest(name, "STATS");
+    if (shutdown) return ControlRequest(name, "SHUTDOWN");
+    if (demo && clients > config.maxClients) {
+        std::cerr << "--clients is at most " << config.maxClients << std::endl;
+        return EXIT_FAILURE;
+    }
+    if (demo) name += "_demo_" + std::to_string(getpid());
+
+    ServiceHost host;
+    if (!host.Create(name, config)) return EXIT_FAILURE;
+
+    // Clients fork before any thread exists; their connections wait in the
+    // listen backlog until Control answers them.
+    std::vector<pid_t> children;
+    for (uint32_t c = 0; demo && c < clients; ++c) {
+        pid_t pid = fork();
+        if (pid == 0) _exit(RunClient(name, clientOptions));
+        if (pid < 0) {
+            std::cerr << "fork failed: " << strerror(errno) << std::endl;
+            serviceRunning.store(false);
+            break;
+        }
+        children.push_back(pid);
+    }
+
+    TraceSession traceSession(tracePath);
+    MemoryAccount memory;
+    ThreadPool pool(threads, pin);
+    GemvService service(pool, host.Segment(), config, memory);
+    service.AddMulAddModel(1024, 256, 1);
+    service.AddMlpModel(2);
+    std::cout << "GEMV service " << name << " with " << pool.NumThreads() << " threads, batch " << config.maxBatch << " jobs / "
+              << config.batchWindowUs << " us" << std::endl;
+
+    signal(SIGINT, StopService);
+    signal(SIGTERM, StopService);
+    std::thread control([&] { host.Control(service, serviceRunning); });
+
+    int result = EXIT_SUCCESS;
+    if (demo) {
+        std::thread waiter([&] {
+            for (pid_t pid : children) {
+                int status = 0;
+                if (waitpid(pid, &status, 0) != pid || !WIFEXITED(status) || WEXITSTATUS(status) != EXIT_SUCCESS) result = EXIT_FAILURE;
+            }
+            serviceRunning.store(false);
+        });
+        ServeLoop(service);
+        waiter.join();
+    } else {
+        ServeLoop(service);
+    }
+    control.join();
+
+    service.Report(std::cout);
+    memory.Report(std::cout);
+    if (demo) std::cout << (result == EXIT_SUCCESS ? "All clients verified" : "A client failed") << std::endl;
+    return result;
+}
@@ -0,0 +1,122 @@
+#include <vector>
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <cstring>
+#include <cstdlib>
+#include <cmath>
+#include <algorithm>
+
+#include "include/low_rank.h"
+
+// Offline truncation tool for low-rank layers (low_rank.h): factors a
+// dense F32 matrix into U (M x r) and V (r x K) by truncated SVD.
+//
+//   LowRankFactorize (--in FILE | --synthetic RANK NOISE) --size M K
+//                    (--rank R | --error E) [--max-rank N] [--iterations N] [--out PREFIX]
+//
+// --in reads M x K row-major F32 without padding; --synthetic makes a
+// test layer instead (FillLowRankTestMatrix). --rank keeps R singular
+// values; --error keeps the fewest whose relative Frobenius error is at
+// most E, searched among the first --max-rank (default min(M, K) / 2), and
+// fails without writing anything when even --max-rank misses E.
+// --out writes PREFIX.u.f32 (M x r) and PREFIX.v.f32 (r x K), row-major
+// F32 without padding. The report gives the leading singular values, the
+// predicted and the measured error of U V and the bytes against W.
+
+static bool WriteFloats(std::string const& path, std::vector<float> const& data)
+{
+    std::ofstream file(path, std::ios::binary);
+    file.write(reinterpret_cast<const char*>(data.data()), std::streamsize(data.size() * sizeof(float)));
+    return bool(file);
+}
+
+int main(int argc, char** argv) {
+    const char* inPath = nullptr;
+    const char* outPrefix = nullptr;
+    uint32_t M = 0, K = 0, rank = 0, maxRank = 0, iterations = 4;
+    uint32_t syntheticRank = 0;
+    float syntheticNoise = 0.0f;
+    double errorTarget = -1.0;
+    for (int i = 1; i < argc; ++i) {
+        if (strcmp(argv[i], "--in") == 0 && i + 1 < argc) inPath = argv[++i];
+        else if (strcmp(argv[i], "--out") == 0 && i + 1 < argc) outPrefix = argv[++i];
+        else if (strcmp(argv[i], "--rank") == 0 && i + 1 < argc) rank = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--error") == 0 && i + 1 < argc) errorTarget = atof(argv[++i]);
+        else if (strcmp(argv[i], "--max-rank") == 0 && i + 1 < argc) maxRank = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--iterations") == 0 && i + 1 < argc) iterations = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--synthetic") == 0 && i + 2 < argc) {
+            syntheticRank = atoi(argv[++i]);
+            syntheticNoise = float(atof(argv[++i]));
+        }
+        else if (strcmp(argv[i], "--size") == 0 && i + 2 < argc) {
+            M = atoi(argv[++i]);
+            K = atoi(argv[++i]);
+        }
+        else {
+            std::cerr << "Unknown argument " << argv[i] << std::endl;
+            return EXIT_FAILURE;
+        }
+    }
+    if (!M || !K || (!inPath && !syntheticRank) || (rank == 0) == (errorTarget < 0.0)) {
+        std::cerr << "Need --size M K, one of --in / --synthetic and one of --rank / --error" << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    const uint32_t strideK = K * sizeof(float);
+    std::vector<float> W(uint64_t(M) * K);
+    if (inPath) {
+        std::ifstream file(inPath, std::ios::binary);
+        file.read(reinterpret_cast<char*>(W.data()), std::streamsize(W.size() * sizeof(float)));
+        if (!file) {
+            std::cerr << "Cannot read " << W.size() * sizeof(float) << " bytes from " << inPath << std::endl;
+            return EXIT_FAILURE;
+        }
+    } else {
+        FillLowRankTestMatrix(W.data(), M, K, strideK, syntheticRank, syntheticNoise);
+    }
+
+    if (!maxRank) maxRank = rank ? rank : std::max(1u, std::min(M, K) / 2);
+    LowRankFactors factors = FactorizeLowRank(W.data(), M, K, strideK, std::max(rank, maxRank), iterations);
+    if (errorTarget >= 0.0) rank = factors.RankForError(errorTarget);
+    factors.Truncate(rank);
+    const bool targetMissed = errorTarget >= 0.0 && factors.RelativeError(factors.rank) > errorTarget;
+
+    std::cout << "singular values:";
+    for (size_t i = 0; i < std::min<size_t>(factors.singularValues.size(), 16); ++i) std::cout << " " << factors.singularValues[i];
+    if (factors.singularValues.size() > 16) std::cout << " ...";
+    std::cout << std::endl;
+
+    // Measured error: |W - U V| / |W|, exact rather than from the spectrum
+    double residual = 0.0;
+    std::vector<double> row(K);
+    for (uint32_t m = 0; m < M; ++m) {
+        std::fill(row.begin(), row.end(), 0.0);
+        for (uint32_t r = 0; r < factors.rank; ++r) {
+            double u = factors.u[uint64_t(m) * factors.rank + r];
+            for (uint32_t k = 0; k < K; ++k) row[k] += u * factors.v[uint64_t(r) * K + k];
+        }
+        for (uint32_t k = 0; k < K; ++k) {
+            double d = W[uint64_t(m) * K + k] - row[k];
+            residual += d * d;
+        }
+    }
+    double measured = factors.frobeniusSq > 0.0 ? std::sqrt(residual / factors.frobeniusSq) : 0.0;
+    uint64_t denseBytes = uint64_t(M) * K * sizeof(float), factoredBytes = (uint64_t(M) + K) * factors.rank * sizeof(float);
+    std::cout << "rank " << factors.rank << ": relative error " << factors.RelativeError(factors.rank) << " predicted, " << measured
+              << " measured; " << factoredBytes << " of " << denseBytes << " bytes (" << double(factoredBytes) / denseBytes << "x)" << std::endl;
+
+    if (targetMissed) {
+        std::cerr << "Error target " << errorTarget << " not met within --max-rank " << factors.rank << "; raise --max-rank" << std::endl;
+        return EXIT_FAILURE;
+    }
+    if (outPrefix) {
+        std::string prefix = outPrefix;
+        if (!WriteFloats(prefix + ".u.f32", factors.u) || !WriteFloats(prefix + ".v.f32", factors.v)) {
+            std::cerr << "Cannot write " << prefix << ".u.f32 / .v.f32" << std::endl;
+            return EXIT_FAILURE;
+        }
+        std::cout << "Wrote " << prefix << ".u.f32 and " << prefix << ".v.f32" << std::endl;
+    }
+    return 0;
+}
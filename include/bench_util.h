@@ -0,0 +1,107 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "util.h"
+
+struct Timer {
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+    double ElapsedMs() const
+    {
+        return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    }
+};
+
+inline const char *DataTypeName(DataType dt)
+{
+    switch (dt) {
+    case DATA_TYPE_SINT16: return "I16";
+    case DATA_TYPE_UINT16: return "U16";
+    case DATA_TYPE_SINT32: return "I32";
+    case DATA_TYPE_UINT32: return "U32";
+    case DATA_TYPE_FLOAT16: return "F16";
+    case DATA_TYPE_FLOAT32: return "F32";
+    case DATA_TYPE_SINT8_T4_PACKED: return "PackedS8x32";
+    case DATA_TYPE_UINT8_T4_PACKED: return "PackedU8x32";
+    case DATA_TYPE_UINT8: return "U8";
+    case DATA_TYPE_SINT8: return "I8";
+    case DATA_TYPE_FLOAT8_E4M3: return "F8_E4M3";
+    case DATA_TYPE_FLOAT8_E5M2: return "F8_E5M2";
+    }
+    return "?";
+}
+
+inline double Median(std::vector<double> v)
+{
+    if (v.empty()) return 0.0;
+    std::sort(v.begin(), v.end());
+    size_t n = v.size();
+    return n % 2 ? v[n / 2] : 0.5 * (v[n / 2 - 1] + v[n / 2]);
+}
+
+// Runs fn once to warm up, then `samples` timed times.
+template <typename Fn>
+std::vector<double> MeasureMs(uint32_t samples, Fn &&fn)
+{
+    fn();
+    std::vector<double> times;
+    for (uint32_t i = 0; i < samples; ++i) {
+        Timer t;
+        fn();
+        times.push_back(t.ElapsedMs());
+    }
+    return times;
+}
+
+// MeasureMs with prepare run untimed before every run of fn, for work
+// that changes the state fn starts from.
+template <typename Prepare, typename Fn>
+std::vector<double> MeasurePreparedMs(uint32_t samples, Prepare &&prepare, Fn &&fn)
+{
+    prepare();
+    fn();
+    std::vector<double> times;
+    for (uint32_t i = 0; i < samples; ++i) {
+        prepare();
+        Timer t;
+        fn();
+        times.push_back(t.ElapsedMs());
+    }
+    return times;
+}
+
+// One line of sweep output: a (backend, variant, shape, type) point and all
+// of its timed samples.
+struct SweepRecord {
+    std::string backend;
+    std::string variant;
+    uint32_t M;
+    uint32_t K;
+    uint32_t batch;
+    std::string type;
+    uint32_t threads;
+    std::vector<double> samplesMs;
+};
+
+inline void PrintSweepHeader(std::ostream &os)
+{
+    os << "backend,variant,M,K,batch,type,threads,samples,median_ms,min_ms,gmacs" << std::endl;
+}
+
+inline void PrintSweepRecord(std::ostream &os, SweepRecord const &r)
+{
+    double median = Median(r.samplesMs);
+    double minMs = r.samplesMs.empty() ? 0.0 : *std::min_element(r.samplesMs.begin(), r.samplesMs.end());
+    double gmacs = median > 0.0 ? double(r.M) * r.K * r.batch / (median * 1e6) : 0.0;
+    os << r.backend << "," << r.variant << "," << r.M << "," << r.K << "," << r.batch << "," << r.type << ","
+       << r.threads << "," << r.samplesMs.size() << ","
+       << std::fixed << std::setprecision(4) << median << "," << minMs << "," << gmacs
+       << std::defaultfloat << std::endl;
+}
@@ -0,0 +1,321 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <functional>
+#include <iostream>
+#include <string>
+#include <vector>
+
+// Compute graph with automatic resource barriers. Ops declare which
+// resources they read and write and in which state; Execute works out the
+// barriers instead of a hand-written transition before every access:
+//
+//   ComputeGraph graph;
+//   auto input = graph.AddResource("input", GRAPH_STATE_COMMON);
+//   auto output = graph.AddResource("output", GRAPH_STATE_COMMON);
+//   graph.AddOp("upload", { GraphWrite(input, GRAPH_STATE_COPY_DEST) }, [&] { ... });
+//   graph.AddOp("gemv", { GraphRead(input, GRAPH_STATE_SHADER_READ), GraphWrite(output, GRAPH_STATE_UNORDERED_ACCESS) }, [&] { ... });
+//   graph.Execute([&](std::vector<GraphBarrier> const &batch) { ... one ResourceBarrier call ... });
+//
+// Execute orders the ops into levels: an op goes one level after the last
+// op it has a hazard with (read after write, write after read or write on
+// one resource), so independent ops share a level and run back to back
+// with no barrier in between. All barriers of a level go out as one batch
+// before it. On the way it
+//   - transitions a resource only when a level needs another state, never
+//     back and forth between ops of one level,
+//   - merges the reads of a level into one combined read state (shader
+//     read | copy source), and skips a transition when the current read
+//     state already covers the one needed,
+//   - adds a UAV barrier between two levels that both use a resource as
+//     UAV after a write,
+//   - with split barriers on, begins a transition right after the last
+//     level that used the old state and ends it before the level that needs
+//     the new one, when at least one level lies in between.
+// Each executed op is checked against the states the barriers produced,
+// so a scheduling bug shows up as an invalid access in the stats instead of
+// as a GPU hang. The stats compare with hand-written code: one barrier
+// call per transition, before every access whose state differs.
+//
+// Resources and their states persist across Execute calls; ops do not.
+// Buffers decay to COMMON at the end of ExecuteCommandLists, see Decay.
+
+enum GraphState : uint32_t {
+    GRAPH_STATE_COMMON = 0,
+    GRAPH_STATE_COPY_DEST = 1 << 0,
+    GRAPH_STATE_COPY_SOURCE = 1 << 1,
+    GRAPH_STATE_SHADER_READ = 1 << 2, // NON_PIXEL_SHADER_RESOURCE
+    GRAPH_STATE_UNORDERED_ACCESS = 1 << 3,
+};
+
+inline GraphState operator|(GraphState a, GraphState b) { return GraphState(uint32_t(a) | uint32_t(b)); }
+
+// States that may be combined with each other and shared by readers
+inline bool IsReadState(GraphState state)
+{
+    return state != GRAPH_STATE_COMMON && (state & ~(GRAPH_STATE_COPY_SOURCE | GRAPH_STATE_SHADER_READ)) == 0;
+}
+
+inline std::string GraphStateName(GraphState state)
+{
+    if (state == GRAPH_STATE_COMMON) return "common";
+    std::string name;
+    const char *names[] = { "copy_dest", "copy_source", "shader_read", "uav" };
+    for (uint32_t bit = 0; bit < 4; ++bit) {
+        if (state & (1u << bit)) name += (name.empty() ? "" : "|") + std::string(names[bit]);
+    }
+    return name;
+}
+
+enum GraphBarrierType : uint32_t {
+    GRAPH_BARRIER_TRANSITION,
+    GRAPH_BARRIER_UAV,
+};
+
+enum GraphBarrierSplit : uint32_t {
+    GRAPH_BARRIER_FULL,
+    GRAPH_BARRIER_BEGIN_ONLY,
+    GRAPH_BARRIER_END_ONLY,
+};
+
+struct GraphBarrier {
+    GraphBarrierType type;
+    GraphBarrierSplit split;
+    uint32_t resource;
+    GraphState before;
+    GraphState after;
+};
+
+// One access per resource and op.
+struct GraphAccess {
+    uint32_t resource;
+    GraphState state;
+    bool write;
+};
+
+inline GraphAccess GraphRead(uint32_t resource, GraphState state) { return { resource, state, false }; }
+inline GraphAccess GraphWrite(uint32_t resource, GraphState state) { return { resource, state, true }; }
+
+struct ComputeGraphStats {
+    uint64_t ops = 0;
+    uint64_t levels = 0;
+    uint64_t batches = 0;      // barrier calls
+    uint64_t transitions = 0;  // a split begin + end counts once
+    uint64_t splits = 0;
+    uint64_t uavBarriers = 0;
+    uint64_t naiveBarriers = 0; // hand-written: one call each
+    uint64_t invalidAccesses = 0;
+
+    uint64_t Removed() const { return naiveBarriers > transitions + uavBarriers ? naiveBarriers - transitions - uavBarriers : 0; }
+};
+
+class ComputeGraph {
+public:
+    using ResourceId = uint32_t;
+    using OpId = uint32_t;
+    using BarrierSink = std::function<void(std::vector<GraphBarrier> const &)>;
+
+    ResourceId AddResource(const char *name, GraphState initial)
+    {
+        resources_.push_back({ name, initial, false });
+        return ResourceId(resources_.size() - 1);
+    }
+
+    OpId AddOp(const char *name, std::vector<GraphAccess> accesses, std::function<void()> record = nullptr)
+    {
+        ops_.push_back({ name, std::move(accesses), std::move(record), 0 });
+        return OpId(ops_.size() - 1);
+    }
+
+    void SetSplitBarriers(bool split) { splitBarriers_ = split; }
+
+    GraphState State(ResourceId resource) const { return resources_[resource].state; }
+    const char *ResourceName(ResourceId resource) const { return resources_[resource].name; }
+
+    // Buffers return to COMMON when ExecuteCommandLists finishes; call it
+    // after a submit so the next graph starts from there.
+    void Decay()
+    {
+        for (Resource &r : resources_) {
+            r.state = GRAPH_STATE_COMMON;
+            r.uavWritten = false;
+        }
+    }
+
+    // Runs the ops added since the last Execute: per level, issue gets the
+    // barrier batch (when there is one), then the ops record in the order
+    // they were added.
+    void Execute(BarrierSink const &issue)
+    {
+        CountNaive();
+        uint32_t numLevels = AssignLevels();
+        std::vector<std::vector<GraphBarrier>> batches = PlanBarriers(numLevels);
+
+        std::vector<GraphState> shadow(resources_.size());
+        std::vector<bool> splitting(resources_.size(), false);
+        for (ResourceId r = 0; r < resources_.size(); ++r) shadow[r] = levelStartStates_[r];
+        for (uint32_t level = 0; level < numLevels; ++level) {
+            std::vector<GraphBarrier> const &batch = batches[level];
+            for (GraphBarrier const &b : batch) {
+                if (b.type != GRAPH_BARRIER_TRANSITION) continue;
+                if (shadow[b.resource] != b.before && b.split != GRAPH_BARRIER_END_ONLY) stats_.invalidAccesses++;
+                splitting[b.resource] = b.split == GRAPH_BARRIER_BEGIN_ONLY;
+                shadow[b.resource] = b.after;
+            }
+            if (!batch.empty()) {
+                issue(batch);
+                stats_.batches++;
+            }
+            for (Op const &op : ops_) {
+                if (op.level != level) continue;
+                for (GraphAccess const &a : op.accesses) {
+                    if (splitting[a.resource] || (shadow[a.resource] & a.state) != a.state) stats_.invalidAccesses++;
+                }
+                if (op.record) op.record();
+            }
+        }
+        stats_.ops += ops_.size();
+        stats_.levels += numLevels;
+        ops_.clear();
+    }
+
+    ComputeGraphStats const &Stats() const { return stats_; }
+
+    void Report(std::ostream &os) const
+    {
+        os << "graph: " << stats_.ops << " ops in " << stats_.levels << " levels, " << stats_.transitions << " transitions ("
+           << stats_.splits << " split) and " << stats_.uavBarriers << " UAV barriers in " << stats_.batches << " calls; hand-written "
+           << stats_.naiveBarriers << " barriers in as many calls, " << stats_.Removed() << " removed";
+        if (stats_.invalidAccesses) os << "; " << stats_.invalidAccesses << " INVALID accesses";
+        os << std::endl;
+    }
+
+private:
+    struct Resource {
+        const char *name;
+        GraphState state;
+        bool uavWritten; // written as UAV since the last barrier
+    };
+
+    struct Op {
+        const char *name;
+        std::vector<GraphAccess> accesses;
+        std::function<void()> record;
+        uint32_t level;
+    };
+
+    // A write, or an access in a state no one else may share
+    static bool Exclusive(GraphAccess const &a) { return a.write || !IsReadState(a.state); }
+
+    // What hand-written code would issue for the ops in program order: a
+    // transition to exactly the accessed state whenever it differs, and a
+    // UAV barrier between two UAV uses after a write.
+    void CountNaive()
+    {
+        std::vector<GraphState> state(resources_.size());
+        std::vector<bool> uavWritten(resources_.size());
+        for (ResourceId r = 0; r < resources_.size(); ++r) {
+            state[r] = resources_[r].state;
+            uavWritten[r] = resources_[r].uavWritten;
+        }
+        for (Op const &op : ops_) {
+            for (GraphAccess const &a : op.accesses) {
+                if (state[a.resource] != a.state) {
+                    stats_.naiveBarriers++;
+                    state[a.resource] = a.state;
+                    uavWritten[a.resource] = false;
+                } else if (a.state == GRAPH_STATE_UNORDERED_ACCESS && uavWritten[a.resource]) {
+                    stats_.naiveBarriers++;
+                    uavWritten[a.resource] = false;
+                }
+                if (a.write && a.state == GRAPH_STATE_UNORDERED_ACCESS) uavWritten[a.resource] = true;
+            }
+        }
+    }
+
+    // Level of an op: one past the deepest op it has a hazard with.
+    uint32_t AssignLevels()
+    {
+        std::vector<int64_t> lastExclusive(resources_.size(), -1);
+        std::vector<std::vector<uint32_t>> readers(resources_.size());
+        uint32_t numLevels = 0;
+        for (uint32_t i = 0; i < ops_.size(); ++i) {
+            Op &op = ops_[i];
+            uint32_t level = 0;
+            for (GraphAccess const &a : op.accesses) {
+                if (lastExclusive[a.resource] >= 0) level = std::max(level, ops_[lastExclusive[a.resource]].level + 1);
+                if (Exclusive(a)) {
+                    for (uint32_t reader : readers[a.resource]) level = std::max(level, ops_[reader].level + 1);
+                }
+            }
+            op.level = level;
+            numLevels = std::max(numLevels, level + 1);
+            for (GraphAccess const &a : op.accesses) {
+                if (Exclusive(a)) {
+                    lastExclusive[a.resource] = i;
+                    readers[a.resource].clear();
+                } else {
+                    readers[a.resource].push_back(i);
+                }
+            }
+        }
+        return numLevels;
+    }
+
+    std::vector<std::vector<GraphBarrier>> PlanBarriers(uint32_t numLevels)
+    {
+        std::vector<std::vector<GraphBarrier>> batches(numLevels);
+        levelStartStates_.resize(resources_.size());
+        for (ResourceId r = 0; r < resources_.size(); ++r) levelStartStates_[r] = resources_[r].state;
+        std::vector<int64_t> lastLevel(resources_.size(), -1);
+
+        for (uint32_t level = 0; level < numLevels; ++level) {
+            // The state each resource needs in this level, and whether a UAV
+            // write happens in it
+            std::vector<GraphState> needed(resources_.size(), GRAPH_STATE_COMMON);
+            std::vector<bool> used(resources_.size(), false), uavWrite(resources_.size(), false);
+            for (Op const &op : ops_) {
+                if (op.level != level) continue;
+                for (GraphAccess const &a : op.accesses) {
+                    needed[a.resource] = needed[a.resource] | a.state;
+                    used[a.resource] = true;
+                    if (a.write && a.state == GRAPH_STATE_UNORDERED_ACCESS) uavWrite[a.resource] = true;
+                }
+            }
+            for (ResourceId r = 0; r < resources_.size(); ++r) {
+                if (!used[r]) continue;
+                Resource &res = resources_[r];
+                bool covered = IsReadState(res.state) && IsReadState(needed[r]) && (res.state & needed[r]) == needed[r];
+                if (res.state == needed[r] || covered) {
+                    if (needed[r] == GRAPH_STATE_UNORDERED_ACCESS && res.uavWritten) {
+                        batches[level].push_back({ GRAPH_BARRIER_UAV, GRAPH_BARRIER_FULL, r, needed[r], needed[r] });
+                        stats_.uavBarriers++;
+                        res.uavWritten = false;
+                    }
+                } else {
+                    uint32_t begin = uint32_t(lastLevel[r] + 1);
+                    if (splitBarriers_ && begin < level) {
+                        batches[begin].push_back({ GRAPH_BARRIER_TRANSITION, GRAPH_BARRIER_BEGIN_ONLY, r, res.state, needed[r] });
+                        batches[level].push_back({ GRAPH_BARRIER_TRANSITION, GRAPH_BARRIER_END_ONLY, r, res.state, needed[r] });
+                        stats_.splits++;
+                    } else {
+                        batches[level].push_back({ GRAPH_BARRIER_TRANSITION, GRAPH_BARRIER_FULL, r, res.state, needed[r] });
+                    }
+                    stats_.transitions++;
+                    res.state = needed[r];
+                    res.uavWritten = false;
+                }
+                if (uavWrite[r]) res.uavWritten = true;
+                lastLevel[r] = level;
+            }
+        }
+        return batches;
+    }
+
+    std::vector<Resource> resources_;
+    std::vector<Op> ops_;
+    std::vector<GraphState> levelStartStates_;
+    bool splitBarriers_ = false;
+    ComputeGraphStats stats_;
+};
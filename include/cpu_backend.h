@@ -0,0 +1,510 @@
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "util.h"
+#include "grouped_gemv.h"
+#include "linalg_host.h"
+#include "low_rank.h"
+#include "mlp_training.h"
+#include "row_split.h"
+#include "sparse_util.h"
+#include "tiled_gemv.h"
+#include "thread_pool.h"
+#include "trace.h"
+
+// CPU backend: emulates Dispatch(x, y, z) of the compute shaders in shader/
+// so the host-side logic can run and be checked without a D3D12 device.
+//
+// A kernel is a functor with a static NumThreads (the [numthreads] of the
+// shader) and an operator() taking the system values of one thread. Thread
+// groups are the unit of scheduling: ranges of groups are handed to the
+// ThreadPool and the threads of one group run back to back on one core.
+// Kernels therefore must not rely on group barriers or groupshared memory.
+
+struct Uint3 {
+    uint32_t x, y, z;
+};
+
+struct CpuThreadContext {
+    Uint3 groupId;          // SV_GroupID
+    Uint3 groupThreadId;    // SV_GroupThreadID
+    Uint3 dispatchThreadId; // SV_DispatchThreadID
+    uint32_t groupIndex;    // SV_GroupIndex
+};
+
+// Runs every SV_DispatchThreadID of the grid. groupsPerChunk == 0 lets the
+// pool pick the chunking.
+template <typename Kernel>
+void CpuDispatch(ThreadPool &pool, Kernel const &kernel, uint32_t x, uint32_t y, uint32_t z, uint64_t groupsPerChunk = 0)
+{
+    const Uint3 numThreads = Kernel::NumThreads;
+    const uint64_t numGroups = uint64_t(x) * y * z;
+    TRACE_SCOPE_ARG("CpuDispatch", "groups", numGroups);
+    pool.ParallelFor(numGroups, groupsPerChunk, [&](uint64_t begin, uint64_t end) {
+        TRACE_SCOPE_ARG("group chunk", "first group", begin);
+        for (uint64_t g = begin; g < end; ++g) {
+            CpuThreadContext ctx;
+            ctx.groupId.x = uint32_t(g % x);
+            ctx.groupId.y = uint32_t((g / x) % y);
+            ctx.groupId.z = uint32_t(g / (uint64_t(x) * y));
+            ctx.groupIndex = 0;
+            for (uint32_t tz = 0; tz < numThreads.z; ++tz) {
+                for (uint32_t ty = 0; ty < numThreads.y; ++ty) {
+                    for (uint32_t tx = 0; tx < numThreads.x; ++tx) {
+                        ctx.groupThreadId = { tx, ty, tz };
+                        ctx.dispatchThreadId = {
+                            ctx.groupId.x * numThreads.x + tx,
+                            ctx.groupId.y * numThreads.y + ty,
+                            ctx.groupId.z * numThreads.z + tz,
+                        };
+                        kernel(ctx);
+                        ctx.groupIndex++;
+                    }
+                }
+            }
+        }
+    });
+}
+
+// Number of groups needed to cover `threads` threads along one axis.
+inline uint32_t CpuGroupCount(uint32_t threads, uint32_t groupSize)
+{
+    return (threads + groupSize - 1) / groupSize;
+}
+
+// VectorMulAdd.hlsl: one thread per output row. A null biasVec is a
+// MulAdd without the add (the first half of a low-rank layer).
+struct VectorMulAddKernel {
+    static constexpr Uint3 NumThreads = { 4, 1, 1 };
+
+    DataType dataType;
+    void *outputVec;
+    void const *matrix;
+    void const *inputVec;
+    void const *biasVec;
+    uint32_t M, K, strideK;
+
+    void operator()(CpuThreadContext const &ctx) const
+    {
+        uint32_t m = ctx.dispatchThreadId.x;
+        if (m >= M) return;
+        float sum = 0.0f;
+        for (uint32_t k = 0; k < K; ++k) {
+            float a = GetDataFloat(inputVec, dataType, 0, k);
+            float b = GetDataFloat(matrix, dataType, m * strideK, k);
+            sum += a * b;
+        }
+        if (biasVec) sum += GetDataFloat(biasVec, dataType, 0, m);
+        SetDataFloat(outputVec, dataType, 0, m, sum);
+    }
+};
+
+// CoopVectorMulAdd.hlsl with per-operand types (MatMulAddTypes). The caller
+// converts the input once per dispatch (LoadInterpretedInput); every thread
+// then only converts its own matrix row and bias element.
+struct MixedVectorMulAddKernel {
+    static constexpr Uint3 NumThreads = { 4, 1, 1 };
+
+    MatMulAddTypes types;
+    void *outputVec;
+    void const *matrix;
+    float const *input; // interpreted input, K floats
+    void const *biasVec;
+    uint32_t M, K, strideK;
+
+    void operator()(CpuThreadContext const &ctx) const
+    {
+        uint32_t m = ctx.dispatchThreadId.x;
+        if (m >= M) return;
+        SetDataFloat(outputVec, types.output, 0, m, MatMulAddRow(types, input, matrix, m * strideK, biasVec, m, K));
+    }
+};
+
+// VectorMulAdd.hlsl over a batch of F32 input vectors that need not be
+// contiguous (the GEMV service gathers them from several clients): thread
+// x is the row, y the vector, so the matrix is read once per batch.
+struct GatherVectorMulAddKernel {
+    static constexpr Uint3 NumThreads = { 4, 1, 1 };
+
+    float *const *outputs;
+    float const *const *inputs;
+    void const *matrix;
+    float const *bias;
+    uint32_t M, K, strideK, numVectors;
+
+    void operator()(CpuThreadContext const &ctx) const
+    {
+        uint32_t m = ctx.dispatchThreadId.x, v = ctx.dispatchThreadId.y;
+        if (m >= M || v >= numVectors) return;
+        float const *row = reinterpret_cast<float const *>(static_cast<uint8_t const *>(matrix) + uint64_t(m) * strideK);
+        float const *input = inputs[v];
+        float sum = 0.0f;
+        for (uint32_t k = 0; k < K; ++k) sum += input[k] * row[k];
+        outputs[v][m] = sum + bias[m];
+    }
+};
+
+// VectorMulAdd.hlsl on typed views: data types, shape and layout are
+// template parameters, so the per-element switch of GetDataFloat is gone.
+template <typename MatrixViewT, DataType InputDT, DataType BiasDT, DataType OutputDT>
+struct TypedVectorMulAddKernel {
+    static constexpr Uint3 NumThreads = { 4, 1, 1 };
+
+    linalg::RWVectorView<OutputDT> outputVec;
+    MatrixViewT matrix;
+    linalg::VectorView<InputDT> inputVec;
+    linalg::VectorView<BiasDT> biasVec;
+
+    void operator()(CpuThreadContext const &ctx) const
+    {
+        uint32_t m = ctx.dispatchThreadId.x;
+        if (m >= MatrixViewT::Rows) return;
+        std::array<float, MatrixViewT::Cols> input;
+        for (uint32_t k = 0; k < MatrixViewT::Cols; ++k) input[k] = inputVec.Load(k);
+        outputVec.Store(m, matrix.RowDot(m, input.data()) + biasVec.Load(m));
+    }
+};
+
+// VectorMulAdd.hlsl built with an epilogue permutation (EPI_SCALE, EPI_ACT,
+// OUT_F16): the epilogue and the output conversion happen before the store.
+template <typename Epi>
+struct FusedVectorMulAddKernel {
+    static constexpr Uint3 NumThreads = { 4, 1, 1 };
+
+    DataType dataType;
+    DataType outputType;
+    void *outputVec;
+    void const *matrix;
+    void const *inputVec;
+    void const *biasVec;
+    uint32_t M, K, strideK;
+    EpilogueParams params;
+
+    void operator()(CpuThreadContext const &ctx) const
+    {
+        uint32_t m = ctx.dispatchThreadId.x;
+        if (m >= M) return;
+        float sum = 0.0f;
+        for (uint32_t k = 0; k < K; ++k) {
+            float a = GetDataFloat(inputVec, dataType, 0, k);
+            float b = GetDataFloat(matrix, dataType, m * strideK, k);
+            sum += a * b;
+        }
+        sum += GetDataFloat(biasVec, dataType, 0, m);
+        SetDataFloat(outputVec, outputType, 0, m, Epi::Apply(sum, m, params));
+    }
+};
+
+// CoopVectorMulAdd.hlsl: every thread multiplies its own input vector by the
+// whole matrix. The shader runs one thread; batched use puts one vector per
+// SV_DispatchThreadID.x, with vectors inputStride / outputStride bytes apart.
+// One thread per group, so every vector is a unit of work for the pool.
+struct CoopVectorMulAddKernel {
+    static constexpr Uint3 NumThreads = { 1, 1, 1 };
+
+    DataType dataType;
+    void *outputVec;
+    void const *matrix;
+    void const *inputVec;
+    void const *biasVec;
+    uint32_t M, K, strideK;
+    uint32_t batch;
+    uint32_t inputStride, outputStride;
+
+    void operator()(CpuThreadContext const &ctx) const
+    {
+        uint32_t v = ctx.dispatchThreadId.x;
+        if (v >= batch) return;
+        MatMulAdd(dataType,
+            (uint8_t *)outputVec + uint64_t(v) * outputStride,
+            matrix,
+            (uint8_t const *)inputVec + uint64_t(v) * inputStride,
+            biasVec, M, K, strideK);
+    }
+};
+
+// GroupedVectorMulAdd.hlsl: one group per GemvGroupTile.
+struct GroupedVectorMulAddKernel {
+    static constexpr Uint3 NumThreads = { 32, 1, 1 };
+
+    DataType dataType;
+    void *outputVec;
+    void const *matrix;
+    void const *inputVec;
+    void const *biasVec;
+    GemvGroupEntry const *entries;
+    GemvGroupTile const *tiles;
+
+    void operator()(CpuThreadContext const &ctx) const
+    {
+        GemvGroupTile const &tile = tiles[ctx.groupId.x];
+        GemvGroupEntry const &e = entries[tile.entryIndex];
+        for (uint32_t m = tile.rowBegin + ctx.groupIndex; m < tile.rowEnd; m += NumThreads.x) {
+            float sum = 0.0f;
+            for (uint32_t k = 0; k < e.K; ++k) {
+                float a = GetDataFloat(inputVec, dataType, e.inputOffset, k);
+                float b = GetDataFloat(matrix, dataType, e.matrixOffset + m * e.strideK, k);
+                sum += a * b;
+            }
+            sum += GetDataFloat(biasVec, dataType, e.biasOffset, m);
+            SetDataFloat(outputVec, dataType, e.outputOffset, m, sum);
+        }
+    }
+};
+
+// SparseVectorMulAdd.hlsl: one thread per output row of a 2:4 matrix.
+struct SparseVectorMulAddKernel {
+    static constexpr Uint3 NumThreads = { 4, 1, 1 };
+
+    DataType dataType;
+    void *outputVec;
+    Sparse24Matrix const *matrix;
+    void const *inputVec;
+    void const *biasVec;
+
+    void operator()(CpuThreadContext const &ctx) const
+    {
+        uint32_t m = ctx.dispatchThreadId.x;
+        if (m >= matrix->M) return;
+        float sum = SparseRowDot(*matrix, m, inputVec);
+        sum += GetDataFloat(biasVec, dataType, 0, m);
+        SetDataFloat(outputVec, dataType, 0, m, sum);
+    }
+};
+
+// MLP training step (mlp_training.h): one thread per sample, gradients
+// accumulated atomically into grads. losses gets one value per sample.
+template <typename Shape>
+struct MlpTrainStepKernel {
+    static constexpr Uint3 NumThreads = { 32, 1, 1 };
+
+    void const *params;
+    void *grads;
+    float const *samples;
+    float *losses;
+    uint32_t batch;
+
+    void operator()(CpuThreadContext const &ctx) const
+    {
+        uint32_t s = ctx.dispatchThreadId.x;
+        if (s >= batch) return;
+        losses[s] = MlpTrainSample<Shape>(params, grads, samples + uint64_t(s) * Shape::SampleFloats);
+    }
+};
+
+// Inference of the MLP: one thread per sample, inputs and outputs
+// gathered like GatherVectorMulAddKernel.
+template <typename Shape>
+struct MlpForwardKernel {
+    static constexpr Uint3 NumThreads = { 32, 1, 1 };
+
+    void const *params;
+    float *const *outputs;
+    float const *const *inputs;
+    uint32_t batch;
+
+    void operator()(CpuThreadContext const &ctx) const
+    {
+        uint32_t s = ctx.dispatchThreadId.x;
+        if (s >= batch) return;
+        MlpActivations<Shape> a = MlpForward<Shape>(params, inputs[s]);
+        std::copy(a.y.begin(), a.y.end(), outputs[s]);
+    }
+};
+
+// MLP optimizer step (mlp_training.h): one thread per parameter word.
+struct MlpOptimizerKernel {
+    static constexpr Uint3 NumThreads = { 64, 1, 1 };
+
+    float *params;
+    float *grads;
+    float *momentum;
+    uint32_t words;
+    uint32_t batch;
+    MlpOptimizerParams opt;
+
+    void operator()(CpuThreadContext const &ctx) const
+    {
+        uint32_t w = ctx.dispatchThreadId.x;
+        if (w >= words) return;
+        MlpOptimizerUpdate(params, grads, momentum, w, batch, opt);
+    }
+};
+
+// ID3D12Fence on the CPU: a monotonic value, Wait blocks until it is reached.
+class CpuFence {
+public:
+    void Signal(uint64_t value)
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            value_ = value;
+        }
+        reached_.notify_all();
+    }
+
+    void Wait(uint64_t value)
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        reached_.wait(lock, [&] { return value_ >= value; });
+    }
+
+    uint64_t GetCompletedValue()
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return value_;
+    }
+
+private:
+    std::mutex mutex_;
+    std::condition_variable reached_;
+    uint64_t value_ = 0;
+};
+
+// Out-of-core VectorMulAdd (tiled_gemv.h): matrix rows are copied from
+// system memory into the two-slot window by a copy thread, the copy queue,
+// while the pool multiplies the previous tile into its output slice.
+// window must hold plan.WindowBytes().
+inline void CpuTiledVectorMulAdd(
+    ThreadPool &pool,
+    RowTilePlan const &plan,
+    DataType dataType,
+    void *outputVec,
+    void const *matrix,
+    void const *inputVec,
+    void const *biasVec,
+    uint32_t K,
+    void *window
+)
+{
+    std::vector<RowTileStep> steps = BuildRowTileSchedule(plan);
+    CpuFence copyFence, computeFence;
+
+    std::thread copyQueue([&] {
+        Trace::SetThreadName("copy queue");
+        for (RowTileStep const &step : steps) {
+            if (step.kind != RowTileStep::TILE_COPY) continue;
+            {
+                TRACE_SCOPE_ARG("wait compute fence", "value", step.waitValue);
+                computeFence.Wait(step.waitValue);
+            }
+            TRACE_SCOPE_ARG("tile copy", "tile", step.tile);
+            uint32_t rowBegin = plan.RowBegin(step.tile);
+            memcpy((uint8_t *)window + plan.Slot(step.tile) * plan.SlotBytes(),
+                   (uint8_t const *)matrix + uint64_t(rowBegin) * plan.strideK,
+                   uint64_t(plan.RowEnd(step.tile) - rowBegin) * plan.strideK);
+            copyFence.Signal(step.signalValue);
+        }
+    });
+
+    uint32_t elementSize = SizeofType(dataType);
+    for (RowTileStep const &step : steps) {
+        if (step.kind != RowTileStep::TILE_COMPUTE) continue;
+        {
+            TRACE_SCOPE_ARG("wait copy fence", "value", step.waitValue);
+            copyFence.Wait(step.waitValue);
+        }
+        TRACE_SCOPE_ARG("tile compute", "tile", step.tile);
+        uint32_t rowBegin = plan.RowBegin(step.tile);
+        uint32_t rows = plan.RowEnd(step.tile) - rowBegin;
+        VectorMulAddKernel kernel = { dataType,
+                                      (uint8_t *)outputVec + uint64_t(rowBegin) * elementSize,
+                                      (uint8_t const *)window + plan.Slot(step.tile) * plan.SlotBytes(),
+                                      inputVec,
+                                      (uint8_t const *)biasVec + uint64_t(rowBegin) * elementSize,
+                                      rows, K, plan.strideK };
+        CpuDispatch(pool, kernel, CpuGroupCount(rows, VectorMulAddKernel::NumThreads.x), 1, 1);
+        computeFence.Signal(step.signalValue);
+    }
+    copyQueue.join();
+}
+
+// A CPU stand-in for one device of the row-split mode (row_split.h): its own
+// pool and its own queue thread. A device with slowdown S runs every
+// dispatch S times, to emulate a slower part next to a fast one.
+struct CpuSplitDevice {
+    std::unique_ptr<ThreadPool> pool;
+    uint32_t slowdown = 1;
+    std::vector<uint8_t> output; // the device-local output slice
+};
+
+// Row-split VectorMulAdd: every device multiplies its slice of the rows on
+// its queue thread into its own output buffer and signals its fence; the
+// host waits on all fences and gathers the slices into outputVec. Returns
+// the time of every device in ms, 0 for an empty slice.
+inline std::vector<double> CpuRowSplitVectorMulAdd(
+    std::vector<CpuSplitDevice> &devices,
+    std::vector<RowSlice> const &slices,
+    DataType dataType,
+    void *outputVec,
+    void const *matrix,
+    void const *inputVec,
+    void const *biasVec,
+    uint32_t K,
+    uint32_t strideK
+)
+{
+    uint32_t elementSize = SizeofType(dataType);
+    std::vector<CpuFence> fences(devices.size());
+    std::vector<double> ms(devices.size(), 0.0);
+    std::vector<std::thread> queues;
+    for (size_t d = 0; d < devices.size(); ++d) {
+        queues.emplace_back([&, d] {
+            Trace::SetThreadName("split device " + std::to_string(d));
+            RowSlice slice = slices[d];
+            if (slice.Rows()) {
+                TRACE_SCOPE_ARG("split slice", "rows", slice.Rows());
+                CpuSplitDevice &device = devices[d];
+                device.output.resize(uint64_t(slice.Rows()) * elementSize);
+                auto start = std::chrono::steady_clock::now();
+                VectorMulAddKernel kernel = { dataType, device.output.data(),
+                                              (uint8_t const *)matrix + uint64_t(slice.begin) * strideK,
+                                              inputVec,
+                                              (uint8_t const *)biasVec + uint64_t(slice.begin) * elementSize,
+                                              slice.Rows(), K, strideK };
+                for (uint32_t r = 0; r < device.slowdown; ++r) {
+                    CpuDispatch(*device.pool, kernel, CpuGroupCount(slice.Rows(), VectorMulAddKernel::NumThreads.x), 1, 1);
+                }
+                ms[d] = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+            }
+            fences[d].Signal(1);
+        });
+    }
+
+    // Gather in device order as the fences complete
+    for (size_t d = 0; d < devices.size(); ++d) {
+        fences[d].Wait(1);
+        RowSlice slice = slices[d];
+        if (slice.Rows() == 0) continue;
+        memcpy((uint8_t *)outputVec + uint64_t(slice.begin) * elementSize, devices[d].output.data(), uint64_t(slice.Rows()) * elementSize);
+    }
+    for (std::thread &q : queues) q.join();
+    return ms;
+}
+
+// Low-rank layer (low_rank.h): t = V x, then y = U t + b, two dispatches
+// with the intermediate (layout.rank elements of layout.dt) in between.
+inline void CpuLowRankVectorMulAdd(
+    ThreadPool &pool,
+    LowRankLayout const &layout,
+    void *outputVec,
+    void const *uBuffer,
+    void const *vBuffer,
+    void const *inputVec,
+    void const *biasVec,
+    void *intermediate
+)
+{
+    VectorMulAddKernel project = { layout.dt, intermediate, vBuffer, inputVec, nullptr, layout.rank, layout.K, layout.strideV };
+    CpuDispatch(pool, project, CpuGroupCount(layout.rank, VectorMulAddKernel::NumThreads.x), 1, 1);
+    VectorMulAddKernel expand = { layout.dt, outputVec, uBuffer, intermediate, biasVec, layout.M, layout.rank, layout.strideU };
+    CpuDispatch(pool, expand, CpuGroupCount(layout.M, VectorMulAddKernel::NumThreads.x), 1, 1);
+}
@@ -0,0 +1,50 @@
+#pragma once
+
+#include <cmath>
+#include <cstdint>
+
+// Fused epilogues: element-wise ops applied to (matrix * input + bias) in
+// registers, before the value is converted to the output type and stored.
+//
+// An epilogue is a compile-time list of ops, applied left to right:
+//
+//   Epilogue<EpilogueRowScale, EpilogueRelu>  ->  relu(scale[m] * (Wx + b)[m])
+//
+// The shader side (shader/epilogue.hlsli) is driven by EPI_SCALE / EPI_ACT
+// defines; keep the op order the same as the permutation being checked.
+
+struct EpilogueParams {
+    float const *rowScale = nullptr; // per-row dequant scale, EpilogueRowScale
+    float leakyAlpha = 0.01f;        // negative slope, EpilogueLeakyRelu
+};
+
+struct EpilogueRowScale {
+    static float Apply(float v, uint32_t row, EpilogueParams const &p) { return v * p.rowScale[row]; }
+};
+
+struct EpilogueRelu {
+    static float Apply(float v, uint32_t, EpilogueParams const &) { return v > 0.0f ? v : 0.0f; }
+};
+
+struct EpilogueLeakyRelu {
+    static float Apply(float v, uint32_t, EpilogueParams const &p) { return v > 0.0f ? v : v * p.leakyAlpha; }
+};
+
+struct EpilogueSigmoid {
+    static float Apply(float v, uint32_t, EpilogueParams const &) { return 1.0f / (1.0f + std::exp(-v)); }
+};
+
+struct EpilogueSilu {
+    static float Apply(float v, uint32_t, EpilogueParams const &) { return v / (1.0f + std::exp(-v)); }
+};
+
+template <typename... Ops>
+struct Epilogue {
+    static float Apply(float v, [[maybe_unused]] uint32_t row, [[maybe_unused]] EpilogueParams const &p)
+    {
+        ((v = Ops::Apply(v, row, p)), ...);
+        return v;
+    }
+};
+
+using NoEpilogue = Epilogue<>;
@@ -0,0 +1,329 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <iostream>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include "cpu_backend.h"
+#include "job_ring.h"
+#include "memory_budget.h"
+#include "mlp_training.h"
+#include "thread_pool.h"
+#include "trace.h"
+
+// GEMV service: one long-running process keeps the models (weights,
+// pipelines, the pool) resident and runs MulAdd or MLP jobs of local
+// clients, so a client pays for a ring push instead of device and PSO
+// creation. Everything the jobs touch lives in one shared-memory segment:
+//
+//   ServiceHeader   sizes and offsets of the parts below
+//   JobRing         clients push GemvJobs, the service pops them
+//   regions         one per client (regionBytes each): the client puts its
+//                   inputs, outputs and job status words there
+//
+// A job only carries offsets into the segment (the segment maps at a
+// different address in every process), so inputs are read and outputs
+// written in place, without a copy. The service pops every job that
+// arrives within a short batch window and runs all jobs of one model as a
+// single dispatch over the gathered vectors, so the weights are read once
+// per batch instead of once per client. The platform parts (segment
+// mapping, control socket, client registry) are in GemvService.cpp; this
+// file has no OS dependency.
+//
+// Trust: every client maps the whole segment read-write, so nothing stops
+// a client from writing another client's region directly; the clients are
+// processes of the same user (the segment and the socket are 0600) and are
+// trusted that far. What the service does enforce is that a job it runs
+// touches only the region of the client holding the job's token, handed
+// out at registration (SetClientToken) and revoked when the client leaves,
+// so a forged, stale or misaddressed job cannot make the service read or
+// write someone else's region.
+
+const uint32_t GEMV_SERVICE_MAGIC = 0x564d4547; // "GEMV"
+const uint32_t GEMV_SERVICE_VERSION = 1;
+
+enum GemvModelKind : uint32_t {
+    GEMV_MODEL_MULADD, // F32 matrix * input + bias
+    GEMV_MODEL_MLP,    // ServiceMlp forward pass
+};
+
+enum GemvJobStatus : uint32_t {
+    GEMV_JOB_PENDING,
+    GEMV_JOB_DONE,
+    GEMV_JOB_FAILED, // offsets outside the client region, bad token, or unknown model
+};
+
+using ServiceMlp = MlpShape<16, 32, 8>;
+
+struct GemvJob {
+    uint32_t client;       // region the offsets must stay in
+    uint32_t model;
+    uint32_t count;        // input vectors (MulAdd) or samples (MLP)
+    uint32_t token;        // the client's token, see SetClientToken
+    uint64_t inputOffset;  // count * inputs F32, from the segment base
+    uint64_t outputOffset; // count * outputs F32
+    uint64_t statusOffset; // std::atomic<uint32_t> GemvJobStatus, stored last
+};
+
+struct GemvServiceConfig {
+    uint32_t ringCapacity = 256; // power of two
+    uint32_t maxClients = 16;
+    uint64_t regionBytes = 1 << 20;
+    uint32_t maxBatch = 64;      // jobs per batch
+    uint32_t batchWindowUs = 20; // how long the first job of a batch waits for company
+};
+
+struct ServiceHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t ringCapacity;
+    uint32_t maxClients;
+    uint64_t regionBytes;
+    uint64_t ringOffset;
+    uint64_t regionsOffset;
+    uint64_t totalBytes;
+};
+
+struct GemvModelInfo {
+    uint32_t id;
+    GemvModelKind kind;
+    uint32_t inputs;
+    uint32_t outputs;
+    uint32_t seed;
+};
+
+// Writes the header of a segment for config; returns its size when
+// segment is null, so the caller can size the mapping first.
+inline uint64_t InitServiceSegment(void *segment, GemvServiceConfig const &config)
+{
+    ServiceHeader header = {};
+    header.magic = GEMV_SERVICE_MAGIC;
+    header.version = GEMV_SERVICE_VERSION;
+    header.ringCapacity = config.ringCapacity;
+    header.maxClients = config.maxClients;
+    header.regionBytes = config.regionBytes;
+    header.ringOffset = (sizeof(ServiceHeader) + 63) & ~63ull;
+    header.regionsOffset = (header.ringOffset + JobRing<GemvJob>::Bytes(config.ringCapacity) + 4095) & ~4095ull;
+    header.totalBytes = header.regionsOffset + config.regionBytes * config.maxClients;
+    if (segment) {
+        *static_cast<ServiceHeader *>(segment) = header;
+        JobRing<GemvJob>::Create(static_cast<uint8_t *>(segment) + header.ringOffset, config.ringCapacity);
+    }
+    return header.totalBytes;
+}
+
+inline uint64_t ServiceRegionOffset(ServiceHeader const &header, uint32_t client)
+{
+    return header.regionsOffset + header.regionBytes * client;
+}
+
+inline std::atomic<uint32_t> &ServiceJobStatus(void *segment, uint64_t offset)
+{
+    return *reinterpret_cast<std::atomic<uint32_t> *>(static_cast<uint8_t *>(segment) + offset);
+}
+
+// Weights of a MulAdd model, a function of the seed only, so a client can
+// rebuild them to check its results.
+inline void FillServiceLayer(uint32_t seed, uint32_t M, uint32_t K, uint32_t strideK, uint8_t *matrix, float *bias)
+{
+    for (uint32_t m = 0; m < M; ++m) {
+        float *row = reinterpret_cast<float *>(matrix + uint64_t(m) * strideK);
+        for (uint32_t k = 0; k < K; ++k) row[k] = float(int((m * 7 + k * 3 + seed) % 11) - 5) * 0.125f;
+        bias[m] = float(int((m + seed) % 5) - 2) * 0.5f;
+    }
+}
+
+class GemvService {
+public:
+    struct Stats {
+        uint64_t jobs, vectors, batches, dispatches, failed;
+    };
+
+    GemvService(ThreadPool &pool, void *segment, GemvServiceConfig const &config, MemoryAccount &memory)
+        : pool_(pool), segment_(static_cast<uint8_t *>(segment)), config_(config), memory_(memory)
+    {
+        header_ = *static_cast<ServiceHeader const *>(segment);
+        ring_ = JobRing<GemvJob>::Attach(segment_ + header_.ringOffset);
+        segmentCharge_ = MemoryCharge(memory_, MEMORY_POOL_HOST, MEMORY_ACTIVATIONS, header_.totalBytes, "service segment");
+        tokens_.reset(new std::atomic<uint32_t>[header_.maxClients]);
+        for (uint32_t c = 0; c < header_.maxClients; ++c) tokens_[c].store(0, std::memory_order_relaxed);
+    }
+
+    // Binds a region to the token its client was given; jobs must carry
+    // it. 0 revokes: jobs for the region fail until the next registration.
+    // Safe to call while another thread runs batches.
+    void SetClientToken(uint32_t client, uint32_t token)
+    {
+        if (client < header_.maxClients) tokens_[client].store(token, std::memory_order_release);
+    }
+
+    // Models are added before the first RunBatch and stay resident.
+    uint32_t AddMulAddModel(uint32_t M, uint32_t K, uint32_t seed)
+    {
+        Model model;
+        model.info = { uint32_t(models_.size()), GEMV_MODEL_MULADD, K, M, seed };
+        model.strideK = (K * 4 + 31) & ~31u;
+        model.weights.resize(uint64_t(model.strideK) * M);
+        model.bias.resize(M);
+        FillServiceLayer(seed, M, K, model.strideK, model.weights.data(), model.bias.data());
+        model.charge = MemoryCharge(memory_, MEMORY_POOL_DEVICE, MEMORY_WEIGHTS, model.weights.size() + M * 4, "service layer");
+        models_.push_back(std::move(model));
+        return models_.back().info.id;
+    }
+
+    uint32_t AddMlpModel(uint32_t seed)
+    {
+        Model model;
+        model.info = { uint32_t(models_.size()), GEMV_MODEL_MLP, ServiceMlp::Inputs, ServiceMlp::Outputs, seed };
+        MlpInitParams<ServiceMlp>(model.params, seed);
+        model.charge = MemoryCharge(memory_, MEMORY_POOL_DEVICE, MEMORY_WEIGHTS, ServiceMlp::ParamBytes, "service mlp");
+        models_.push_back(std::move(model));
+        return models_.back().info.id;
+    }
+
+    std::vector<GemvModelInfo> Models() const
+    {
+        std::vector<GemvModelInfo> infos;
+        for (Model const &model : models_) infos.push_back(model.info);
+        return infos;
+    }
+
+    // Pops the jobs that arrive within the batch window of the first one
+    // (at most maxBatch) and runs them. False when the ring was empty.
+    bool RunBatch()
+    {
+        GemvJob job;
+        if (!ring_.TryPop(job)) return false;
+        batch_.clear();
+        batch_.push_back(job);
+        auto deadline = std::chrono::steady_clock::now() + std::chrono::microseconds(config_.batchWindowUs);
+        while (batch_.size() < config_.maxBatch) {
+            if (ring_.TryPop(job)) {
+                batch_.push_back(job);
+            } else if (std::chrono::steady_clock::now() >= deadline) {
+                break;
+            } else {
+                std::this_thread::yield();
+            }
+        }
+        Execute();
+        return true;
+    }
+
+    // Safe to call while another thread runs batches.
+    Stats GetStats() const
+    {
+        return { jobs_.load(std::memory_order_relaxed), vectors_.load(std::memory_order_relaxed), batches_.load(std::memory_order_relaxed),
+                 dispatches_.load(std::memory_order_relaxed), failed_.load(std::memory_order_relaxed) };
+    }
+
+    void Report(std::ostream &os) const
+    {
+        Stats s = GetStats();
+        os << "service: " << s.jobs << " jobs, " << s.vectors << " vectors in " << s.batches << " batches ("
+           << (s.batches ? double(s.jobs) / s.batches : 0.0) << " jobs per batch), " << s.dispatches << " dispatches, " << s.failed << " failed"
+           << std::endl;
+    }
+
+private:
+    struct Model {
+        GemvModelInfo info;
+        uint32_t strideK = 0;
+        std::vector<uint8_t> weights;
+        std::vector<float> bias;
+        std::vector<float> params;
+        MemoryCharge charge;
+    };
+
+    // A job may only touch the region of the client that holds its token,
+    // and every F32 array and the status word must be 4-byte aligned.
+    bool Authorized(GemvJob const &job) const
+    {
+        return job.client < header_.maxClients && job.token != 0 && tokens_[job.client].load(std::memory_order_acquire) == job.token;
+    }
+
+    bool Valid(GemvJob const &job) const
+    {
+        if (!Authorized(job) || job.model >= models_.size() || job.count == 0) return false;
+        GemvModelInfo const &info = models_[job.model].info;
+        uint64_t begin = ServiceRegionOffset(header_, job.client), end = begin + header_.regionBytes;
+        auto Inside = [&](uint64_t offset, uint64_t bytes) { return offset % 4 == 0 && offset >= begin && offset <= end && bytes <= end - offset; };
+        return Inside(job.inputOffset, uint64_t(job.count) * info.inputs * 4) && Inside(job.outputOffset, uint64_t(job.count) * info.outputs * 4);
+    }
+
+    bool StatusValid(GemvJob const &job) const
+    {
+        if (!Authorized(job)) return false;
+        uint64_t begin = ServiceRegionOffset(header_, job.client);
+        return job.statusOffset % 4 == 0 && job.statusOffset >= begin && job.statusOffset + 4 <= begin + header_.regionBytes;
+    }
+
+    // One dispatch per model over the vectors of all its jobs, then the
+    // status words; a client sees its outputs once its status is DONE.
+    // Jobs are validated once up front: SetClientToken may run on another
+    // thread, and the status must say whether the job actually ran.
+    void Execute()
+    {
+        TRACE_SCOPE_ARG("service batch", "jobs", batch_.size());
+        uint64_t vectors = 0, dispatches = 0, failed = 0;
+        valid_.resize(batch_.size());
+        statusValid_.resize(batch_.size());
+        for (size_t j = 0; j < batch_.size(); ++j) {
+            valid_[j] = Valid(batch_[j]);
+            statusValid_[j] = StatusValid(batch_[j]);
+        }
+        for (Model const &model : models_) {
+            inputs_.clear();
+            outputs_.clear();
+            for (size_t j = 0; j < batch_.size(); ++j) {
+                GemvJob const &job = batch_[j];
+                if (job.model != model.info.id || !valid_[j]) continue;
+                for (uint32_t v = 0; v < job.count; ++v) {
+                    inputs_.push_back(reinterpret_cast<float const *>(segment_ + job.inputOffset) + uint64_t(v) * model.info.inputs);
+                    outputs_.push_back(reinterpret_cast<float *>(segment_ + job.outputOffset) + uint64_t(v) * model.info.outputs);
+                }
+            }
+            if (inputs_.empty()) continue;
+            uint32_t count = uint32_t(inputs_.size());
+            if (model.info.kind == GEMV_MODEL_MULADD) {
+                GatherVectorMulAddKernel kernel = { outputs_.data(), inputs_.data(), model.weights.data(), model.bias.data(),
+                                                    model.info.outputs, model.info.inputs, model.strideK, count };
+                CpuDispatch(pool_, kernel, CpuGroupCount(model.info.outputs, GatherVectorMulAddKernel::NumThreads.x), count, 1);
+            } else {
+                MlpForwardKernel<ServiceMlp> kernel = { model.params.data(), outputs_.data(), inputs_.data(), count };
+                CpuDispatch(pool_, kernel, CpuGroupCount(count, MlpForwardKernel<ServiceMlp>::NumThreads.x), 1, 1);
+            }
+            vectors += count;
+            dispatches++;
+        }
+        for (size_t j = 0; j < batch_.size(); ++j) {
+            failed += !valid_[j];
+            if (statusValid_[j])
+                ServiceJobStatus(segment_, batch_[j].statusOffset).store(valid_[j] ? GEMV_JOB_DONE : GEMV_JOB_FAILED, std::memory_order_release);
+        }
+        jobs_.fetch_add(batch_.size(), std::memory_order_relaxed);
+        vectors_.fetch_add(vectors, std::memory_order_relaxed);
+        batches_.fetch_add(1, std::memory_order_relaxed);
+        dispatches_.fetch_add(dispatches, std::memory_order_relaxed);
+        failed_.fetch_add(failed, std::memory_order_relaxed);
+    }
+
+    ThreadPool &pool_;
+    uint8_t *segment_;
+    GemvServiceConfig config_;
+    MemoryAccount &memory_;
+    ServiceHeader header_;
+    JobRing<GemvJob> ring_;
+    MemoryCharge segmentCharge_;
+    std::unique_ptr<std::atomic<uint32_t>[]> tokens_;
+    std::vector<Model> models_;
+    std::vector<GemvJob> batch_;
+    std::vector<float const *> inputs_;
+    std::vector<float *> outputs_;
+    std::vector<uint8_t> valid_, statusValid_; // per job of batch_
+    std::atomic<uint64_t> jobs_{ 0 }, vectors_{ 0 }, batches_{ 0 }, dispatches_{ 0 }, failed_{ 0 };
+};
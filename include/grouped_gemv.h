@@ -0,0 +1,113 @@
+#pragma once
+
+#include <vector>
+#include <algorithm>
+
+#include "util.h"
+
+// One item of a grouped (ragged) GEMV: output = matrix * input + bias, where
+// every item has its own shape and lives at its own byte offset inside the
+// shared matrix / bias / input / output buffers.
+// The layout must match the entry table read by GroupedVectorMulAdd.hlsl.
+struct GemvGroupEntry {
+    uint32_t matrixOffset;  // bytes into the matrix buffer
+    uint32_t biasOffset;    // bytes into the bias buffer
+    uint32_t inputOffset;   // bytes into the input vector buffer
+    uint32_t outputOffset;  // bytes into the output vector buffer
+    uint32_t M;
+    uint32_t K;
+    uint32_t strideK;       // bytes between two matrix rows
+    uint32_t reserved;
+};
+
+// A contiguous range of rows of one entry, executed by one thread group.
+struct GemvGroupTile {
+    uint32_t entryIndex;
+    uint32_t rowBegin;
+    uint32_t rowEnd;
+    uint32_t reserved;
+};
+
+struct GemvGroupBufferSizes {
+    uint32_t matrix;
+    uint32_t bias;
+    uint32_t input;
+    uint32_t output;
+};
+
+// Packs the entries back to back: fills in the offsets and strideK of every
+// entry from its M and K, and returns the total size of each shared buffer.
+inline GemvGroupBufferSizes AssignGemvGroupOffsets(DataType dt, std::vector<GemvGroupEntry> &entries, uint32_t strideAlignBytes)
+{
+    GemvGroupBufferSizes sizes = {};
+    for (GemvGroupEntry &e : entries) {
+        e.strideK = (SizeofType(dt) * e.K + strideAlignBytes - 1) & ~(strideAlignBytes - 1);
+        e.matrixOffset = sizes.matrix;
+        e.biasOffset = sizes.bias;
+        e.inputOffset = sizes.input;
+        e.outputOffset = sizes.output;
+        e.reserved = 0;
+        sizes.matrix += e.strideK * e.M;
+        sizes.bias += SizeofType(dt) * e.M;
+        sizes.input += SizeofType(dt) * e.K;
+        sizes.output += SizeofType(dt) * e.M;
+    }
+    return sizes;
+}
+
+// Picks the per-tile cost (in multiply-adds) so that the whole group splits
+// into roughly targetTiles tiles, but never below one row of the widest entry.
+inline uint64_t ChooseGemvGroupTileCost(std::vector<GemvGroupEntry> const &entries, uint32_t targetTiles)
+{
+    uint64_t totalMacs = 0;
+    uint32_t maxK = 1;
+    for (GemvGroupEntry const &e : entries) {
+        totalMacs += uint64_t(e.M) * e.K;
+        maxK = std::max(maxK, e.K);
+    }
+    uint64_t cost = totalMacs / std::max(targetTiles, 1u);
+    return std::max<uint64_t>(cost, maxK);
+}
+
+// Splits every entry into row tiles of about tileCost multiply-adds each, so
+// a 4096x16 item and a 64x1024 item produce similarly sized pieces of work.
+// Tiles are ordered most expensive first (longest-processing-time first) so
+// the tail of the dispatch is made of the cheap leftovers.
+inline std::vector<GemvGroupTile> BuildGemvGroupTiles(std::vector<GemvGroupEntry> const &entries, uint64_t tileCost)
+{
+    std::vector<GemvGroupTile> tiles;
+    for (uint32_t i = 0; i < entries.size(); ++i) {
+        GemvGroupEntry const &e = entries[i];
+        uint64_t rows = tileCost / std::max(e.K, 1u);
+        uint32_t rowsPerTile = uint32_t(std::min<uint64_t>(std::max<uint64_t>(rows, 1), e.M));
+        for (uint32_t row = 0; row < e.M; row += rowsPerTile) {
+            tiles.push_back({ i, row, std::min(row + rowsPerTile, e.M), 0 });
+        }
+    }
+    std::stable_sort(tiles.begin(), tiles.end(), [&](GemvGroupTile const &a, GemvGroupTile const &b) {
+        uint64_t costA = uint64_t(a.rowEnd - a.rowBegin) * entries[a.entryIndex].K;
+        uint64_t costB = uint64_t(b.rowEnd - b.rowBegin) * entries[b.entryIndex].K;
+        return costA > costB;
+    });
+    return tiles;
+}
+
+// Grouped CPU reference: one MatMulAdd per entry on the shared buffers.
+inline void GroupedMatMulAdd(
+    DataType dataType,
+    void *outputVec,
+    void const *matrix,
+    void const *inputVec,
+    void const *biasVec,
+    std::vector<GemvGroupEntry> const &entries
+)
+{
+    for (GemvGroupEntry const &e : entries) {
+        MatMulAdd(dataType,
+            (uint8_t *)outputVec + e.outputOffset,
+            (uint8_t const *)matrix + e.matrixOffset,
+            (uint8_t const *)inputVec + e.inputOffset,
+            (uint8_t const *)biasVec + e.biasOffset,
+            e.M, e.K, e.strideK);
+    }
+}
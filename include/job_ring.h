@@ -0,0 +1,131 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <new>
+#include <type_traits>
+
+// Bounded lock-free ring of trivially copyable jobs that lives in memory
+// the caller provides, so several processes can map it: any number of
+// producers (clients) push, any number of consumers (the service) pop.
+// Every slot carries a sequence number (Vyukov's bounded MPMC queue): a
+// producer claims a position with one CAS on the tail, writes the job and
+// publishes it with a release store of the sequence; a consumer does the
+// same on the head. Nobody waits on a lock, so a client that dies half way
+// only stalls its own slot.
+//
+//   JobRing<Job>::Create(memory, 256);            owner, once
+//   JobRing<Job> ring = JobRing<Job>::Attach(memory);
+//   ring.TryPush(job); ring.TryPop(job);
+//
+// Only address-free (always lock-free) atomics are placed in the shared
+// memory, and positions are 64-bit so they never wrap.
+
+template <typename Job>
+class JobRing {
+    static_assert(std::is_trivially_copyable<Job>::value, "jobs are copied between processes");
+    static_assert(std::atomic<uint64_t>::is_always_lock_free, "shared-memory atomics must be lock-free");
+
+public:
+    // Bytes of shared memory for a ring of capacity jobs
+    static constexpr size_t Bytes(uint32_t capacity) { return sizeof(Header) + sizeof(Slot) * size_t(capacity); }
+
+    // Initializes the ring in memory (at least Bytes(capacity), 64-byte
+    // aligned). capacity must be a power of two.
+    static JobRing Create(void *memory, uint32_t capacity)
+    {
+        Header *header = new (memory) Header;
+        header->capacity = capacity;
+        header->head.store(0, std::memory_order_relaxed);
+        header->tail.store(0, std::memory_order_relaxed);
+        Slot *slots = reinterpret_cast<Slot *>(header + 1);
+        for (uint32_t i = 0; i < capacity; ++i) {
+            new (&slots[i]) Slot;
+            slots[i].sequence.store(i, std::memory_order_relaxed);
+        }
+        std::atomic_thread_fence(std::memory_order_release);
+        return Attach(memory);
+    }
+
+    static JobRing Attach(void *memory)
+    {
+        JobRing ring;
+        ring.header_ = static_cast<Header *>(memory);
+        ring.slots_ = reinterpret_cast<Slot *>(ring.header_ + 1);
+        ring.mask_ = ring.header_->capacity - 1;
+        return ring;
+    }
+
+    uint32_t Capacity() const { return mask_ + 1; }
+
+    // False when the ring is full
+    bool TryPush(Job const &job)
+    {
+        uint64_t pos = header_->tail.load(std::memory_order_relaxed);
+        for (;;) {
+            Slot &slot = slots_[pos & mask_];
+            uint64_t sequence = slot.sequence.load(std::memory_order_acquire);
+            int64_t diff = int64_t(sequence) - int64_t(pos);
+            if (diff == 0) {
+                if (header_->tail.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    slot.job = job;
+                    slot.sequence.store(pos + 1, std::memory_order_release);
+                    return true;
+                }
+            } else if (diff < 0) {
+                return false;
+            } else {
+                pos = header_->tail.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    // False when the ring is empty
+    bool TryPop(Job &job)
+    {
+        uint64_t pos = header_->head.load(std::memory_order_relaxed);
+        for (;;) {
+            Slot &slot = slots_[pos & mask_];
+            uint64_t sequence = slot.sequence.load(std::memory_order_acquire);
+            int64_t diff = int64_t(sequence) - int64_t(pos + 1);
+            if (diff == 0) {
+                if (header_->head.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    job = slot.job;
+                    slot.sequence.store(pos + mask_ + 1, std::memory_order_release);
+                    return true;
+                }
+            } else if (diff < 0) {
+                return false;
+            } else {
+                pos = header_->head.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    // Jobs pushed and not yet popped; a snapshot, for stats only.
+    uint64_t Size() const
+    {
+        uint64_t tail = header_->tail.load(std::memory_order_relaxed);
+        uint64_t head = header_->head.load(std::memory_order_relaxed);
+        return tail > head ? tail - head : 0;
+    }
+
+private:
+    // Head and tail on separate cache lines: producers and consumers do not
+    // invalidate each other's position.
+    struct Header {
+        uint32_t capacity;
+        alignas(64) std::atomic<uint64_t> tail;
+        alignas(64) std::atomic<uint64_t> head;
+    };
+
+    struct alignas(64) Slot {
+        std::atomic<uint64_t> sequence;
+        Job job;
+    };
+
+    Header *header_ = nullptr;
+    Slot *slots_ = nullptr;
+    uint32_t mask_ = 0;
+};
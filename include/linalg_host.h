@@ -0,0 +1,369 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <cstring>
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+#include "util.h"
+
+// Host-side mirror of shader/linalg.h.
+//
+// The void* + runtime DataType helpers (SetDataFloat / GetDataFloat) pay a
+// switch per element and cannot see layout mistakes. The views below carry
+// the data type, shape and layout in the type, like MatrixRef / VectorRef
+// in HLSL, so element access resolves at compile time and Mul / MulAdd
+// specialize their inner loops per data type:
+//
+//   linalg::MatrixView<DATA_TYPE_FLOAT16, 8, 8, linalg::MATRIX_LAYOUT_ROW_MAJOR> matrix = { data, 0, 16 };
+//   linalg::VectorView<DATA_TYPE_FLOAT16> bias = { biasData, 0 };
+//   auto out = linalg::MulAdd<float>(matrix, linalg::MakeInterpretedVector<DATA_TYPE_FLOAT16>(in), bias);
+//
+// Results are bit-identical to the runtime path: the conversions are the
+// ones SetDataFloat / GetDataFloat use and the accumulation order is the
+// same as MatMulAdd in util.h.
+
+namespace linalg {
+
+enum MatrixLayout {
+    MATRIX_LAYOUT_ROW_MAJOR = 0,
+    MATRIX_LAYOUT_COLUMN_MAJOR = 1,
+    MATRIX_LAYOUT_MUL_OPTIMAL = 2,
+    MATRIX_LAYOUT_OUTER_PRODUCT_OPTIMAL = 3
+};
+
+//
+// Data type traits
+//
+
+// Storage: element type in memory. Load / Store convert one element to and
+// from float, Round is Store followed by Load (the value after conversion).
+template <DataType DT> struct DataTypeTraits;
+
+template <> struct DataTypeTraits<DATA_TYPE_FLOAT32> {
+    using Storage = float;
+    static float Load(Storage v) { return v; }
+    static Storage Store(float v) { return v; }
+    static float Round(float v) { return v; }
+};
+
+template <> struct DataTypeTraits<DATA_TYPE_FLOAT16> {
+    using Storage = uint16_t;
+    static float Load(Storage v) { return SmallFloatBitsToFloat<5, 10>(v); }
+    static Storage Store(float v) { return Storage(FloatToSmallFloatBits<5, 10>(v)); }
+    static float Round(float v) { return Load(Store(v)); }
+};
+
+namespace details {
+// 8-bit floats decode through a 256-entry table built from the same
+// conversion as GetDataFloat.
+template <uint32_t expBits, uint32_t manBits>
+struct SmallFloat8Traits {
+    using Storage = uint8_t;
+    static std::array<float, 256> BuildTable()
+    {
+        std::array<float, 256> table;
+        for (uint32_t i = 0; i < 256; ++i) table[i] = SmallFloatBitsToFloat<expBits, manBits>(i);
+        return table;
+    }
+    static inline const std::array<float, 256> Table = BuildTable();
+
+    static float Load(Storage v) { return Table[v]; }
+    static Storage Store(float v) { return Storage(FloatToSmallFloatBits<expBits, manBits>(v)); }
+    static float Round(float v) { return Load(Store(v)); }
+};
+} // namespace details
+
+template <> struct DataTypeTraits<DATA_TYPE_FLOAT8_E4M3> : details::SmallFloat8Traits<4, 3> {};
+template <> struct DataTypeTraits<DATA_TYPE_FLOAT8_E5M2> : details::SmallFloat8Traits<5, 2> {};
+
+template <DataType DT>
+constexpr uint32_t ElementSize = sizeof(typename DataTypeTraits<DT>::Storage);
+
+//
+// (RW)MatrixView
+//
+
+// M x K is the shape used by Mul (M outputs, K inputs). With Transpose the
+// buffer holds the K x M matrix and element (m, k) is read from (k, m).
+// Stride is the byte distance between rows (row major) or columns (column
+// major) of the stored matrix. The optimal layouts are opaque to the host.
+template <typename BufferTy, DataType DT, uint32_t M, uint32_t K, MatrixLayout ML, bool Transpose>
+struct MatrixViewImpl {
+    static_assert(ML == MATRIX_LAYOUT_ROW_MAJOR || ML == MATRIX_LAYOUT_COLUMN_MAJOR,
+                  "only row and column major matrices are addressable on the host");
+
+    using Traits = DataTypeTraits<DT>;
+    using Storage = typename Traits::Storage;
+    static constexpr uint32_t Rows = M;
+    static constexpr uint32_t Cols = K;
+
+    BufferTy Buffer;
+    uint32_t StartOffset;
+    uint32_t Stride;
+
+    static constexpr uint32_t StoredRows = Transpose ? K : M;
+    static constexpr uint32_t StoredCols = Transpose ? M : K;
+
+    uint64_t Offset(uint32_t m, uint32_t k) const
+    {
+        uint32_t r = Transpose ? k : m;
+        uint32_t c = Transpose ? m : k;
+        if (ML == MATRIX_LAYOUT_ROW_MAJOR) return StartOffset + uint64_t(r) * Stride + uint64_t(c) * sizeof(Storage);
+        return StartOffset + uint64_t(c) * Stride + uint64_t(r) * sizeof(Storage);
+    }
+
+    float Load(uint32_t m, uint32_t k) const
+    {
+        Storage v;
+        memcpy(&v, (uint8_t const *)Buffer + Offset(m, k), sizeof(v));
+        return Traits::Load(v);
+    }
+
+    void Store(uint32_t m, uint32_t k, float value) const
+    {
+        Storage v = Traits::Store(value);
+        memcpy((uint8_t *)Buffer + Offset(m, k), &v, sizeof(v));
+    }
+
+    // Bytes from StartOffset to the end of the last stored row / column.
+    uint64_t SizeInBytes() const
+    {
+        uint32_t lines = ML == MATRIX_LAYOUT_ROW_MAJOR ? StoredRows : StoredCols;
+        uint32_t lineElements = ML == MATRIX_LAYOUT_ROW_MAJOR ? StoredCols : StoredRows;
+        return uint64_t(lines - 1) * Stride + uint64_t(lineElements) * sizeof(Storage);
+    }
+
+    // Dot product of row m with K already converted input values. Row major
+    // untransposed rows are contiguous and run as a plain typed loop.
+    float RowDot(uint32_t m, float const *input) const
+    {
+        float sum = 0.0f;
+        if (ML == MATRIX_LAYOUT_ROW_MAJOR && !Transpose) {
+            Storage const *row = (Storage const *)((uint8_t const *)Buffer + StartOffset + uint64_t(m) * Stride);
+            for (uint32_t k = 0; k < K; ++k) {
+                sum += input[k] * Traits::Load(row[k]);
+            }
+        } else {
+            for (uint32_t k = 0; k < K; ++k) {
+                sum += input[k] * Load(m, k);
+            }
+        }
+        return sum;
+    }
+};
+
+template <DataType DT, uint32_t M, uint32_t K, MatrixLayout ML, bool Transpose = false>
+using MatrixView = MatrixViewImpl<void const *, DT, M, K, ML, Transpose>;
+
+template <DataType DT, uint32_t M, uint32_t K, MatrixLayout ML, bool Transpose = false>
+using RWMatrixView = MatrixViewImpl<void *, DT, M, K, ML, Transpose>;
+
+//
+// (RW)VectorView
+//
+
+template <typename BufferTy, DataType DT>
+struct VectorViewImpl {
+    using Traits = DataTypeTraits<DT>;
+    using Storage = typename Traits::Storage;
+
+    BufferTy Buffer;
+    uint32_t StartOffset;
+
+    float Load(uint32_t i) const
+    {
+        Storage v;
+        memcpy(&v, (uint8_t const *)Buffer + StartOffset + uint64_t(i) * sizeof(Storage), sizeof(v));
+        return Traits::Load(v);
+    }
+
+    void Store(uint32_t i, float value) const
+    {
+        Storage v = Traits::Store(value);
+        memcpy((uint8_t *)Buffer + StartOffset + uint64_t(i) * sizeof(Storage), &v, sizeof(v));
+    }
+};
+
+template <DataType DT>
+using VectorView = VectorViewImpl<void const *, DT>;
+
+template <DataType DT>
+using RWVectorView = VectorViewImpl<void *, DT>;
+
+//
+// Vector
+//
+
+// N values of T, converted to DT by Mul / MulAdd before the multiply.
+template <typename T, int N, DataType DT>
+struct InterpretedVector {
+    std::array<T, N> Data;
+};
+
+template <DataType DT, typename T, size_t N>
+InterpretedVector<T, int(N), DT> MakeInterpretedVector(std::array<T, N> const &vec)
+{
+    InterpretedVector<T, int(N), DT> iv = { vec };
+    return iv;
+}
+
+// Loads N elements of a vector view into an InterpretedVector of floats.
+template <int N, typename BufferTy, DataType DT>
+InterpretedVector<float, N, DT> LoadInterpretedVector(VectorViewImpl<BufferTy, DT> const &vec)
+{
+    InterpretedVector<float, N, DT> iv;
+    for (int i = 0; i < N; ++i) iv.Data[i] = vec.Load(i);
+    return iv;
+}
+
+//
+// Mul
+//
+
+template <typename OutputElTy, typename InputElTy, int InputElCount, typename MatrixBufferTy,
+          DataType InputDT, DataType MatrixDT, uint32_t MatrixM, uint32_t MatrixK,
+          MatrixLayout ML, bool MatrixTranspose>
+std::array<OutputElTy, MatrixM>
+Mul(MatrixViewImpl<MatrixBufferTy, MatrixDT, MatrixM, MatrixK, ML, MatrixTranspose> const &matrix,
+    InterpretedVector<InputElTy, InputElCount, InputDT> const &inputVector)
+{
+    static_assert(InputElCount == int(MatrixK), "input vector length must match the matrix K");
+    std::array<float, MatrixK> input;
+    for (uint32_t k = 0; k < MatrixK; ++k) {
+        input[k] = DataTypeTraits<InputDT>::Round(float(inputVector.Data[k]));
+    }
+    std::array<OutputElTy, MatrixM> output;
+    for (uint32_t m = 0; m < MatrixM; ++m) {
+        output[m] = OutputElTy(matrix.RowDot(m, input.data()));
+    }
+    return output;
+}
+
+//
+// MulAdd
+//
+
+template <typename OutputElTy, typename InputElTy, int InputElCount, typename MatrixBufferTy,
+          DataType InputDT, DataType MatrixDT, uint32_t MatrixM, uint32_t MatrixK,
+          MatrixLayout ML, bool MatrixTranspose, typename BiasVectorBufferTy, DataType BiasVectorDT>
+std::array<OutputElTy, MatrixM>
+MulAdd(MatrixViewImpl<MatrixBufferTy, MatrixDT, MatrixM, MatrixK, ML, MatrixTranspose> const &matrix,
+       InterpretedVector<InputElTy, InputElCount, InputDT> const &inputVector,
+       VectorViewImpl<BiasVectorBufferTy, BiasVectorDT> const &biasVector)
+{
+    static_assert(InputElCount == int(MatrixK), "input vector length must match the matrix K");
+    std::array<float, MatrixK> input;
+    for (uint32_t k = 0; k < MatrixK; ++k) {
+        input[k] = DataTypeTraits<InputDT>::Round(float(inputVector.Data[k]));
+    }
+    std::array<OutputElTy, MatrixM> output;
+    for (uint32_t m = 0; m < MatrixM; ++m) {
+        output[m] = OutputElTy(matrix.RowDot(m, input.data()) + biasVector.Load(m));
+    }
+    return output;
+}
+
+//
+// OuterProductAccumulate / VectorAccumulate
+//
+
+namespace details {
+// Atomic float add, like the accumulation the GPU does for many threads
+// hitting the same gradient element.
+inline void AtomicAddFloat(void *ptr, float value)
+{
+#if defined(_MSC_VER)
+    volatile long *bits = (volatile long *)ptr;
+    long expected = *bits;
+    for (;;) {
+        float current;
+        memcpy(&current, &expected, sizeof(current));
+        float sum = current + value;
+        long desired;
+        memcpy(&desired, &sum, sizeof(desired));
+        long previous = _InterlockedCompareExchange(bits, desired, expected);
+        if (previous == expected) break;
+        expected = previous;
+    }
+#else
+    uint32_t *bits = (uint32_t *)ptr;
+    uint32_t expected = __atomic_load_n(bits, __ATOMIC_RELAXED);
+    for (;;) {
+        float current;
+        memcpy(&current, &expected, sizeof(current));
+        float sum = current + value;
+        uint32_t desired;
+        memcpy(&desired, &sum, sizeof(desired));
+        if (__atomic_compare_exchange_n(bits, &expected, desired, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) break;
+    }
+#endif
+}
+} // namespace details
+
+// matrix += v1 * v2^T, element by element atomically. Float32 accumulators
+// only on the host.
+template <typename ElTy, size_t N1, size_t N2, DataType MatrixDT, uint32_t M, uint32_t N, MatrixLayout ML>
+void OuterProductAccumulate(std::array<ElTy, N1> const &inputVector1, std::array<ElTy, N2> const &inputVector2,
+                            MatrixViewImpl<void *, MatrixDT, M, N, ML, false> const &matrix)
+{
+    static_assert(N1 == M && N2 == N, "vector lengths must match the matrix shape");
+    static_assert(MatrixDT == DATA_TYPE_FLOAT32, "host accumulation is Float32 only");
+    for (uint32_t m = 0; m < M; ++m) {
+        for (uint32_t n = 0; n < N; ++n) {
+            details::AtomicAddFloat((uint8_t *)matrix.Buffer + matrix.Offset(m, n), float(inputVector1[m]) * float(inputVector2[n]));
+        }
+    }
+}
+
+// buffer[offset ..] += inputVector, element by element atomically.
+template <size_t N>
+void VectorAccumulate(std::array<float, N> const &inputVector, void *buffer, uint32_t offset)
+{
+    for (uint32_t i = 0; i < N; ++i) {
+        details::AtomicAddFloat((uint8_t *)buffer + offset + i * sizeof(float), inputVector[i]);
+    }
+}
+
+//
+// Buffer helpers
+//
+
+// Typed counterpart of MatMulAdd in util.h: output = matrix * input + bias,
+// each operand in its own data type, the output converted on store.
+template <DataType OutputDT, typename MatrixBufferTy, DataType MatrixDT, uint32_t M, uint32_t K,
+          MatrixLayout ML, bool Transpose, typename InputBufferTy, DataType InputDT,
+          typename BiasBufferTy, DataType BiasDT>
+void MatMulAdd(RWVectorView<OutputDT> const &outputVec,
+               MatrixViewImpl<MatrixBufferTy, MatrixDT, M, K, ML, Transpose> const &matrix,
+               VectorViewImpl<InputBufferTy, InputDT> const &inputVec,
+               VectorViewImpl<BiasBufferTy, BiasDT> const &biasVec)
+{
+    std::array<float, K> input;
+    for (uint32_t k = 0; k < K; ++k) input[k] = inputVec.Load(k);
+    for (uint32_t m = 0; m < M; ++m) {
+        outputVec.Store(m, matrix.RowDot(m, input.data()) + biasVec.Load(m));
+    }
+}
+
+// Fills every element of a writable view, e.g. straight into a mapped
+// upload buffer: fn(m, k) for matrices, fn(i) for the first count elements
+// of vectors.
+template <typename Fn, DataType DT, uint32_t M, uint32_t K, MatrixLayout ML, bool Transpose>
+void Fill(MatrixViewImpl<void *, DT, M, K, ML, Transpose> const &matrix, Fn &&fn)
+{
+    for (uint32_t m = 0; m < M; ++m) {
+        for (uint32_t k = 0; k < K; ++k) matrix.Store(m, k, fn(m, k));
+    }
+}
+
+template <typename Fn, DataType DT>
+void Fill(VectorViewImpl<void *, DT> const &vec, uint32_t count, Fn &&fn)
+{
+    for (uint32_t i = 0; i < count; ++i) vec.Store(i, fn(i));
+}
+
+} // namespace linalg
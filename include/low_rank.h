@@ -0,0 +1,291 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <numeric>
+#include <vector>
+
+#include "util.h"
+
+// Low-rank layers: a wide M x K matrix W is replaced by U (M x r) and V
+// (r x K) with W ~ U V, and the GEMV by two chained MulAdds
+//
+//   t = V x          K -> r, no bias
+//   y = U t + b      r -> M, the bias only here
+//
+// which read (M + K) r elements instead of M K: a win whenever
+// r < M K / (M + K). The factors come from a truncated SVD, W = A S B^T
+// cut to the r largest singular values, with U = A S and V = B^T; the
+// relative Frobenius error of the cut is sqrt(sum of the dropped s^2 /
+// |W|^2), so a rank can be picked for an error target.
+//
+// The SVD is randomized subspace iteration (Halko, Martinsson, Tropp):
+// W times a fixed pseudo-random K x p block, a few rounds of W W^T with
+// re-orthonormalization, then the exact SVD of the small p x K projection
+// via Jacobi on its p x p Gram matrix. It costs O(M K p) per round, so it
+// runs offline on real layer sizes where a full SVD would not.
+
+struct LowRankFactors {
+    uint32_t M = 0, K = 0, rank = 0;
+    std::vector<float> u;              // M x rank, singular values folded in
+    std::vector<float> v;              // rank x K, orthonormal rows
+    std::vector<double> singularValues; // descending, every one computed (>= rank)
+    double frobeniusSq = 0.0;          // |W|^2
+
+    // Relative Frobenius error of W against its rank-r cut
+    double RelativeError(uint32_t r) const
+    {
+        if (frobeniusSq <= 0.0) return 0.0;
+        double kept = 0.0;
+        for (uint32_t i = 0; i < std::min<size_t>(r, singularValues.size()); ++i) kept += singularValues[i] * singularValues[i];
+        return std::sqrt(std::max(frobeniusSq - kept, 0.0) / frobeniusSq);
+    }
+
+    // Smallest factored rank (at most rank, not the oversampled singular
+    // values past it) whose error is within target, or rank when none is;
+    // check RelativeError of the result to tell.
+    uint32_t RankForError(double target) const
+    {
+        for (uint32_t r = 1; r <= rank; ++r) {
+            if (RelativeError(r) <= target) return r;
+        }
+        return rank;
+    }
+
+    // Drops the columns of U and rows of V past r
+    void Truncate(uint32_t r)
+    {
+        r = std::min(r, rank);
+        std::vector<float> cut(uint64_t(M) * r);
+        for (uint32_t m = 0; m < M; ++m) std::copy_n(&u[uint64_t(m) * rank], r, &cut[uint64_t(m) * r]);
+        u.swap(cut);
+        v.resize(uint64_t(r) * K);
+        rank = r;
+    }
+};
+
+namespace low_rank_detail {
+
+// Modified Gram-Schmidt on the p columns of a rows x p row-major block.
+// Columns that vanish (rank deficiency) are zeroed.
+inline void Orthonormalize(std::vector<double> &q, uint32_t rows, uint32_t p)
+{
+    for (uint32_t j = 0; j < p; ++j) {
+        for (uint32_t i = 0; i < j; ++i) {
+            double dot = 0.0;
+            for (uint32_t r = 0; r < rows; ++r) dot += q[uint64_t(r) * p + i] * q[uint64_t(r) * p + j];
+            for (uint32_t r = 0; r < rows; ++r) q[uint64_t(r) * p + j] -= dot * q[uint64_t(r) * p + i];
+        }
+        double norm = 0.0;
+        for (uint32_t r = 0; r < rows; ++r) norm += q[uint64_t(r) * p + j] * q[uint64_t(r) * p + j];
+        norm = std::sqrt(norm);
+        double scale = norm > 1e-300 ? 1.0 / norm : 0.0;
+        for (uint32_t r = 0; r < rows; ++r) q[uint64_t(r) * p + j] *= scale;
+    }
+}
+
+// Eigen decomposition of a symmetric n x n matrix by cyclic Jacobi
+// rotations: a becomes diagonal (the eigenvalues), vectors the columns.
+inline void SymmetricEigen(std::vector<double> &a, uint32_t n, std::vector<double> &vectors)
+{
+    vectors.assign(uint64_t(n) * n, 0.0);
+    for (uint32_t i = 0; i < n; ++i) vectors[uint64_t(i) * n + i] = 1.0;
+    for (uint32_t sweep = 0; sweep < 64; ++sweep) {
+        double off = 0.0, diag = 0.0;
+        for (uint32_t i = 0; i < n; ++i) {
+            diag += a[uint64_t(i) * n + i] * a[uint64_t(i) * n + i];
+            for (uint32_t j = i + 1; j < n; ++j) off += a[uint64_t(i) * n + j] * a[uint64_t(i) * n + j];
+        }
+        if (off <= 1e-30 * diag) break;
+        for (uint32_t p = 0; p < n; ++p) {
+            for (uint32_t q = p + 1; q < n; ++q) {
+                double apq = a[uint64_t(p) * n + q];
+                if (std::fabs(apq) < 1e-300) continue;
+                double theta = (a[uint64_t(q) * n + q] - a[uint64_t(p) * n + p]) / (2.0 * apq);
+                double t = (theta >= 0.0 ? 1.0 : -1.0) / (std::fabs(theta) + std::sqrt(theta * theta + 1.0));
+                double c = 1.0 / std::sqrt(t * t + 1.0), s = t * c;
+                for (uint32_t k = 0; k < n; ++k) {
+                    double akp = a[uint64_t(k) * n + p], akq = a[uint64_t(k) * n + q];
+                    a[uint64_t(k) * n + p] = c * akp - s * akq;
+                    a[uint64_t(k) * n + q] = s * akp + c * akq;
+                }
+                for (uint32_t k = 0; k < n; ++k) {
+                    double apk = a[uint64_t(p) * n + k], aqk = a[uint64_t(q) * n + k];
+                    a[uint64_t(p) * n + k] = c * apk - s * aqk;
+                    a[uint64_t(q) * n + k] = s * apk + c * aqk;
+                }
+                for (uint32_t k = 0; k < n; ++k) {
+                    double vkp = vectors[uint64_t(k) * n + p], vkq = vectors[uint64_t(k) * n + q];
+                    vectors[uint64_t(k) * n + p] = c * vkp - s * vkq;
+                    vectors[uint64_t(k) * n + q] = s * vkp + c * vkq;
+                }
+            }
+        }
+    }
+}
+
+} // namespace low_rank_detail
+
+// Truncated SVD of the F32 matrix W (M rows of strideK bytes) to rank
+// maxRank. oversample extra directions and the power iterations sharpen
+// the subspace when the spectrum decays slowly.
+inline LowRankFactors FactorizeLowRank(float const *W, uint32_t M, uint32_t K, uint32_t strideK, uint32_t maxRank,
+                                       uint32_t iterations = 4, uint32_t oversample = 8)
+{
+    using namespace low_rank_detail;
+    auto Row = [&](uint32_t m) { return reinterpret_cast<float const *>(reinterpret_cast<uint8_t const *>(W) + uint64_t(m) * strideK); };
+
+    LowRankFactors f;
+    f.M = M;
+    f.K = K;
+    maxRank = std::min({ maxRank, M, K });
+    const uint32_t p = std::min({ maxRank + oversample, M, K });
+    for (uint32_t m = 0; m < M; ++m) {
+        for (uint32_t k = 0; k < K; ++k) f.frobeniusSq += double(Row(m)[k]) * Row(m)[k];
+    }
+
+    // Q = orth(W Omega), Omega uniform in [-1, 1) from a fixed LCG
+    std::vector<double> omega(uint64_t(K) * p), q(uint64_t(M) * p, 0.0), z(uint64_t(K) * p, 0.0);
+    uint32_t state = 12345;
+    for (double &x : omega) {
+        state = state * 1664525u + 1013904223u;
+        x = double(state >> 8) / double(1 << 24) * 2.0 - 1.0;
+    }
+    auto MulW = [&](std::vector<double> const &in, std::vector<double> &out) { // out (M x p) = W in (K x p)
+        std::fill(out.begin(), out.end(), 0.0);
+        for (uint32_t m = 0; m < M; ++m) {
+            float const *row = Row(m);
+            double *o = &out[uint64_t(m) * p];
+            for (uint32_t k = 0; k < K; ++k) {
+                double w = row[k];
+                double const *i = &in[uint64_t(k) * p];
+                for (uint32_t j = 0; j < p; ++j) o[j] += w * i[j];
+            }
+        }
+    };
+    auto MulWt = [&](std::vector<double> const &in, std::vector<double> &out) { // out (K x p) = W^T in (M x p)
+        std::fill(out.begin(), out.end(), 0.0);
+        for (uint32_t m = 0; m < M; ++m) {
+            float const *row = Row(m);
+            double const *i = &in[uint64_t(m) * p];
+            for (uint32_t k = 0; k < K; ++k) {
+                double w = row[k];
+                double *o = &out[uint64_t(k) * p];
+                for (uint32_t j = 0; j < p; ++j) o[j] += w * i[j];
+            }
+        }
+    };
+    MulW(omega, q);
+    Orthonormalize(q, M, p);
+    for (uint32_t it = 0; it < iterations; ++it) {
+        MulWt(q, z);
+        Orthonormalize(z, K, p);
+        MulW(z, q);
+        Orthonormalize(q, M, p);
+    }
+
+    // B = Q^T W (p x K), stored transposed as z (K x p); then B B^T = E L E^T
+    MulWt(q, z);
+    std::vector<double> gram(uint64_t(p) * p, 0.0), e;
+    for (uint32_t k = 0; k < K; ++k) {
+        double const *b = &z[uint64_t(k) * p];
+        for (uint32_t i = 0; i < p; ++i)
+            for (uint32_t j = 0; j < p; ++j) gram[uint64_t(i) * p + j] += b[i] * b[j];
+    }
+    SymmetricEigen(gram, p, e);
+    std::vector<uint32_t> order(p);
+    std::iota(order.begin(), order.end(), 0u);
+    std::sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b) { return gram[uint64_t(a) * p + a] > gram[uint64_t(b) * p + b]; });
+
+    // W ~ (Q E) S (S^-1 E^T B): U = Q E S, V = S^-1 E^T B
+    f.rank = maxRank;
+    f.u.assign(uint64_t(M) * maxRank, 0.0f);
+    f.v.assign(uint64_t(maxRank) * K, 0.0f);
+    for (uint32_t i = 0; i < p; ++i) f.singularValues.push_back(std::sqrt(std::max(gram[uint64_t(order[i]) * p + order[i]], 0.0)));
+    for (uint32_t r = 0; r < maxRank; ++r) {
+        uint32_t col = order[r];
+        double sigma = f.singularValues[r];
+        for (uint32_t m = 0; m < M; ++m) {
+            double sum = 0.0;
+            for (uint32_t j = 0; j < p; ++j) sum += q[uint64_t(m) * p + j] * e[uint64_t(j) * p + col];
+            f.u[uint64_t(m) * maxRank + r] = float(sum * sigma);
+        }
+        if (sigma <= 0.0) continue;
+        for (uint32_t k = 0; k < K; ++k) {
+            double sum = 0.0;
+            for (uint32_t j = 0; j < p; ++j) sum += e[uint64_t(j) * p + col] * z[uint64_t(k) * p + j];
+            f.v[uint64_t(r) * K + k] = float(sum / sigma);
+        }
+    }
+    return f;
+}
+
+// Device layout of the factors: U and V rows aligned like the dense matrix.
+struct LowRankLayout {
+    DataType dt;
+    uint32_t M, K, rank;
+    uint32_t strideU, strideV; // bytes per row
+
+    uint64_t UBytes() const { return uint64_t(strideU) * M; }
+    uint64_t VBytes() const { return uint64_t(strideV) * rank; }
+    // Weights read per GEMV, plus the intermediate written and read back
+    uint64_t BytesMoved() const { return UBytes() + VBytes() + 2ull * SizeofType(dt) * rank; }
+};
+
+inline LowRankLayout MakeLowRankLayout(DataType dt, uint32_t M, uint32_t K, uint32_t rank, uint32_t strideAlign = 32)
+{
+    auto Align = [&](uint32_t bytes) { return (bytes + strideAlign - 1) / strideAlign * strideAlign; };
+    return { dt, M, K, rank, Align(SizeofType(dt) * rank), Align(SizeofType(dt) * K) };
+}
+
+// Writes the factors into dt buffers of the layout (UBytes, VBytes).
+inline void StoreLowRankFactors(LowRankFactors const &f, LowRankLayout const &layout, void *uBuffer, void *vBuffer)
+{
+    for (uint32_t m = 0; m < layout.M; ++m)
+        for (uint32_t r = 0; r < layout.rank; ++r) SetDataFloat(uBuffer, layout.dt, m * layout.strideU, r, f.u[uint64_t(m) * f.rank + r]);
+    for (uint32_t r = 0; r < layout.rank; ++r)
+        for (uint32_t k = 0; k < layout.K; ++k) SetDataFloat(vBuffer, layout.dt, r * layout.strideV, k, f.v[uint64_t(r) * f.K + k]);
+}
+
+// CPU reference of the two chained MulAdds. The intermediate is stored in
+// dt like the buffer between the two dispatches.
+inline void LowRankMatMulAdd(LowRankLayout const &layout, void *outputVec, void const *uBuffer, void const *vBuffer, void const *inputVec,
+                             void const *biasVec)
+{
+    std::vector<uint8_t> t(SizeofType(layout.dt) * layout.rank);
+    for (uint32_t r = 0; r < layout.rank; ++r) {
+        float sum = 0.0f;
+        for (uint32_t k = 0; k < layout.K; ++k) sum += GetDataFloat(inputVec, layout.dt, 0, k) * GetDataFloat(vBuffer, layout.dt, r * layout.strideV, k);
+        SetDataFloat(t.data(), layout.dt, 0, r, sum);
+    }
+    for (uint32_t m = 0; m < layout.M; ++m) {
+        float sum = 0.0f;
+        for (uint32_t r = 0; r < layout.rank; ++r) sum += GetDataFloat(t.data(), layout.dt, 0, r) * GetDataFloat(uBuffer, layout.dt, m * layout.strideU, r);
+        SetDataFloat(outputVec, layout.dt, 0, m, sum + GetDataFloat(biasVec, layout.dt, 0, m));
+    }
+}
+
+// Synthetic layer for the tools and benchmarks: rank terms with weights
+// 1 / (1 + i), so the spectrum decays like a trained layer's, plus uniform
+// noise of the given amplitude that makes it full rank. F32, rows of
+// strideK bytes.
+inline void FillLowRankTestMatrix(float *W, uint32_t M, uint32_t K, uint32_t strideK, uint32_t rank, float noise, uint32_t seed = 1)
+{
+    uint32_t state = seed;
+    auto Next = [&] {
+        state = state * 1664525u + 1013904223u;
+        return float(state >> 8) / float(1 << 24) * 2.0f - 1.0f;
+    };
+    std::vector<float> x(uint64_t(M) * rank), y(uint64_t(K) * rank);
+    for (float &value : x) value = Next();
+    for (float &value : y) value = Next();
+    for (uint32_t m = 0; m < M; ++m) {
+        float *row = reinterpret_cast<float *>(reinterpret_cast<uint8_t *>(W) + uint64_t(m) * strideK);
+        for (uint32_t k = 0; k < K; ++k) {
+            float sum = 0.0f;
+            for (uint32_t i = 0; i < rank; ++i) sum += x[uint64_t(m) * rank + i] * y[uint64_t(k) * rank + i] / float(1 + i);
+            row[k] = sum / std::sqrt(float(K)) + noise * Next();
+        }
+    }
+}
@@ -0,0 +1,315 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <limits>
+#include <list>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Memory accounting: every buffer the harness creates is charged to a pool
+// and a category, current and peak usage are kept per (pool, category), and
+// each pool can have a budget.
+//
+//   MEMORY_POOL_DEVICE  video memory: default heap buffers, the DXGI local
+//                       segment (or the emulated device of the CPU backend)
+//   MEMORY_POOL_HOST    system memory: upload and readback heaps (the
+//                       DXGI non-local segment)
+//   MEMORY_POOL_SYSTEM  the process heap: host std::vector copies, which
+//                       no DXGI segment covers, so it is left unbudgeted
+//
+// Allocate charges an allocation or refuses it when the pool would go over
+// budget, so callers pick a smaller plan (tiling) instead of failing inside
+// the driver. Allocations made with an evict callback are evictable: to
+// make room, the least recently used of them in the pool are evicted first
+// (the callback drops the memory, the account drops the charge). Touch marks
+// an allocation as used.
+//
+// On D3D12 the budgets come from IDXGIAdapter3::QueryVideoMemoryInfo, see
+// main.cpp. All methods are thread safe; allocations are rare enough that a
+// mutex costs nothing.
+
+enum MemoryPool : uint32_t {
+    MEMORY_POOL_DEVICE,
+    MEMORY_POOL_HOST,
+    MEMORY_POOL_SYSTEM,
+    MEMORY_POOL_COUNT,
+};
+
+enum MemoryCategory : uint32_t {
+    MEMORY_WEIGHTS,
+    MEMORY_ACTIVATIONS,
+    MEMORY_UPLOAD,
+    MEMORY_READBACK,
+    MEMORY_DESCRIPTORS,
+    MEMORY_CATEGORY_COUNT,
+};
+
+inline const char *MemoryPoolName(MemoryPool pool)
+{
+    switch (pool) {
+    case MEMORY_POOL_DEVICE: return "device";
+    case MEMORY_POOL_HOST: return "host";
+    case MEMORY_POOL_SYSTEM: return "system";
+    default: return "?";
+    }
+}
+
+inline const char *MemoryCategoryName(MemoryCategory category)
+{
+    switch (category) {
+    case MEMORY_WEIGHTS: return "weights";
+    case MEMORY_ACTIVATIONS: return "activations";
+    case MEMORY_UPLOAD: return "upload";
+    case MEMORY_READBACK: return "readback";
+    case MEMORY_DESCRIPTORS: return "descriptors";
+    default: return "?";
+    }
+}
+
+class MemoryAccount {
+public:
+    using AllocationId = uint64_t; // 0 = refused
+    static constexpr uint64_t Unlimited = std::numeric_limits<uint64_t>::max();
+
+    void SetBudget(MemoryPool pool, uint64_t bytes)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        pools_[pool].budget = bytes;
+    }
+
+    uint64_t Budget(MemoryPool pool) const
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return pools_[pool].budget;
+    }
+
+    // Charges bytes to (pool, category), evicting least recently used
+    // evictable allocations of the pool if that makes it fit. Returns 0 and
+    // charges nothing when it cannot fit even with every evictable
+    // allocation gone.
+    AllocationId Allocate(MemoryPool pool, MemoryCategory category, uint64_t bytes, const char *name, std::function<void()> evict = nullptr)
+    {
+        std::vector<std::function<void()>> evicted;
+        AllocationId id = 0;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            PoolState &p = pools_[pool];
+            if (bytes > p.budget || p.current - p.evictableBytes > p.budget - bytes) return 0;
+            while (p.current > p.budget - bytes) {
+                AllocationId victim = p.lru.front();
+                evicted.push_back(allocations_[victim].evict);
+                p.evictions++;
+                p.evictedBytes += allocations_[victim].bytes;
+                Release(victim);
+            }
+            id = nextId_++;
+            Allocation &a = allocations_[id];
+            a.pool = pool;
+            a.category = category;
+            a.bytes = bytes;
+            a.name = name;
+            a.evict = std::move(evict);
+            if (a.evict) {
+                a.lruPos = p.lru.insert(p.lru.end(), id);
+                p.evictableBytes += bytes;
+            }
+            p.current += bytes;
+            p.peak = std::max(p.peak, p.current);
+            Usage &u = p.categories[category];
+            u.current += bytes;
+            u.peak = std::max(u.peak, u.current);
+        }
+        // Outside the lock: a callback may free other allocations
+        for (auto &fn : evicted) fn();
+        return id;
+    }
+
+    // Ignores ids that were refused, evicted or already freed.
+    void Free(AllocationId id)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (allocations_.count(id)) Release(id);
+    }
+
+    // Marks an evictable allocation as the most recently used one.
+    void Touch(AllocationId id)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto it = allocations_.find(id);
+        if (it == allocations_.end() || !it->second.evict) return;
+        std::list<AllocationId> &lru = pools_[it->second.pool].lru;
+        lru.splice(lru.end(), lru, it->second.lruPos);
+    }
+
+    bool IsResident(AllocationId id) const
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return allocations_.count(id) != 0;
+    }
+
+    uint64_t Current(MemoryPool pool) const
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return pools_[pool].current;
+    }
+
+    uint64_t Peak(MemoryPool pool) const
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return pools_[pool].peak;
+    }
+
+    uint64_t Current(MemoryPool pool, MemoryCategory category) const
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return pools_[pool].categories[category].current;
+    }
+
+    uint64_t Peak(MemoryPool pool, MemoryCategory category) const
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return pools_[pool].categories[category].peak;
+    }
+
+    // What an allocation can still get without evicting anything;
+    // Unlimited when the pool has no budget.
+    uint64_t Headroom(MemoryPool pool) const
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        PoolState const &p = pools_[pool];
+        if (p.budget == Unlimited) return Unlimited;
+        return p.budget > p.current ? p.budget - p.current : 0;
+    }
+
+    uint64_t Evictions(MemoryPool pool) const
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return pools_[pool].evictions;
+    }
+
+    uint64_t EvictedBytes(MemoryPool pool) const
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return pools_[pool].evictedBytes;
+    }
+
+    // One line per used (pool, category): current and peak in KB, then the
+    // pool totals against the budget.
+    void Report(std::ostream &os) const
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        os << "memory: current, peak in KB" << std::endl;
+        os << std::fixed << std::setprecision(1);
+        for (uint32_t pool = 0; pool < MEMORY_POOL_COUNT; ++pool) {
+            PoolState const &p = pools_[pool];
+            if (p.peak == 0) continue;
+            for (uint32_t c = 0; c < MEMORY_CATEGORY_COUNT; ++c) {
+                Usage const &u = p.categories[c];
+                if (u.peak == 0) continue;
+                os << "   " << std::left << std::setw(7) << MemoryPoolName(MemoryPool(pool)) << std::setw(13) << MemoryCategoryName(MemoryCategory(c))
+                   << std::right << std::setw(12) << u.current / 1024.0 << std::setw(12) << u.peak / 1024.0 << std::endl;
+            }
+            os << "   " << std::left << std::setw(20) << (std::string(MemoryPoolName(MemoryPool(pool))) + " total") << std::right
+               << std::setw(12) << p.current / 1024.0 << std::setw(12) << p.peak / 1024.0;
+            if (p.budget != Unlimited) os << " of " << p.budget / 1024.0 << " budget";
+            if (p.evictions) os << ", " << p.evictions << " evictions (" << p.evictedBytes / 1024.0 << " KB)";
+            os << std::endl;
+        }
+        os << std::defaultfloat;
+    }
+
+private:
+    struct Usage {
+        uint64_t current = 0;
+        uint64_t peak = 0;
+    };
+
+    struct PoolState {
+        uint64_t budget = Unlimited;
+        uint64_t current = 0;
+        uint64_t peak = 0;
+        uint64_t evictableBytes = 0;
+        uint64_t evictions = 0;
+        uint64_t evictedBytes = 0;
+        Usage categories[MEMORY_CATEGORY_COUNT];
+        std::list<AllocationId> lru; // evictable allocations, least recently used first
+    };
+
+    struct Allocation {
+        MemoryPool pool;
+        MemoryCategory category;
+        uint64_t bytes;
+        const char *name;
+        std::function<void()> evict;
+        std::list<AllocationId>::iterator lruPos;
+    };
+
+    void Release(AllocationId id)
+    {
+        Allocation &a = allocations_[id];
+        PoolState &p = pools_[a.pool];
+        p.current -= a.bytes;
+        p.categories[a.category].current -= a.bytes;
+        if (a.evict) {
+            p.evictableBytes -= a.bytes;
+            p.lru.erase(a.lruPos);
+        }
+        allocations_.erase(id);
+    }
+
+    mutable std::mutex mutex_;
+    PoolState pools_[MEMORY_POOL_COUNT];
+    std::unordered_map<AllocationId, Allocation> allocations_;
+    AllocationId nextId_ = 1;
+};
+
+// Charge that is freed with its owner. Movable, so it can live next to the
+// buffer it accounts for.
+class MemoryCharge {
+public:
+    MemoryCharge() = default;
+    MemoryCharge(MemoryAccount &account, MemoryPool pool, MemoryCategory category, uint64_t bytes, const char *name,
+                 std::function<void()> evict = nullptr)
+        : account_(&account), id_(account.Allocate(pool, category, bytes, name, std::move(evict)))
+    {
+    }
+    ~MemoryCharge() { Reset(); }
+
+    MemoryCharge(MemoryCharge &&other) noexcept : account_(other.account_), id_(other.id_) { other.id_ = 0; }
+    MemoryCharge &operator=(MemoryCharge &&other) noexcept
+    {
+        if (this != &other) {
+            Reset();
+            account_ = other.account_;
+            id_ = other.id_;
+            other.id_ = 0;
+        }
+        return *this;
+    }
+    MemoryCharge(MemoryCharge const &) = delete;
+    MemoryCharge &operator=(MemoryCharge const &) = delete;
+
+    // False when the budget refused it (or it was evicted since)
+    bool Ok() const { return id_ && account_->IsResident(id_); }
+    MemoryAccount::AllocationId Id() const { return id_; }
+    void Touch() const
+    {
+        if (id_) account_->Touch(id_);
+    }
+
+    void Reset()
+    {
+        if (id_) account_->Free(id_);
+        id_ = 0;
+    }
+
+private:
+    MemoryAccount *account_ = nullptr;
+    MemoryAccount::AllocationId id_ = 0;
+};
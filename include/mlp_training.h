@@ -0,0 +1,221 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+#include "linalg_host.h"
+
+// Training step for a small two-layer MLP, built from the four
+// cooperative vector operations of linalg.h:
+//
+//   forward    h = relu(W1 x + b1), y = W2 h + b2           MulAdd
+//   loss       0.5 * |y - t|^2, dy = y - t
+//   backward   dW2 += dy h^T, db2 += dy                     OuterProductAccumulate, VectorAccumulate
+//              dh = (W2^T dy) * relu'(W1 x + b1)            Mul on the transposed W2
+//              dW1 += dh x^T, db1 += dh                     OuterProductAccumulate, VectorAccumulate
+//   optimizer  SGD with momentum, one element at a time, then the gradients are cleared
+//
+// Parameters, gradients and momentum share one Float32 layout (MlpShape),
+// so the optimizer is a flat loop over ParamBytes / 4 words and never needs
+// to know where a matrix starts. Rows are 16-byte aligned like row-major
+// cooperative vector matrices.
+//
+// CPU only for now: OuterProductAccumulate only accumulates into
+// MATRIX_LAYOUT_OUTER_PRODUCT_OPTIMAL, so a shader version needs the host
+// to convert the gradients to row major (ConvertLinearAlgebraMatrix)
+// before the optimizer step, and main.cpp dispatches neither.
+
+template <uint32_t In, uint32_t Hidden, uint32_t Out>
+struct MlpShape {
+    static constexpr uint32_t Inputs = In;
+    static constexpr uint32_t Hiddens = Hidden;
+    static constexpr uint32_t Outputs = Out;
+
+    static constexpr uint32_t Align16(uint32_t bytes) { return (bytes + 15) & ~15u; }
+    static constexpr uint32_t W1Stride = Align16(In * 4);
+    static constexpr uint32_t W1Offset = 0;
+    static constexpr uint32_t B1Offset = W1Offset + Hidden * W1Stride;
+    static constexpr uint32_t W2Stride = Align16(Hidden * 4);
+    static constexpr uint32_t W2Offset = B1Offset + Align16(Hidden * 4);
+    static constexpr uint32_t B2Offset = W2Offset + Out * W2Stride;
+    static constexpr uint32_t ParamBytes = B2Offset + Align16(Out * 4);
+    static constexpr uint32_t ParamWords = ParamBytes / 4;
+    static constexpr uint32_t SampleFloats = In + Out; // input, then target
+
+    static constexpr uint64_t MacsPerSample = 3ull * (uint64_t(In) * Hidden + uint64_t(Hidden) * Out);
+};
+
+struct MlpOptimizerParams {
+    float learningRate = 0.01f;
+    float momentum = 0.9f;
+};
+
+// Deterministic He-style init, biases zero.
+template <typename Shape>
+void MlpInitParams(std::vector<float> &params, uint32_t seed = 1)
+{
+    params.assign(Shape::ParamWords, 0.0f);
+    uint32_t state = seed;
+    auto next = [&] {
+        state = state * 1664525u + 1013904223u;
+        return float(state >> 8) / float(1 << 24) * 2.0f - 1.0f;
+    };
+    float scale1 = std::sqrt(2.0f / Shape::Inputs), scale2 = std::sqrt(2.0f / Shape::Hiddens);
+    for (uint32_t h = 0; h < Shape::Hiddens; ++h)
+        for (uint32_t i = 0; i < Shape::Inputs; ++i) params[(Shape::W1Offset + h * Shape::W1Stride) / 4 + i] = next() * scale1;
+    for (uint32_t o = 0; o < Shape::Outputs; ++o)
+        for (uint32_t h = 0; h < Shape::Hiddens; ++h) params[(Shape::W2Offset + o * Shape::W2Stride) / 4 + h] = next() * scale2;
+}
+
+template <typename Shape>
+struct MlpActivations {
+    std::array<float, Shape::Inputs> x;
+    std::array<float, Shape::Hiddens> hPre, h;
+    std::array<float, Shape::Outputs> y;
+};
+
+template <typename Shape>
+MlpActivations<Shape> MlpForward(void const *params, float const *input)
+{
+    using namespace linalg;
+    MatrixView<DATA_TYPE_FLOAT32, Shape::Hiddens, Shape::Inputs, MATRIX_LAYOUT_ROW_MAJOR> w1 = { params, Shape::W1Offset, Shape::W1Stride };
+    MatrixView<DATA_TYPE_FLOAT32, Shape::Outputs, Shape::Hiddens, MATRIX_LAYOUT_ROW_MAJOR> w2 = { params, Shape::W2Offset, Shape::W2Stride };
+    VectorView<DATA_TYPE_FLOAT32> b1 = { params, Shape::B1Offset };
+    VectorView<DATA_TYPE_FLOAT32> b2 = { params, Shape::B2Offset };
+
+    MlpActivations<Shape> a;
+    std::copy(input, input + Shape::Inputs, a.x.begin());
+    a.hPre = MulAdd<float>(w1, MakeInterpretedVector<DATA_TYPE_FLOAT32>(a.x), b1);
+    for (uint32_t i = 0; i < Shape::Hiddens; ++i) a.h[i] = std::max(a.hPre[i], 0.0f);
+    a.y = MulAdd<float>(w2, MakeInterpretedVector<DATA_TYPE_FLOAT32>(a.h), b2);
+    return a;
+}
+
+template <typename Shape>
+float MlpSampleLoss(void const *params, float const *sample)
+{
+    MlpActivations<Shape> a = MlpForward<Shape>(params, sample);
+    float loss = 0.0f;
+    for (uint32_t o = 0; o < Shape::Outputs; ++o) {
+        float d = a.y[o] - sample[Shape::Inputs + o];
+        loss += 0.5f * d * d;
+    }
+    return loss;
+}
+
+// Forward and backward of one sample; gradients are accumulated atomically
+// into grads, so any number of samples may run at once. Returns the loss.
+template <typename Shape>
+float MlpTrainSample(void const *params, void *grads, float const *sample)
+{
+    using namespace linalg;
+    MlpActivations<Shape> a = MlpForward<Shape>(params, sample);
+
+    std::array<float, Shape::Outputs> dy;
+    float loss = 0.0f;
+    for (uint32_t o = 0; o < Shape::Outputs; ++o) {
+        dy[o] = a.y[o] - sample[Shape::Inputs + o];
+        loss += 0.5f * dy[o] * dy[o];
+    }
+
+    RWMatrixView<DATA_TYPE_FLOAT32, Shape::Outputs, Shape::Hiddens, MATRIX_LAYOUT_ROW_MAJOR> dw2 = { grads, Shape::W2Offset, Shape::W2Stride };
+    OuterProductAccumulate(dy, a.h, dw2);
+    VectorAccumulate(dy, grads, Shape::B2Offset);
+
+    // W2^T dy: the same W2 buffer viewed transposed
+    MatrixView<DATA_TYPE_FLOAT32, Shape::Hiddens, Shape::Outputs, MATRIX_LAYOUT_ROW_MAJOR, true> w2t = { params, Shape::W2Offset, Shape::W2Stride };
+    std::array<float, Shape::Hiddens> dh = Mul<float>(w2t, MakeInterpretedVector<DATA_TYPE_FLOAT32>(dy));
+    for (uint32_t i = 0; i < Shape::Hiddens; ++i) {
+        if (a.hPre[i] <= 0.0f) dh[i] = 0.0f;
+    }
+
+    RWMatrixView<DATA_TYPE_FLOAT32, Shape::Hiddens, Shape::Inputs, MATRIX_LAYOUT_ROW_MAJOR> dw1 = { grads, Shape::W1Offset, Shape::W1Stride };
+    OuterProductAccumulate(dh, a.x, dw1);
+    VectorAccumulate(dh, grads, Shape::B1Offset);
+    return loss;
+}
+
+// One word of the optimizer update: the gradient is the batch sum, so it is
+// averaged here, then cleared for the next step.
+inline void MlpOptimizerUpdate(float *params, float *grads, float *momentum, uint32_t word, uint32_t batch, MlpOptimizerParams const &opt)
+{
+    float g = grads[word] / float(batch);
+    float v = opt.momentum * momentum[word] + g;
+    momentum[word] = v;
+    params[word] -= opt.learningRate * v;
+    grads[word] = 0.0f;
+}
+
+// CPU reference of a whole step, one sample after the other. Returns the
+// mean loss of the batch before the update.
+template <typename Shape>
+float MlpTrainStepReference(std::vector<float> &params, std::vector<float> &grads, std::vector<float> &momentum,
+                            float const *samples, uint32_t batch, MlpOptimizerParams const &opt)
+{
+    float loss = 0.0f;
+    for (uint32_t s = 0; s < batch; ++s) {
+        loss += MlpTrainSample<Shape>(params.data(), grads.data(), samples + uint64_t(s) * Shape::SampleFloats);
+    }
+    for (uint32_t w = 0; w < Shape::ParamWords; ++w) {
+        MlpOptimizerUpdate(params.data(), grads.data(), momentum.data(), w, batch, opt);
+    }
+    return loss / float(batch);
+}
+
+// Compares the accumulated gradients of a batch with central differences of
+// the summed loss. Returns the largest error relative to max(|g|, 1e-2).
+// Parameters whose +-eps probe flips a ReLU are skipped: the loss has a
+// kink there and the difference quotient means nothing. Without a flip the
+// loss is quadratic in every single parameter, so central differences are
+// exact up to rounding and eps can be large.
+template <typename Shape>
+float MlpGradientCheck(std::vector<float> const &params, float const *samples, uint32_t batch, float eps = 1e-2f)
+{
+    std::vector<float> grads(Shape::ParamWords, 0.0f);
+    for (uint32_t s = 0; s < batch; ++s) {
+        MlpTrainSample<Shape>(params.data(), grads.data(), samples + uint64_t(s) * Shape::SampleFloats);
+    }
+    // Summed loss and the ReLU pattern of every sample
+    auto probeLoss = [&](std::vector<float> const &p, std::vector<bool> &active) {
+        double loss = 0.0;
+        active.clear();
+        for (uint32_t s = 0; s < batch; ++s) {
+            float const *sample = samples + uint64_t(s) * Shape::SampleFloats;
+            MlpActivations<Shape> a = MlpForward<Shape>(p.data(), sample);
+            for (uint32_t o = 0; o < Shape::Outputs; ++o) {
+                double d = double(a.y[o]) - sample[Shape::Inputs + o];
+                loss += 0.5 * d * d;
+            }
+            for (float v : a.hPre) active.push_back(v > 0.0f);
+        }
+        return loss;
+    };
+
+    std::vector<float> probe = params;
+    std::vector<bool> baseActive, plusActive, minusActive;
+    probeLoss(probe, baseActive);
+    float maxError = 0.0f;
+    auto check = [&](uint32_t word) {
+        float saved = probe[word];
+        probe[word] = saved + eps;
+        double plus = probeLoss(probe, plusActive);
+        probe[word] = saved - eps;
+        double minus = probeLoss(probe, minusActive);
+        probe[word] = saved;
+        if (plusActive != baseActive || minusActive != baseActive) return;
+        float numeric = float((plus - minus) / (2.0 * eps));
+        maxError = std::max(maxError, std::fabs(numeric - grads[word]) / std::max(std::fabs(grads[word]), 1e-2f));
+    };
+    for (uint32_t h = 0; h < Shape::Hiddens; ++h) {
+        for (uint32_t i = 0; i < Shape::Inputs; ++i) check((Shape::W1Offset + h * Shape::W1Stride) / 4 + i);
+        check(Shape::B1Offset / 4 + h);
+    }
+    for (uint32_t o = 0; o < Shape::Outputs; ++o) {
+        for (uint32_t h = 0; h < Shape::Hiddens; ++h) check((Shape::W2Offset + o * Shape::W2Stride) / 4 + h);
+        check(Shape::B2Offset / 4 + o);
+    }
+    return maxError;
+}
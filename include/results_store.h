@@ -0,0 +1,240 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "bench_util.h"
+
+// Local benchmark results store.
+//
+// One CSV file per git revision, <root>/<revision>.csv, one line per sweep
+// point with all of its raw samples:
+//
+//   backend,variant,M,K,batch,type,threads,<sample_ms> <sample_ms> ...
+//
+// Saving a run replaces the points it measured and keeps the others, so a
+// partial sweep can be stored on top of a full one.
+
+inline std::string SweepKey(SweepRecord const &r)
+{
+    std::ostringstream key;
+    key << r.backend << "," << r.variant << "," << r.M << "," << r.K << "," << r.batch << "," << r.type << "," << r.threads;
+    return key.str();
+}
+
+// `git describe --always --dirty` of the working directory, "unknown" when
+// git is not available.
+inline std::string GetGitRevision()
+{
+#if defined(_WIN32)
+    FILE *pipe = _popen("git describe --always --dirty 2>nul", "r");
+#else
+    FILE *pipe = popen("git describe --always --dirty 2>/dev/null", "r");
+#endif
+    if (!pipe) return "unknown";
+    char buffer[128] = {};
+    std::string rev;
+    if (fgets(buffer, sizeof(buffer), pipe)) rev = buffer;
+#if defined(_WIN32)
+    _pclose(pipe);
+#else
+    pclose(pipe);
+#endif
+    while (!rev.empty() && (rev.back() == '\n' || rev.back() == '\r')) rev.pop_back();
+    return rev.empty() ? "unknown" : rev;
+}
+
+class ResultsStore {
+public:
+    explicit ResultsStore(std::string root) : root_(std::move(root)) {}
+
+    std::string PathFor(std::string const &revision) const
+    {
+        return root_ + "/" + revision + ".csv";
+    }
+
+    // Returns false when the revision has no stored results. Malformed
+    // lines are reported on stderr and skipped.
+    bool Load(std::string const &revision, std::map<std::string, SweepRecord> &records) const
+    {
+        std::ifstream in(PathFor(revision));
+        if (!in) return false;
+        std::string line;
+        uint32_t lineNumber = 0;
+        while (std::getline(in, line)) {
+            lineNumber++;
+            if (line.empty() || line[0] == '#') continue;
+            std::istringstream fields(line);
+            SweepRecord r;
+            std::string M, K, batch, threads, samples;
+            std::getline(fields, r.backend, ',');
+            std::getline(fields, r.variant, ',');
+            std::getline(fields, M, ',');
+            std::getline(fields, K, ',');
+            std::getline(fields, batch, ',');
+            std::getline(fields, r.type, ',');
+            std::getline(fields, threads, ',');
+            std::getline(fields, samples);
+            std::istringstream values(samples);
+            double v;
+            while (values >> v) r.samplesMs.push_back(v);
+            if (!ParseCount(M, r.M) || !ParseCount(K, r.K) || !ParseCount(batch, r.batch) || !ParseCount(threads, r.threads) ||
+                !values.eof() || r.samplesMs.empty()) {
+                std::cerr << PathFor(revision) << ":" << lineNumber << ": skipping malformed line" << std::endl;
+                continue;
+            }
+            records[SweepKey(r)] = r;
+        }
+        return true;
+    }
+
+    // Merges the records into the revision's file. Returns false on I/O error.
+    bool Save(std::string const &revision, std::vector<SweepRecord> const &newRecords) const
+    {
+        std::map<std::string, SweepRecord> records;
+        Load(revision, records);
+        for (SweepRecord const &r : newRecords) {
+            records[SweepKey(r)] = r;
+        }
+        std::error_code ec;
+        std::filesystem::create_directories(root_, ec);
+        std::ofstream out(PathFor(revision), std::ios::trunc);
+        if (!out) return false;
+        out << "# backend,variant,M,K,batch,type,threads,samples_ms" << std::endl;
+        out.precision(9);
+        for (auto const &kv : records) {
+            out << kv.first << ",";
+            for (size_t i = 0; i < kv.second.samplesMs.size(); ++i) {
+                out << (i ? " " : "") << kv.second.samplesMs[i];
+            }
+            out << std::endl;
+        }
+        return bool(out);
+    }
+
+private:
+    static bool ParseCount(std::string const &text, uint32_t &value)
+    {
+        if (text.empty() || text.find_first_not_of("0123456789") != std::string::npos || text.size() > 9) return false;
+        value = uint32_t(std::stoul(text));
+        return true;
+    }
+
+    std::string root_;
+};
+
+//
+// Statistics
+//
+
+// One-sided Mann-Whitney U test with normal approximation and tie
+// correction. Returns the p-value for "candidate samples are larger (slower)
+// than baseline samples".
+inline double MannWhitneyPValue(std::vector<double> const &baseline, std::vector<double> const &candidate)
+{
+    size_t n1 = baseline.size(), n2 = candidate.size();
+    if (n1 == 0 || n2 == 0) return 1.0;
+
+    std::vector<std::pair<double, int>> all;
+    for (double v : baseline) all.push_back({ v, 0 });
+    for (double v : candidate) all.push_back({ v, 1 });
+    std::sort(all.begin(), all.end());
+
+    // Average ranks over ties, accumulate the tie correction term.
+    double rankSumCandidate = 0.0;
+    double tieTerm = 0.0;
+    size_t n = all.size();
+    for (size_t i = 0; i < n;) {
+        size_t j = i;
+        while (j < n && all[j].first == all[i].first) ++j;
+        double rank = 0.5 * double(i + 1 + j);
+        double t = double(j - i);
+        tieTerm += t * t * t - t;
+        for (size_t k = i; k < j; ++k) {
+            if (all[k].second == 1) rankSumCandidate += rank;
+        }
+        i = j;
+    }
+
+    double u = rankSumCandidate - double(n2) * (n2 + 1) / 2.0;
+    double mean = double(n1) * n2 / 2.0;
+    double var = double(n1) * n2 / 12.0 * ((n + 1) - tieTerm / (double(n) * (n - 1)));
+    if (var <= 0.0) return u > mean ? 0.0 : 1.0;
+    double z = (u - mean - 0.5) / std::sqrt(var); // continuity correction
+    return 0.5 * std::erfc(z / std::sqrt(2.0));
+}
+
+struct RatioInterval {
+    double ratio; // median(candidate) / median(baseline)
+    double low;
+    double high;
+};
+
+// Percentile bootstrap confidence interval of the ratio of medians.
+// Deterministic (fixed seed) so the same stored data gives the same verdict.
+inline RatioInterval BootstrapMedianRatio(std::vector<double> const &baseline, std::vector<double> const &candidate,
+                                          double confidence = 0.95, uint32_t resamples = 2000)
+{
+    RatioInterval ci = { 1.0, 1.0, 1.0 };
+    if (baseline.empty() || candidate.empty()) return ci;
+    double mb = Median(baseline);
+    ci.ratio = mb > 0.0 ? Median(candidate) / mb : 1.0;
+
+    std::mt19937 rng(12345);
+    std::vector<double> ratios, b(baseline.size()), c(candidate.size());
+    std::uniform_int_distribution<size_t> pickB(0, baseline.size() - 1), pickC(0, candidate.size() - 1);
+    for (uint32_t i = 0; i < resamples; ++i) {
+        for (double &v : b) v = baseline[pickB(rng)];
+        for (double &v : c) v = candidate[pickC(rng)];
+        double med = Median(b);
+        if (med > 0.0) ratios.push_back(Median(c) / med);
+    }
+    if (ratios.empty()) return ci;
+    std::sort(ratios.begin(), ratios.end());
+    double tail = (1.0 - confidence) / 2.0;
+    ci.low = ratios[size_t(tail * (ratios.size() - 1))];
+    ci.high = ratios[size_t((1.0 - tail) * (ratios.size() - 1))];
+    return ci;
+}
+
+struct Comparison {
+    std::string key;
+    double baselineMs;
+    double candidateMs;
+    RatioInterval ci;
+    double pValue;
+    bool regression;
+};
+
+// Compares every point present in both runs. A point regresses when the
+// slowdown is significant (p < alpha and the whole confidence interval of
+// the median ratio lies above 1) and larger than minSlowdown (0.05 = 5%).
+inline std::vector<Comparison> CompareResults(std::map<std::string, SweepRecord> const &baseline,
+                                              std::map<std::string, SweepRecord> const &candidate,
+                                              double alpha, double minSlowdown)
+{
+    std::vector<Comparison> out;
+    for (auto const &kv : candidate) {
+        auto base = baseline.find(kv.first);
+        if (base == baseline.end()) continue;
+        Comparison c;
+        c.key = kv.first;
+        c.baselineMs = Median(base->second.samplesMs);
+        c.candidateMs = Median(kv.second.samplesMs);
+        c.ci = BootstrapMedianRatio(base->second.samplesMs, kv.second.samplesMs);
+        c.pValue = MannWhitneyPValue(base->second.samplesMs, kv.second.samplesMs);
+        c.regression = c.pValue < alpha && c.ci.low > 1.0 && c.ci.ratio > 1.0 + minSlowdown;
+        out.push_back(c);
+    }
+    return out;
+}
@@ -0,0 +1,101 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+// Scale-out GEMV: the output rows are cut into one contiguous slice per
+// worker (a device, or a queue of a device), every worker multiplies its
+// slice against the whole input vector and the slices are gathered into
+// the output. Slices are sized by measured throughput, so a fast dGPU next
+// to an iGPU gets most of the rows, and re-sized after every run.
+
+struct RowSlice {
+    uint32_t begin;
+    uint32_t end;
+
+    uint32_t Rows() const { return end - begin; }
+};
+
+// Cuts [0, M) into weights.size() slices proportional to the weights, with
+// every boundary a multiple of granularity (except M itself). Slices may
+// be empty when a weight is small against M / granularity.
+inline std::vector<RowSlice> SplitRows(uint32_t M, std::vector<double> const &weights, uint32_t granularity = 1)
+{
+    std::vector<RowSlice> slices(weights.size(), RowSlice{ 0, 0 });
+    if (weights.empty()) return slices;
+    double total = 0.0;
+    for (double w : weights) total += std::max(w, 0.0);
+
+    double cumulative = 0.0;
+    uint32_t begin = 0;
+    for (size_t i = 0; i < weights.size(); ++i) {
+        cumulative += std::max(weights[i], 0.0);
+        uint32_t end = M;
+        if (i + 1 < weights.size()) {
+            double ideal = total > 0.0 ? M * (cumulative / total) : double(M) * (i + 1) / weights.size();
+            end = uint32_t(std::llround(ideal / granularity)) * granularity;
+            end = std::min(std::max(end, begin), M);
+        }
+        slices[i] = { begin, end };
+        begin = end;
+    }
+    return slices;
+}
+
+// Throughput model of the workers: rows per ms, smoothed over runs. Until
+// a worker has been measured it counts as fast as the average of the
+// measured ones (or 1 when none is), so the first run splits evenly.
+class RowSplitBalancer {
+public:
+    explicit RowSplitBalancer(uint32_t workers, double smoothing = 0.5) : rowsPerMs_(workers, 0.0), smoothing_(smoothing) {}
+
+    uint32_t NumWorkers() const { return uint32_t(rowsPerMs_.size()); }
+
+    std::vector<double> Weights() const
+    {
+        double sum = 0.0;
+        uint32_t measured = 0;
+        for (double r : rowsPerMs_) {
+            if (r > 0.0) {
+                sum += r;
+                measured++;
+            }
+        }
+        double fallback = measured ? sum / measured : 1.0;
+        std::vector<double> weights(rowsPerMs_.size());
+        for (size_t i = 0; i < weights.size(); ++i) weights[i] = rowsPerMs_[i] > 0.0 ? rowsPerMs_[i] : fallback;
+        return weights;
+    }
+
+    std::vector<RowSlice> Split(uint32_t M, uint32_t granularity = 1) const { return SplitRows(M, Weights(), granularity); }
+
+    // Feeds back one run of a worker. Empty slices and unmeasurably short
+    // runs leave the estimate alone.
+    void Record(uint32_t worker, uint32_t rows, double ms)
+    {
+        if (rows == 0 || !(ms > 0.0)) return;
+        double rate = rows / ms;
+        double &r = rowsPerMs_[worker];
+        r = r > 0.0 ? smoothing_ * rate + (1.0 - smoothing_) * r : rate;
+    }
+
+    // Slowest worker over the mean of the busy ones: 1 is a perfect split.
+    static double Imbalance(std::vector<double> const &ms)
+    {
+        double sum = 0.0, slowest = 0.0;
+        uint32_t busy = 0;
+        for (double t : ms) {
+            if (t <= 0.0) continue;
+            sum += t;
+            slowest = std::max(slowest, t);
+            busy++;
+        }
+        return busy ? slowest / (sum / busy) : 1.0;
+    }
+
+private:
+    std::vector<double> rowsPerMs_;
+    double smoothing_;
+};
@@ -0,0 +1,151 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+#include "util.h"
+
+// 2:4 structured-sparse matrix storage.
+//
+// Every row is cut into groups of 4 consecutive K elements, and each group
+// keeps at most 2 values. A row therefore stores K/2 compressed values plus
+// one 2-bit column index per kept value (4 bits per group, 8 groups per
+// uint32 metadata word, lowest group in the lowest bits):
+//
+//   metadata nibble of group g = idx0 | (idx1 << 2),  idx0 < idx1 < 4
+//   values[2g + 0] = dense[4g + idx0]
+//   values[2g + 1] = dense[4g + idx1]
+//
+// Matrix bytes drop to about half of the dense matrix plus one bit of
+// metadata per dense element, and the multiplies drop to half. Value rows
+// are packed at their natural stride (rounded to 4 bytes for raw buffer
+// loads); only the buffer total is padded, so the savings hold for short
+// rows too. SparseVectorMulAdd.hlsl reads the same layout.
+struct Sparse24Matrix {
+    DataType dataType;
+    uint32_t M, K;          // dense shape; the last group of a row is zero padded
+    uint32_t valueStride;   // bytes between two rows of values
+    uint32_t metaStride;    // bytes between two rows of metadata
+    std::vector<uint8_t> values;
+    std::vector<uint8_t> metadata;
+    uint64_t prunedNonZeros; // nonzeros dropped by PackSparse24
+
+    uint64_t SizeInBytes() const { return values.size() + metadata.size(); }
+};
+
+inline uint32_t Sparse24Groups(uint32_t K)
+{
+    return (K + 3) / 4;
+}
+
+inline uint32_t Sparse24ValueStride(DataType dt, uint32_t K)
+{
+    return (SizeofType(dt) * Sparse24Groups(K) * 2 + 3) & ~3u;
+}
+
+// Size of the value buffer PackSparse24 makes, known before packing
+inline uint64_t Sparse24ValueBytes(DataType dt, uint32_t M, uint32_t K, uint32_t bufferAlignBytes)
+{
+    return (uint64_t(Sparse24ValueStride(dt, K)) * M + bufferAlignBytes - 1) & ~uint64_t(bufferAlignBytes - 1);
+}
+
+// Packs a dense row-major matrix into 2:4 form. Groups with more than two
+// nonzeros are pruned by magnitude (the two largest survive), so an already
+// 2:4-pruned matrix packs losslessly and prunedNonZeros stays 0. The value
+// buffer is padded to a multiple of bufferAlignBytes.
+inline Sparse24Matrix PackSparse24(DataType dt, void const *dense, uint32_t M, uint32_t K, uint32_t strideK, uint32_t bufferAlignBytes)
+{
+    Sparse24Matrix sp = {};
+    sp.dataType = dt;
+    sp.M = M;
+    sp.K = K;
+    uint32_t groups = Sparse24Groups(K);
+    sp.valueStride = Sparse24ValueStride(dt, K);
+    sp.metaStride = (groups + 7) / 8 * 4;
+    sp.values.assign(Sparse24ValueBytes(dt, M, K, bufferAlignBytes), 0);
+    sp.metadata.assign(uint64_t(sp.metaStride) * M, 0);
+
+    for (uint32_t m = 0; m < M; ++m) {
+        uint32_t *meta = (uint32_t *)&sp.metadata[uint64_t(m) * sp.metaStride];
+        for (uint32_t g = 0; g < groups; ++g) {
+            float v[4];
+            uint32_t nonZeros = 0;
+            for (uint32_t i = 0; i < 4; ++i) {
+                uint32_t k = g * 4 + i;
+                v[i] = k < K ? GetDataFloat(dense, dt, m * strideK, k) : 0.0f;
+                nonZeros += v[i] != 0.0f;
+            }
+            // Two largest magnitudes, earliest index on ties.
+            uint32_t a = 0, b = 1;
+            if (std::fabs(v[b]) > std::fabs(v[a])) std::swap(a, b);
+            for (uint32_t i = 2; i < 4; ++i) {
+                if (std::fabs(v[i]) > std::fabs(v[a])) { b = a; a = i; }
+                else if (std::fabs(v[i]) > std::fabs(v[b])) { b = i; }
+            }
+            uint32_t idx0 = std::min(a, b), idx1 = std::max(a, b);
+            if (nonZeros > 2) sp.prunedNonZeros += nonZeros - 2;
+
+            SetDataFloat(sp.values.data(), dt, m * sp.valueStride, g * 2 + 0, v[idx0]);
+            SetDataFloat(sp.values.data(), dt, m * sp.valueStride, g * 2 + 1, v[idx1]);
+            meta[g / 8] |= (idx0 | (idx1 << 2)) << ((g % 8) * 4);
+        }
+    }
+    return sp;
+}
+
+// Expands back to a dense row-major matrix (zeros where pruned). Used to
+// build the dense golden for the sparse path.
+inline void UnpackSparse24(Sparse24Matrix const &sp, void *dense, uint32_t strideK)
+{
+    for (uint32_t m = 0; m < sp.M; ++m) {
+        uint32_t const *meta = (uint32_t const *)&sp.metadata[uint64_t(m) * sp.metaStride];
+        for (uint32_t k = 0; k < sp.K; ++k) {
+            SetDataFloat(dense, sp.dataType, m * strideK, k, 0.0f);
+        }
+        for (uint32_t g = 0; g < Sparse24Groups(sp.K); ++g) {
+            uint32_t nibble = (meta[g / 8] >> ((g % 8) * 4)) & 0xF;
+            for (uint32_t j = 0; j < 2; ++j) {
+                uint32_t k = g * 4 + ((nibble >> (j * 2)) & 3);
+                if (k < sp.K) {
+                    SetDataFloat(dense, sp.dataType, m * strideK, k, GetDataFloat(sp.values.data(), sp.dataType, m * sp.valueStride, g * 2 + j));
+                }
+            }
+        }
+    }
+}
+
+// Dot product of one sparse row with the input vector: two multiplies per
+// group of four columns.
+inline float SparseRowDot(Sparse24Matrix const &matrix, uint32_t m, void const *inputVec)
+{
+    uint32_t const *meta = (uint32_t const *)&matrix.metadata[uint64_t(m) * matrix.metaStride];
+    float sum = 0.0f;
+    for (uint32_t g = 0; g < Sparse24Groups(matrix.K); ++g) {
+        uint32_t nibble = (meta[g / 8] >> ((g % 8) * 4)) & 0xF;
+        uint32_t k0 = g * 4 + (nibble & 3);
+        uint32_t k1 = g * 4 + (nibble >> 2);
+        float b0 = GetDataFloat(matrix.values.data(), matrix.dataType, m * matrix.valueStride, g * 2 + 0);
+        float b1 = GetDataFloat(matrix.values.data(), matrix.dataType, m * matrix.valueStride, g * 2 + 1);
+        if (k0 < matrix.K) sum += GetDataFloat(inputVec, matrix.dataType, 0, k0) * b0;
+        if (k1 < matrix.K) sum += GetDataFloat(inputVec, matrix.dataType, 0, k1) * b1;
+    }
+    return sum;
+}
+
+// Sparse CPU GEMV: output = sparse(matrix) * input + bias.
+inline void SparseMatMulAdd(
+    DataType dataType,
+    void *outputVec,
+    Sparse24Matrix const &matrix,
+    void const *inputVec,
+    void const *biasVec
+)
+{
+    for (uint32_t m = 0; m < matrix.M; ++m) {
+        float sum = SparseRowDot(matrix, m, inputVec);
+        sum += GetDataFloat(biasVec, dataType, 0, m);
+        SetDataFloat(outputVec, dataType, 0, m, sum);
+    }
+}
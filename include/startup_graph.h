@@ -0,0 +1,142 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <vector>
+
+#include "thread_pool.h"
+#include "trace.h"
+
+// Startup as a task graph: every stage names the stages it needs, and Run
+// hands a stage to the ThreadPool as soon as the last of them finishes, so
+// independent work (shader file, root signature blob, host data) overlaps
+// with the device calls instead of queueing behind them.
+//
+//   StartupGraph graph;
+//   auto device = graph.Add("create device", {}, [&] { ... });
+//   auto shader = graph.Add("read shader", {}, [&] { ... });
+//   graph.Add("create PSO", { device, shader }, [&] { ... });
+//   graph.Run(pool);
+//   graph.Report(std::cout);
+//
+// Stages may block (file IO, driver calls); they only hold one executor.
+// Stage names must be string literals, they also name the trace spans.
+
+class StartupGraph {
+public:
+    using StageId = uint32_t;
+
+    StageId Add(const char *name, std::initializer_list<StageId> deps, std::function<void()> fn)
+    {
+        StageId id = StageId(stages_.size());
+        Stage stage;
+        stage.name = name;
+        stage.fn = std::move(fn);
+        for (StageId dep : deps) {
+            stage.deps.push_back(dep);
+            stages_[dep].dependents.push_back(id);
+        }
+        stages_.push_back(std::move(stage));
+        return id;
+    }
+
+    // Runs every stage once and returns when all are done. Dependencies
+    // must be added before their dependents, so the graph has no cycles.
+    void Run(ThreadPool &pool)
+    {
+        TRACE_SCOPE("startup graph");
+        start_ = std::chrono::steady_clock::now();
+        std::vector<std::atomic<uint32_t>> waiting(stages_.size());
+        std::atomic<uint32_t> remaining(uint32_t(stages_.size()));
+
+        std::function<void(StageId)> launch = [&](StageId id) {
+            pool.Submit([&, id] {
+                Stage &stage = stages_[id];
+                stage.beginMs = ElapsedMs();
+                {
+                    TraceScope span(stage.name);
+                    stage.fn();
+                }
+                stage.endMs = ElapsedMs();
+                for (StageId next : stage.dependents) {
+                    if (waiting[next].fetch_sub(1, std::memory_order_acq_rel) == 1) launch(next);
+                }
+                remaining.fetch_sub(1, std::memory_order_release);
+            });
+        };
+        for (StageId id = 0; id < stages_.size(); ++id) waiting[id].store(uint32_t(stages_[id].deps.size()));
+        for (StageId id = 0; id < stages_.size(); ++id) {
+            if (stages_[id].deps.empty()) launch(id);
+        }
+        pool.WaitUntil([&] { return remaining.load(std::memory_order_acquire) == 0; });
+        wallMs_ = ElapsedMs();
+    }
+
+    double WallMs() const { return wallMs_; }
+
+    // Sum of all stage times: what a serial startup would have taken.
+    double SerialMs() const
+    {
+        double sum = 0.0;
+        for (Stage const &stage : stages_) sum += stage.endMs - stage.beginMs;
+        return sum;
+    }
+
+    // End of a stage in ms from the start of Run.
+    double StageEndMs(StageId id) const { return stages_[id].endMs; }
+
+    // One line per stage in start order; '*' marks the critical path, the
+    // chain of last-finishing dependencies that bounded the wall time.
+    void Report(std::ostream &os) const
+    {
+        std::vector<bool> critical(stages_.size(), false);
+        if (!stages_.empty()) {
+            StageId id = StageId(std::max_element(stages_.begin(), stages_.end(),
+                [](Stage const &a, Stage const &b) { return a.endMs < b.endMs; }) - stages_.begin());
+            for (;;) {
+                critical[id] = true;
+                Stage const &stage = stages_[id];
+                if (stage.deps.empty()) break;
+                id = *std::max_element(stage.deps.begin(), stage.deps.end(),
+                    [&](StageId a, StageId b) { return stages_[a].endMs < stages_[b].endMs; });
+            }
+        }
+
+        std::vector<StageId> order(stages_.size());
+        for (StageId id = 0; id < order.size(); ++id) order[id] = id;
+        std::stable_sort(order.begin(), order.end(), [&](StageId a, StageId b) { return stages_[a].beginMs < stages_[b].beginMs; });
+
+        os << "startup stages: begin, end, duration in ms; * = critical path" << std::endl;
+        os << std::fixed << std::setprecision(3);
+        for (StageId id : order) {
+            Stage const &stage = stages_[id];
+            os << (critical[id] ? " * " : "   ") << std::left << std::setw(28) << stage.name << std::right
+               << std::setw(10) << stage.beginMs << std::setw(10) << stage.endMs << std::setw(10) << stage.endMs - stage.beginMs << std::endl;
+        }
+        os << "startup wall " << wallMs_ << " ms, serial sum " << SerialMs() << " ms" << std::defaultfloat << std::endl;
+    }
+
+private:
+    struct Stage {
+        const char *name;
+        std::function<void()> fn;
+        std::vector<StageId> deps;
+        std::vector<StageId> dependents;
+        double beginMs = 0.0;
+        double endMs = 0.0;
+    };
+
+    double ElapsedMs() const
+    {
+        return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start_).count();
+    }
+
+    std::vector<Stage> stages_;
+    std::chrono::steady_clock::time_point start_;
+    double wallMs_ = 0.0;
+};
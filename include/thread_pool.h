@@ -0,0 +1,239 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#if defined(_WIN32)
+#include <windows.h>
+#else
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+#include "trace.h"
+
+// Work-stealing thread pool used by the CPU backend.
+//
+// Every executor owns a deque: it pushes and pops its own work at the back
+// (LIFO, cache friendly) and steals from the front of the other deques
+// (FIFO, takes the oldest and usually largest block). Executor 0 is the
+// thread that calls ParallelFor/WaitUntil, so a pool of N threads spawns N-1
+// background workers and a pool of 1 runs everything inline. With
+// pinThreads the background workers are bound to cores 1..N-1; the calling
+// thread is left alone.
+class ThreadPool {
+public:
+    explicit ThreadPool(uint32_t numThreads = 0, bool pinThreads = false)
+        : pinThreads_(pinThreads)
+    {
+        if (numThreads == 0) {
+            numThreads = std::max(1u, std::thread::hardware_concurrency());
+        }
+        for (uint32_t i = 0; i < numThreads; ++i) {
+            queues_.emplace_back(new Queue());
+        }
+        for (uint32_t i = 1; i < numThreads; ++i) {
+            threads_.emplace_back([this, i] { WorkerLoop(i); });
+        }
+    }
+
+    ~ThreadPool()
+    {
+        {
+            std::lock_guard<std::mutex> lock(sleepMutex_);
+            stop_ = true;
+        }
+        wake_.notify_all();
+        for (std::thread &t : threads_) {
+            t.join();
+        }
+    }
+
+    ThreadPool(ThreadPool const &) = delete;
+    ThreadPool &operator=(ThreadPool const &) = delete;
+
+    uint32_t NumThreads() const { return uint32_t(queues_.size()); }
+
+    // Queues a task. From inside a worker it goes to that worker's deque,
+    // from outside it goes round-robin.
+    void Submit(std::function<void()> task)
+    {
+        uint32_t index = CurrentIndex();
+        if (index == NO_INDEX) {
+            index = nextQueue_.fetch_add(1, std::memory_order_relaxed) % NumThreads();
+        }
+        Push(index, std::move(task));
+    }
+
+    // Runs fn(begin, end) over [0, count) in chunks of chunkSize and returns
+    // when all chunks are done. Chunks are dealt out in contiguous blocks,
+    // one block per executor, and idle executors steal from the others.
+    // chunkSize == 0 picks about 8 chunks per executor.
+    template <typename Fn>
+    void ParallelFor(uint64_t count, uint64_t chunkSize, Fn &&fn)
+    {
+        if (count == 0) return;
+        if (chunkSize == 0) {
+            chunkSize = std::max<uint64_t>(1, count / (uint64_t(NumThreads()) * 8));
+        }
+        uint64_t numChunks = (count + chunkSize - 1) / chunkSize;
+        if (numChunks == 1 || NumThreads() == 1) {
+            fn(uint64_t(0), count);
+            return;
+        }
+
+        std::atomic<uint64_t> remaining(numChunks);
+        uint32_t n = NumThreads();
+        for (uint32_t q = 0; q < n; ++q) {
+            uint64_t first = numChunks * q / n;
+            uint64_t last = numChunks * (q + 1) / n;
+            for (uint64_t c = first; c < last; ++c) {
+                uint64_t begin = c * chunkSize;
+                uint64_t end = std::min(begin + chunkSize, count);
+                Push(q, [&fn, &remaining, begin, end] {
+                    fn(begin, end);
+                    remaining.fetch_sub(1, std::memory_order_release);
+                });
+            }
+        }
+        WaitUntil([&] { return remaining.load(std::memory_order_acquire) == 0; });
+    }
+
+    // Helps executing queued work until done() returns true.
+    template <typename Pred>
+    void WaitUntil(Pred &&done)
+    {
+        uint32_t index = CurrentIndex();
+        if (index == NO_INDEX) index = 0;
+        while (!done()) {
+            if (!RunOne(index)) {
+                std::this_thread::yield();
+            }
+        }
+    }
+
+    uint64_t StealCount() const { return steals_.load(std::memory_order_relaxed); }
+
+private:
+    static constexpr uint32_t NO_INDEX = ~0u;
+
+    struct Queue {
+        std::mutex mutex;
+        std::deque<std::function<void()>> tasks;
+    };
+
+    struct ThreadSlot {
+        ThreadPool const *pool;
+        uint32_t index;
+    };
+    static ThreadSlot &CurrentSlot()
+    {
+        static thread_local ThreadSlot slot = { nullptr, NO_INDEX };
+        return slot;
+    }
+    uint32_t CurrentIndex() const
+    {
+        ThreadSlot &slot = CurrentSlot();
+        return slot.pool == this ? slot.index : NO_INDEX;
+    }
+
+    void Push(uint32_t index, std::function<void()> task)
+    {
+        {
+            std::lock_guard<std::mutex> lock(queues_[index]->mutex);
+            queues_[index]->tasks.push_back(std::move(task));
+        }
+        {
+            std::lock_guard<std::mutex> lock(sleepMutex_);
+            pending_++;
+        }
+        wake_.notify_one();
+    }
+
+    bool PopLocal(uint32_t index, std::function<void()> &task)
+    {
+        Queue &q = *queues_[index];
+        std::lock_guard<std::mutex> lock(q.mutex);
+        if (q.tasks.empty()) return false;
+        task = std::move(q.tasks.back());
+        q.tasks.pop_back();
+        return true;
+    }
+
+    bool Steal(uint32_t thief, std::function<void()> &task)
+    {
+        uint32_t n = NumThreads();
+        for (uint32_t i = 1; i < n; ++i) {
+            Queue &q = *queues_[(thief + i) % n];
+            std::lock_guard<std::mutex> lock(q.mutex);
+            if (q.tasks.empty()) continue;
+            task = std::move(q.tasks.front());
+            q.tasks.pop_front();
+            steals_.fetch_add(1, std::memory_order_relaxed);
+            return true;
+        }
+        return false;
+    }
+
+    bool RunOne(uint32_t index)
+    {
+        std::function<void()> task;
+        if (!PopLocal(index, task) && !Steal(index, task)) {
+            return false;
+        }
+        {
+            std::lock_guard<std::mutex> lock(sleepMutex_);
+            pending_--;
+        }
+        task();
+        return true;
+    }
+
+    void WorkerLoop(uint32_t index)
+    {
+        CurrentSlot() = { this, index };
+        Trace::SetThreadName("pool worker " + std::to_string(index));
+        if (pinThreads_) {
+            PinCurrentThread(index);
+        }
+        for (;;) {
+            if (RunOne(index)) continue;
+            std::unique_lock<std::mutex> lock(sleepMutex_);
+            wake_.wait(lock, [this] { return stop_ || pending_ > 0; });
+            if (stop_) return;
+        }
+    }
+
+    static void PinCurrentThread(uint32_t index)
+    {
+        uint32_t cores = std::max(1u, std::thread::hardware_concurrency());
+#if defined(_WIN32)
+        SetThreadAffinityMask(GetCurrentThread(), DWORD_PTR(1) << (index % cores));
+#else
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        CPU_SET(index % cores, &set);
+        pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+#endif
+    }
+
+    bool pinThreads_;
+    std::vector<std::unique_ptr<Queue>> queues_;
+    std::vector<std::thread> threads_;
+    std::atomic<uint32_t> nextQueue_{0};
+    std::atomic<uint64_t> steals_{0};
+
+    std::mutex sleepMutex_;
+    std::condition_variable wake_;
+    uint64_t pending_ = 0;
+    bool stop_ = false;
+};
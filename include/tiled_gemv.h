@@ -0,0 +1,78 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+// Out-of-core GEMV: the matrix stays in system memory (the upload heap on
+// D3D12) and is streamed through a fixed-size device window of row tiles.
+//
+// The window has two slots. While tile t is multiplied out of one slot, tile
+// t + 1 is copied into the other; tile t + 2 reuses the first slot once
+// tile t is done with it. Input, bias and output stay resident at full size
+// and every tile writes its own output slice, so no tile sees another.
+//
+// Two monotonic fences order the copy and compute queues:
+//
+//   copy t     waits computeFence >= t - 1 (tile t - 2 left the slot), signals copyFence = t + 1
+//   compute t  waits copyFence >= t + 1,                                signals computeFence = t + 1
+
+struct RowTilePlan {
+    static constexpr uint32_t MaxSlots = 2;
+
+    uint32_t M;            // rows of the whole matrix
+    uint32_t strideK;      // bytes per matrix row
+    uint32_t rowsPerTile;
+    uint32_t numTiles;     // 0 when the budget does not hold one row per slot
+
+    uint32_t NumSlots() const { return std::min(numTiles, MaxSlots); }
+    uint64_t SlotBytes() const { return uint64_t(rowsPerTile) * strideK; }
+    uint64_t WindowBytes() const { return SlotBytes() * NumSlots(); }
+    uint32_t Slot(uint32_t tile) const { return tile % MaxSlots; }
+    uint32_t RowBegin(uint32_t tile) const { return tile * rowsPerTile; }
+    uint32_t RowEnd(uint32_t tile) const { return std::min(M, RowBegin(tile) + rowsPerTile); }
+};
+
+// Picks the largest tile whose two-slot window fits in budgetBytes next to
+// the always-resident buffers (residentBytes). A matrix that fits whole
+// runs as one tile in a single slot.
+inline RowTilePlan PlanRowTiles(uint32_t M, uint32_t strideK, uint64_t residentBytes, uint64_t budgetBytes)
+{
+    RowTilePlan plan = { M, strideK, 0, 0 };
+    if (M == 0 || budgetBytes <= residentBytes) return plan;
+    uint64_t available = budgetBytes - residentBytes;
+    if (uint64_t(M) * strideK <= available) {
+        plan.rowsPerTile = M;
+    } else {
+        plan.rowsPerTile = uint32_t(std::min<uint64_t>(available / (uint64_t(strideK) * RowTilePlan::MaxSlots), M));
+    }
+    if (plan.rowsPerTile == 0) return plan;
+    plan.numTiles = (M + plan.rowsPerTile - 1) / plan.rowsPerTile;
+    return plan;
+}
+
+struct RowTileStep {
+    enum Kind { TILE_COPY, TILE_COMPUTE };
+    Kind kind;
+    uint32_t tile;
+    uint64_t waitValue;   // on the other queue's fence, 0 = no wait
+    uint64_t signalValue; // on this queue's fence
+};
+
+// Steps in submission order: copy 0, then (copy t + 1, compute t) for every
+// tile, so a step never waits on a fence value whose signal has not been
+// submitted yet.
+inline std::vector<RowTileStep> BuildRowTileSchedule(RowTilePlan const &plan)
+{
+    std::vector<RowTileStep> steps;
+    auto copy = [&](uint32_t t) {
+        steps.push_back({ RowTileStep::TILE_COPY, t, t >= RowTilePlan::MaxSlots ? uint64_t(t - RowTilePlan::MaxSlots + 1) : 0, uint64_t(t) + 1 });
+    };
+    if (plan.numTiles == 0) return steps;
+    copy(0);
+    for (uint32_t t = 0; t < plan.numTiles; ++t) {
+        if (t + 1 < plan.numTiles) copy(t + 1);
+        steps.push_back({ RowTileStep::TILE_COMPUTE, t, uint64_t(t) + 1, uint64_t(t) + 1 });
+    }
+    return steps;
+}
@@ -0,0 +1,300 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// Span recorder with a Chrome trace_event exporter (chrome://tracing,
+// ui.perfetto.dev).
+//
+//   TRACE_SCOPE("create device");                 span until the end of the scope
+//   TRACE_SCOPE_ARG("dispatch", "groups", n);     same, with one integer argument
+//   TraceScope span("upload"); ...; span.End();   span that ends before its scope
+//
+// Every thread records into its own ring of TraceRing::Capacity spans; a
+// push is a plain store and one release store of the head, no lock and no
+// allocation after the first span of the thread. A full ring overwrites its
+// oldest spans and the export reports how many were lost. With tracing
+// disabled a scope costs one relaxed load and a branch; defining
+// TRACE_DISABLED compiles the macros out.
+//
+// GPU work goes on tracks of its own (Trace::GpuTrack) with timestamps
+// already converted to the TraceNowNs clock, so host and device spans line
+// up on one timeline.
+//
+// Names and argument names are not copied: pass string literals. Export
+// only once the recording threads are quiet (TraceSession does it last).
+
+inline uint64_t TraceNowNs()
+{
+    return uint64_t(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count());
+}
+
+struct TraceEvent {
+    const char *name;
+    uint64_t beginNs;
+    uint64_t durNs;
+    const char *argName; // nullptr: no argument
+    int64_t argValue;
+};
+
+// Single-producer ring: only the owning thread (or, for a GPU track, the
+// thread that resolves the timestamps) pushes.
+class TraceRing {
+public:
+    static constexpr uint32_t Capacity = 1u << 14;
+
+    TraceRing(uint32_t tid, std::string name, bool gpu) : tid_(tid), name_(std::move(name)), gpu_(gpu), events_(new TraceEvent[Capacity]) {}
+
+    void Push(TraceEvent const &e)
+    {
+        uint64_t head = head_.load(std::memory_order_relaxed);
+        events_[head & (Capacity - 1)] = e;
+        head_.store(head + 1, std::memory_order_release);
+    }
+
+    uint32_t Tid() const { return tid_; }
+    bool IsGpu() const { return gpu_; }
+    std::string const &Name() const { return name_; }
+    void SetName(std::string name) { name_ = std::move(name); }
+
+    uint64_t Recorded() const { return head_.load(std::memory_order_acquire); }
+    uint64_t Dropped() const { return Recorded() > Capacity ? Recorded() - Capacity : 0; }
+
+    // Oldest first
+    template <typename Fn>
+    void ForEach(Fn &&fn) const
+    {
+        uint64_t head = Recorded();
+        for (uint64_t i = head > Capacity ? head - Capacity : 0; i < head; ++i) fn(events_[i & (Capacity - 1)]);
+    }
+
+private:
+    uint32_t tid_;
+    std::string name_;
+    bool gpu_;
+    std::unique_ptr<TraceEvent[]> events_;
+    std::atomic<uint64_t> head_{0};
+};
+
+class Trace {
+public:
+    static bool Enabled() { return enabled_.load(std::memory_order_relaxed); }
+    static void Enable(bool enabled = true) { enabled_.store(enabled, std::memory_order_relaxed); }
+
+    // Names the calling thread's track. Cheap and safe to call with
+    // tracing disabled; the name is picked up when the ring is created.
+    static void SetThreadName(std::string name)
+    {
+        Local().name = name;
+        if (Local().ring) {
+            std::lock_guard<std::mutex> lock(Instance().mutex_);
+            Local().ring->SetName(std::move(name));
+        }
+    }
+
+    static void Record(const char *name, uint64_t beginNs, uint64_t endNs, const char *argName = nullptr, int64_t argValue = 0)
+    {
+        ThreadRing().Push({ name, beginNs, endNs - beginNs, argName, argValue });
+    }
+
+    // A separate timeline for device spans, e.g. one per queue.
+    static TraceRing *GpuTrack(std::string name)
+    {
+        return Instance().AddRing(std::move(name), true);
+    }
+
+    static void AddGpuSpan(TraceRing *track, const char *name, uint64_t beginNs, uint64_t endNs, const char *argName = nullptr, int64_t argValue = 0)
+    {
+        if (!Enabled() || !track) return;
+        track->Push({ name, beginNs, endNs > beginNs ? endNs - beginNs : 0, argName, argValue });
+    }
+
+    // Chrome "JSON object format": complete ("X") events plus thread_name
+    // metadata, timestamps in microseconds from the first span. Returns
+    // false when the file cannot be written.
+    static bool WriteChromeJson(std::string const &path)
+    {
+        Trace &t = Instance();
+        std::lock_guard<std::mutex> lock(t.mutex_);
+        std::ofstream os(path);
+        if (!os) return false;
+
+        uint64_t origin = ~0ull, dropped = 0;
+        for (auto &ring : t.rings_) {
+            ring->ForEach([&](TraceEvent const &e) { origin = std::min(origin, e.beginNs); });
+            dropped += ring->Dropped();
+        }
+        if (origin == ~0ull) origin = 0;
+
+        os << "{\"displayTimeUnit\":\"ms\",\"otherData\":{\"droppedEvents\":" << dropped << "},\"traceEvents\":[";
+        bool first = true;
+        auto separator = [&] {
+            if (!first) os << ",";
+            first = false;
+            os << "\n";
+        };
+        for (auto &ring : t.rings_) {
+            separator();
+            os << "{\"ph\":\"M\",\"name\":\"thread_name\",\"pid\":1,\"tid\":" << ring->Tid() << ",\"args\":{\"name\":";
+            WriteString(os, ring->Name());
+            os << "}}";
+            ring->ForEach([&](TraceEvent const &e) {
+                separator();
+                os << "{\"ph\":\"X\",\"cat\":\"" << (ring->IsGpu() ? "gpu" : "cpu") << "\",\"name\":";
+                WriteString(os, e.name);
+                os << ",\"pid\":1,\"tid\":" << ring->Tid() << ",\"ts\":" << Microseconds(e.beginNs - origin) << ",\"dur\":" << Microseconds(e.durNs);
+                if (e.argName) {
+                    os << ",\"args\":{";
+                    WriteString(os, e.argName);
+                    os << ":" << e.argValue << "}";
+                }
+                os << "}";
+            });
+        }
+        os << "\n]}\n";
+        return bool(os);
+    }
+
+    static uint64_t DroppedEvents()
+    {
+        Trace &t = Instance();
+        std::lock_guard<std::mutex> lock(t.mutex_);
+        uint64_t dropped = 0;
+        for (auto &ring : t.rings_) dropped += ring->Dropped();
+        return dropped;
+    }
+
+private:
+    struct ThreadLocal {
+        TraceRing *ring = nullptr;
+        std::string name;
+    };
+
+    static Trace &Instance()
+    {
+        static Trace trace;
+        return trace;
+    }
+
+    static ThreadLocal &Local()
+    {
+        static thread_local ThreadLocal local;
+        return local;
+    }
+
+    static TraceRing &ThreadRing()
+    {
+        ThreadLocal &local = Local();
+        if (!local.ring) local.ring = Instance().AddRing(local.name, false);
+        return *local.ring;
+    }
+
+    // Rings live as long as the process, so spans of threads that have
+    // already exited are still exported.
+    TraceRing *AddRing(std::string name, bool gpu)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        uint32_t tid = uint32_t(rings_.size()) + 1;
+        if (name.empty()) name = "thread " + std::to_string(tid);
+        rings_.emplace_back(new TraceRing(tid, std::move(name), gpu));
+        return rings_.back().get();
+    }
+
+    static std::string Microseconds(uint64_t ns)
+    {
+        std::string s = std::to_string(ns / 1000) + "." + std::to_string(ns % 1000 + 1000);
+        s.erase(s.size() - 4, 1); // the leading 1 of the zero-padded fraction
+        return s;
+    }
+
+    static void WriteString(std::ostream &os, std::string const &s)
+    {
+        os << '"';
+        for (char c : s) {
+            if (c == '"' || c == '\\') os << '\\';
+            if (uint8_t(c) >= 0x20) os << c;
+        }
+        os << '"';
+    }
+
+    // Not part of Instance(): no static-init guard on the disabled path
+    static inline std::atomic<bool> enabled_{false};
+    std::mutex mutex_;
+    std::vector<std::unique_ptr<TraceRing>> rings_;
+};
+
+class TraceScope {
+public:
+    explicit TraceScope(const char *name, const char *argName = nullptr, int64_t argValue = 0)
+    {
+        if (!Trace::Enabled()) return;
+        name_ = name;
+        argName_ = argName;
+        argValue_ = argValue;
+        beginNs_ = TraceNowNs();
+    }
+    ~TraceScope() { End(); }
+
+    TraceScope(TraceScope const &) = delete;
+    TraceScope &operator=(TraceScope const &) = delete;
+
+    void End()
+    {
+        if (!name_) return;
+        Trace::Record(name_, beginNs_, TraceNowNs(), argName_, argValue_);
+        name_ = nullptr;
+    }
+
+private:
+    const char *name_ = nullptr;
+    const char *argName_ = nullptr;
+    int64_t argValue_ = 0;
+    uint64_t beginNs_ = 0;
+};
+
+// Enables tracing for its lifetime when path is non-empty and writes the
+// file when it goes out of scope. Declare it before the ThreadPool so the
+// pool has joined by the time the rings are read.
+class TraceSession {
+public:
+    explicit TraceSession(std::string path) : path_(std::move(path))
+    {
+        if (path_.empty()) return;
+        Trace::SetThreadName("main");
+        Trace::Enable();
+    }
+    ~TraceSession()
+    {
+        if (path_.empty()) return;
+        Trace::Enable(false);
+        if (!Trace::WriteChromeJson(path_)) return;
+        uint64_t dropped = Trace::DroppedEvents();
+        std::cout << "Trace written to " << path_;
+        if (dropped) std::cout << " (" << dropped << " oldest spans dropped)";
+        std::cout << std::endl;
+    }
+
+    TraceSession(TraceSession const &) = delete;
+    TraceSession &operator=(TraceSession const &) = delete;
+
+private:
+    std::string path_;
+};
+
+#if defined(TRACE_DISABLED)
+#define TRACE_SCOPE(name) ((void)0)
+#define TRACE_SCOPE_ARG(name, argName, value) ((void)0)
+#else
+#define TRACE_CONCAT_IMPL(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_IMPL(a, b)
+#define TRACE_SCOPE(name) TraceScope TRACE_CONCAT(traceScope_, __LINE__)(name)
+#define TRACE_SCOPE_ARG(name, argName, value) TraceScope TRACE_CONCAT(traceScope_, __LINE__)(name, argName, int64_t(value))
+#endif
@@ -0,0 +1,115 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+#if defined(_WIN32)
+#include <windows.h>
+#include <psapi.h>
+#else
+#include <sys/resource.h>
+#endif
+
+#include "thread_pool.h"
+#include "util.h"
+
+// Zero-copy initialization.
+//
+// Instead of building the matrix in a host std::vector, copying it into the
+// upload buffer and keeping the vector alive for verification, producers
+// write straight into the mapped upload allocation and the golden result is
+// accumulated on the way. The only host copies left are O(M + K): the input
+// and bias vectors and the golden output.
+//
+// Upload heaps are write-combined, so the verifier never reads the mapping
+// back: each row is produced into a small cached scratch row, consumed from
+// there (golden accumulation) and written to the mapping with one
+// sequential copy.
+
+// Peak resident set of the process in bytes, 0 when unknown.
+inline uint64_t PeakHostMemoryBytes()
+{
+#if defined(_WIN32)
+    PROCESS_MEMORY_COUNTERS pmc = {};
+    if (!GetProcessMemoryInfo(GetCurrentProcess(), &pmc, sizeof(pmc))) return 0;
+    return pmc.PeakWorkingSetSize;
+#else
+    struct rusage usage = {};
+    if (getrusage(RUSAGE_SELF, &usage) != 0) return 0;
+#if defined(__APPLE__)
+    return uint64_t(usage.ru_maxrss);
+#else
+    return uint64_t(usage.ru_maxrss) * 1024;
+#endif
+#endif
+}
+
+// Streams `rows` rows of rowBytes into dst, rows `stride` bytes apart.
+// produce(m, row) fills the scratch row, consume(m, row) reads it back while
+// it is still in cache, then the row is copied to dst.
+template <typename Produce, typename Consume>
+void StreamRows(void *dst, uint32_t rows, uint32_t rowBytes, uint32_t stride, Produce &&produce, Consume &&consume)
+{
+    std::vector<uint8_t> scratch(rowBytes);
+    for (uint32_t m = 0; m < rows; ++m) {
+        memset(scratch.data(), 0, rowBytes);
+        produce(m, scratch.data());
+        consume(m, scratch.data());
+        memcpy((uint8_t *)dst + uint64_t(m) * stride, scratch.data(), rowBytes);
+    }
+}
+
+// StreamRows on the pool: blocks of rows are produced, consumed and copied
+// on different executors, each with its own scratch row. consume must be
+// safe to call for different rows at once (GemvGoldenStream::Row is).
+template <typename Produce, typename Consume>
+void ParallelStreamRows(ThreadPool &pool, void *dst, uint32_t rows, uint32_t rowBytes, uint32_t stride, Produce &&produce, Consume &&consume)
+{
+    pool.ParallelFor(rows, 0, [&](uint64_t begin, uint64_t end) {
+        std::vector<uint8_t> scratch(rowBytes);
+        for (uint32_t m = uint32_t(begin); m < end; ++m) {
+            memset(scratch.data(), 0, rowBytes);
+            produce(m, scratch.data());
+            consume(m, scratch.data());
+            memcpy((uint8_t *)dst + uint64_t(m) * stride, scratch.data(), rowBytes);
+        }
+    });
+}
+
+// Golden of MatMulAdd built one matrix row at a time, so the matrix never
+// needs a host copy. Same conversions and accumulation order as MatMulAdd.
+class GemvGoldenStream {
+public:
+    GemvGoldenStream(DataType dataType, void const *inputVec, uint32_t sizeM, uint32_t sizeK)
+        : dataType_(dataType), input_(sizeK), sums_(sizeM, 0.0f)
+    {
+        for (uint32_t k = 0; k < sizeK; ++k) input_[k] = GetDataFloat(inputVec, dataType, 0, k);
+    }
+
+    // Rows are independent: different rows may be added concurrently.
+    void Row(uint32_t m, void const *row)
+    {
+        float sum = 0.0f;
+        for (uint32_t k = 0; k < input_.size(); ++k) {
+            sum += input_[k] * GetDataFloat(row, dataType_, 0, k);
+        }
+        sums_[m] = sum;
+    }
+
+    // Adds the bias, applies the epilogue and stores outputType, like
+    // MatMulAdd<Epi>.
+    template <typename Epi = NoEpilogue>
+    void Finish(void *outputVec, DataType outputType, void const *biasVec, EpilogueParams const &params = EpilogueParams()) const
+    {
+        for (uint32_t m = 0; m < sums_.size(); ++m) {
+            float sum = sums_[m] + GetDataFloat(biasVec, dataType_, 0, m);
+            SetDataFloat(outputVec, outputType, 0, m, Epi::Apply(sum, m, params));
+        }
+    }
+
+private:
+    DataType dataType_;
+    std::vector<float> input_;
+    std::vector<float> sums_;
+};
@@ -1,7 +1,15 @@
 #pragma once
 
 #include <iostream>
+#include <algorithm>
 #include <cassert>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <vector>
+
+#include "epilogue.h"
 
 enum DataType {
     DATA_TYPE_SINT16 = 2,           // ComponentType::I16
@@ -20,30 +28,8 @@ enum DataType {
                                     // (1 sign, 5 exp, 2 mantissa bits)
 };
 
-static void GetFloatExpManBits(DataType dt, uint32_t &expBits, uint32_t &manBits, uint32_t &byteSize)
-{
-    switch (dt) {
-    case DATA_TYPE_FLOAT16:
-        expBits = 5;
-        manBits = 10;
-        byteSize = 2;
-        break;
-    case DATA_TYPE_FLOAT8_E4M3:
-        expBits = 4;
-        manBits = 3;
-        byteSize = 1;
-        break;
-    case DATA_TYPE_FLOAT8_E5M2:
-        expBits = 5;
-        manBits = 2;
-        byteSize = 1;
-        break;
-    default:
-        assert(0);
-        break;
-    }
-}
-
+// Bytes per element. The packed 8-bit types hold four elements per 32-bit
+// word, so an element is one byte of the word.
 uint32_t SizeofType(DataType dt)
 {
     switch (dt)
@@ -52,10 +38,101 @@ uint32_t SizeofType(DataType dt)
     case DATA_TYPE_FLOAT16: return 2;
     case DATA_TYPE_FLOAT8_E4M3: return 1;
     case DATA_TYPE_FLOAT8_E5M2: return 1;
+    case DATA_TYPE_SINT32: return 4;
+    case DATA_TYPE_UINT32: return 4;
+    case DATA_TYPE_SINT16: return 2;
+    case DATA_TYPE_UINT16: return 2;
+    case DATA_TYPE_SINT8: return 1;
+    case DATA_TYPE_UINT8: return 1;
+    case DATA_TYPE_SINT8_T4_PACKED: return 1;
+    case DATA_TYPE_UINT8_T4_PACKED: return 1;
     default:
         assert(0);
-        break;
+        return 0;
+    }
+}
+
+inline bool IsIntegerType(DataType dt)
+{
+    return dt != DATA_TYPE_FLOAT32 && dt != DATA_TYPE_FLOAT16 && dt != DATA_TYPE_FLOAT8_E4M3 && dt != DATA_TYPE_FLOAT8_E5M2;
+}
+
+// Float to integer element: round to nearest even, saturate to the range.
+template <typename T>
+inline T FloatToInt(float value)
+{
+    double v = std::nearbyint(double(value));
+    v = std::min(std::max(v, double(std::numeric_limits<T>::min())), double(std::numeric_limits<T>::max()));
+    return T(v);
+}
+
+// Float32 <-> small float bit conversion shared by SetDataFloat/GetDataFloat
+// and the typed host views (linalg_host.h), so both round identically.
+template <uint32_t expBits, uint32_t manBits>
+inline uint32_t FloatToSmallFloatBits(float value)
+{
+    constexpr uint32_t signBit = manBits + expBits;
+    constexpr int32_t minExp = 2 - (1 << (expBits - 1)); // of the smallest normal
+
+    uint32_t intVal;
+    memcpy(&intVal, &value, sizeof(intVal));
+    uint32_t sign = intVal & 0x80000000;
+    // Below the smallest normal: subnormal, mantissa in units of
+    // 2^(minExp - manBits), RTNE. A carry into 1 << manBits is the smallest
+    // normal, which is the same bit pattern.
+    if (int32_t((intVal >> 23) & 0xFF) - 127 < minExp) {
+        uint32_t subnormal = uint32_t(std::nearbyint(std::ldexp(std::fabs(double(value)), int(manBits) - minExp)));
+        return subnormal ? (sign >> (31 - signBit)) | subnormal : 0;
+    }
+    int32_t exp = intVal & 0x7F800000;
+    uint32_t mantissa = intVal & 0x007FFFFF;
+    exp >>= 23;
+    exp -= (1<<(8-1)) - 1;
+    exp += (1<<(expBits-1)) - 1;
+    exp &= (1<<expBits) - 1;
+    // RTNE:
+    if (mantissa & (1<<(23 - manBits))) {
+        mantissa++;
     }
+    mantissa += (1<<(22 - manBits)) - 1;
+    if (mantissa & (1<<23)) {
+        exp++;
+        mantissa = 0;
+    }
+    mantissa >>= 23 - manBits;
+    sign >>= 31;
+    sign <<= signBit;
+    exp <<= manBits;
+    uint32_t result = sign | exp | mantissa;
+    assert(result < (1ULL << (signBit + 1)));
+    return value == 0 ? 0 : result;
+}
+
+template <uint32_t expBits, uint32_t manBits>
+inline float SmallFloatBitsToFloat(uint32_t intVal)
+{
+    constexpr uint32_t signBit = manBits + expBits;
+    constexpr uint32_t signMask = 1 << signBit;
+    constexpr uint32_t expMask = ((1 << expBits) - 1) << manBits;
+    constexpr int32_t minExp = 2 - (1 << (expBits - 1));
+
+    uint32_t sign = intVal & signMask;
+    uint32_t mantissa = intVal & ((1 << manBits) - 1);
+    int32_t exp = (intVal & expMask) >> manBits;
+    if (exp == 0) {
+        float subnormal = float(std::ldexp(double(mantissa), minExp - int(manBits)));
+        return sign ? -subnormal : subnormal;
+    }
+    exp -= (1<<(expBits-1)) - 1;
+    exp += (1<<(8-1)) - 1;
+    exp &= 0xFF;
+    exp <<= 23;
+    mantissa <<= 23 - manBits;
+    sign <<= 31 - signBit;
+    uint32_t result = sign | exp | mantissa;
+    float ret;
+    memcpy(&ret, &result, sizeof(ret));
+    return (intVal == 0 || intVal == signMask) ? 0.0f : ret;
 }
 
 void SetDataFloat(void *ptr, DataType dataType, uint32_t offset, uint32_t index, float value)
@@ -68,42 +145,33 @@ void SetDataFloat(void *ptr, DataType dataType, uint32_t offset, uint32_t index,
         ((float *)p)[index] = value;
         break;
     case DATA_TYPE_FLOAT16:
+        ((uint16_t *)p)[index] = uint16_t(FloatToSmallFloatBits<5, 10>(value));
+        break;
     case DATA_TYPE_FLOAT8_E4M3:
+        p[index] = uint8_t(FloatToSmallFloatBits<4, 3>(value));
+        break;
     case DATA_TYPE_FLOAT8_E5M2:
-        {
-            uint32_t expBits, manBits, byteSize;
-            GetFloatExpManBits(dataType, expBits, manBits, byteSize);
-            uint32_t signBit = manBits + expBits;
-
-		    uint32_t intVal = *(uint32_t *)&value;
-            uint32_t sign = intVal & 0x80000000;
-            int32_t exp = intVal & 0x7F800000;
-            uint32_t mantissa = intVal & 0x007FFFFF;
-            exp >>= 23;
-            exp -= (1<<(8-1)) - 1;
-            exp += (1<<(expBits-1)) - 1;
-            exp &= (1<<expBits) - 1;
-            // RTNE:
-            if (mantissa & (1<<(23 - manBits))) {
-                mantissa++;
-            }
-            mantissa += (1<<(22 - manBits)) - 1;
-            if (mantissa & (1<<23)) {
-                exp++;
-                mantissa = 0;
-            }
-            mantissa >>= 23 - manBits;
-            sign >>= 31;
-            sign <<= signBit;
-            exp <<= manBits;
-            uint32_t result = sign | exp | mantissa;
-            assert(result < (1ULL << (byteSize*8)));
-            if (value == 0) {
-                memset(&((uint8_t *)p)[index*byteSize], 0, byteSize);
-            } else {
-                memcpy(&((uint8_t *)p)[index*byteSize], &result, byteSize);
-            }
-        }
+        p[index] = uint8_t(FloatToSmallFloatBits<5, 2>(value));
+        break;
+    case DATA_TYPE_SINT32:
+        ((int32_t *)p)[index] = FloatToInt<int32_t>(value);
+        break;
+    case DATA_TYPE_UINT32:
+        ((uint32_t *)p)[index] = FloatToInt<uint32_t>(value);
+        break;
+    case DATA_TYPE_SINT16:
+        ((int16_t *)p)[index] = FloatToInt<int16_t>(value);
+        break;
+    case DATA_TYPE_UINT16:
+        ((uint16_t *)p)[index] = FloatToInt<uint16_t>(value);
+        break;
+    case DATA_TYPE_SINT8:
+    case DATA_TYPE_SINT8_T4_PACKED:
+        ((int8_t *)p)[index] = FloatToInt<int8_t>(value);
+        break;
+    case DATA_TYPE_UINT8:
+    case DATA_TYPE_UINT8_T4_PACKED:
+        p[index] = FloatToInt<uint8_t>(value);
         break;
     default:
         assert(0);
@@ -113,44 +181,105 @@ void SetDataFloat(void *ptr, DataType dataType, uint32_t offset, uint32_t index,
 
 float GetDataFloat(void const *ptr, DataType dataType, uint32_t offset, uint32_t index)
 {
-    uint8_t *p = (uint8_t *)ptr;
+    uint8_t const *p = (uint8_t const *)ptr;
     p += offset;
 
     switch (dataType) {
     case DATA_TYPE_FLOAT32:
-        return ((float *)p)[index];
+        return ((float const *)p)[index];
     case DATA_TYPE_FLOAT16:
+        return SmallFloatBitsToFloat<5, 10>(((uint16_t const *)p)[index]);
     case DATA_TYPE_FLOAT8_E4M3:
+        return SmallFloatBitsToFloat<4, 3>(p[index]);
     case DATA_TYPE_FLOAT8_E5M2:
-        {
-            uint32_t expBits, manBits, byteSize;
-            GetFloatExpManBits(dataType, expBits, manBits, byteSize);
-		    uint32_t intVal = 0;
-            memcpy(&intVal, &((uint8_t *)p)[index*byteSize], byteSize);
-
-            uint32_t signBit = manBits + expBits;
-            uint32_t signMask = 1 << signBit;
-            uint32_t expMask = ((1 << expBits) - 1) << manBits;
-
-            uint32_t sign = intVal & signMask;
-            uint32_t mantissa = intVal & ((1 << manBits) - 1);
-            int32_t exp = (intVal & expMask) >> manBits;
-            exp -= (1<<(expBits-1)) - 1;
-            exp += (1<<(8-1)) - 1;
-            exp &= 0xFF;
-            exp <<= 23;
-            mantissa <<= 23 - manBits;
-            sign <<= 31 - signBit;
-            uint32_t result = sign | exp | mantissa;
-            float ret = (intVal == 0 || intVal == signMask) ? 0.0f : *(float *)&result;
-            return ret;
-        }
+        return SmallFloatBitsToFloat<5, 2>(p[index]);
+    case DATA_TYPE_SINT32:
+        return float(((int32_t const *)p)[index]);
+    case DATA_TYPE_UINT32:
+        return float(((uint32_t const *)p)[index]);
+    case DATA_TYPE_SINT16:
+        return float(((int16_t const *)p)[index]);
+    case DATA_TYPE_UINT16:
+        return float(((uint16_t const *)p)[index]);
+    case DATA_TYPE_SINT8:
+    case DATA_TYPE_SINT8_T4_PACKED:
+        return float(((int8_t const *)p)[index]);
+    case DATA_TYPE_UINT8:
+    case DATA_TYPE_UINT8_T4_PACKED:
+        return float(p[index]);
     default:
         assert(0);
         return 0.f;
 	}
 }
 
+// Per-operand types of a MatMulAdd, the host side of the interpretation
+// arguments of __builtin_MatVecMulAdd (CoopVectorMulAdd.hlsl). input is how
+// the input vector is stored, inputInterpretation what the multiply sees:
+// an F16 input interpreted as F8_E4M3 is rounded to E4M3 first. Every
+// buffer is sized by its own type, so each operand can use the smallest
+// storage that holds it.
+struct MatMulAddTypes {
+    DataType input;
+    DataType inputInterpretation;
+    DataType matrix;
+    DataType bias;
+    DataType output;
+
+    static MatMulAddTypes Uniform(DataType dt) { return { dt, dt, dt, dt, dt }; }
+};
+
+// The input vector as the multiply sees it, converted once for all rows.
+inline void LoadInterpretedInput(MatMulAddTypes const &types, void const *inputVec, uint32_t sizeK, float *input)
+{
+    for (uint32_t k = 0; k < sizeK; ++k) {
+        float v = GetDataFloat(inputVec, types.input, 0, k);
+        if (types.inputInterpretation != types.input) {
+            uint32_t interpreted = 0;
+            SetDataFloat(&interpreted, types.inputInterpretation, 0, 0, v);
+            v = GetDataFloat(&interpreted, types.inputInterpretation, 0, 0);
+        }
+        input[k] = v;
+    }
+}
+
+// Row m of matrix * input + bias on an interpreted input. Float operands
+// accumulate in float in k order, integer ones in 64-bit integers (exact
+// until the float result passes 2^24).
+inline float MatMulAddRow(MatMulAddTypes const &types, float const *input, void const *matrix, uint32_t rowOffset,
+                          void const *biasVec, uint32_t m, uint32_t sizeK)
+{
+    if (IsIntegerType(types.inputInterpretation) && IsIntegerType(types.matrix)) {
+        int64_t sum = 0;
+        for (uint32_t k = 0; k < sizeK; ++k) {
+            sum += int64_t(input[k]) * int64_t(GetDataFloat(matrix, types.matrix, rowOffset, k));
+        }
+        return float(sum + int64_t(GetDataFloat(biasVec, types.bias, 0, m)));
+    }
+    float sum = 0.0f;
+    for (uint32_t k = 0; k < sizeK; ++k) {
+        sum += input[k] * GetDataFloat(matrix, types.matrix, rowOffset, k);
+    }
+    return sum + GetDataFloat(biasVec, types.bias, 0, m);
+}
+
+void MatMulAdd(
+    MatMulAddTypes const &types,
+    void *outputVec,
+    void const *matrix,
+    void const *inputVec,
+    void const *biasVec,
+    uint32_t sizeM, uint32_t sizeK,
+    uint32_t strideK
+)
+{
+    std::vector<float> input(sizeK);
+    LoadInterpretedInput(types, inputVec, sizeK, input.data());
+    for (uint32_t m = 0; m < sizeM; ++m) {
+        SetDataFloat(outputVec, types.output, 0, m, MatMulAddRow(types, input.data(), matrix, m * strideK, biasVec, m, sizeK));
+    }
+}
+
 void MatMulAdd(
     DataType dataType,
     void *outputVec,
@@ -160,6 +289,25 @@ void MatMulAdd(
     uint32_t sizeM, uint32_t sizeK,
     uint32_t strideK
 )
+{
+    MatMulAdd(MatMulAddTypes::Uniform(dataType), outputVec, matrix, inputVec, biasVec, sizeM, sizeK, strideK);
+}
+
+// MatMulAdd with a fused epilogue: Epi is applied to every (matrix * input
+// + bias) element before it is converted to outputType and stored, so no
+// second pass over the output is needed.
+template <typename Epi>
+void MatMulAdd(
+    DataType dataType,
+    DataType outputType,
+    void *outputVec,
+    void const *matrix,
+    void const *inputVec,
+    void const *biasVec,
+    uint32_t sizeM, uint32_t sizeK,
+    uint32_t strideK,
+    EpilogueParams const &params = EpilogueParams()
+)
 {
     for (uint32_t m = 0; m < sizeM; ++m) {
         float sum = 0.0f;
@@ -170,6 +318,6 @@ void MatMulAdd(
         }
         float bias = GetDataFloat(biasVec, dataType, 0, m);
         sum += bias;
-        SetDataFloat(outputVec, dataType, 0, m, sum);
+        SetDataFloat(outputVec, outputType, 0, m, Epi::Apply(sum, m, params));
     }
 }
@@ -0,0 +1,426 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "memory_budget.h"
+
+// Weight residency cache: device copies of weight tensors keyed by a hash
+// of their content, so a tensor that is already resident (the same layer
+// loaded twice, a model reloaded by the next job) is shared instead of
+// uploaded again, and a tensor updated in place uploads only the rows that
+// changed.
+//
+//   WeightResidencyCache<CpuWeightBackend> cache(backend, memory);
+//   auto w = cache.Acquire("layer0", data, bytes, rowBytes);   upload or hit
+//   ... fine-tune rows 10..20 of data ...
+//   cache.MarkDirty(w, 10, 20);
+//   cache.Sync(w, data);                                       copies those rows only
+//   cache.Release(w);                                          stays cached, evictable
+//
+// The backend makes and fills device buffers:
+//   using Buffer = ...;
+//   Buffer Create(uint64_t bytes);
+//   void Upload(Buffer &, uint64_t offset, void const *src, uint64_t bytes);
+// CpuWeightBackend is the CPU one; on D3D12, Upload is a write into an
+// upload heap and a CopyBufferRegion.
+//
+// Entries are charged to MEMORY_POOL_DEVICE / MEMORY_WEIGHTS of a
+// MemoryAccount: pinned while a handle holds them, evictable (least
+// recently released first) once the last handle is gone. A Sync of a
+// shared entry detaches the handle first (copy on write), so the other
+// holders keep the old content; when the budget has no room for the
+// private copy the Sync is refused and nothing changes. The key is (hash, size); a 64-bit hash
+// collision between live tensors is not guarded against. Not thread safe.
+//
+// The content hash of a tensor is the hash of the hashes of its row
+// blocks: whole rows, about 4 KB (TensorHashBlockBytes). A Sync rehashes
+// only the blocks its dirty rows touch, at most one block past either end
+// of a range, plus one pass over the block hashes (8 bytes per block), so
+// it costs about the size of the update rather than of the tensor. Stats
+// count the bytes hashed and the time spent on it.
+
+// XXH64 (Yann Collet's xxHash, 64-bit): four independent lanes over 32-byte
+// stripes, so hashing runs near memory bandwidth.
+inline uint64_t ContentHash64(void const *data, uint64_t bytes, uint64_t seed = 0)
+{
+    const uint64_t P1 = 11400714785074694791ull, P2 = 14029467366897019727ull, P3 = 1609587929392839161ull;
+    const uint64_t P4 = 9650029242287828579ull, P5 = 2870177450012600261ull;
+    auto Rotl = [](uint64_t x, int r) { return (x << r) | (x >> (64 - r)); };
+    auto Read64 = [](uint8_t const *p) { uint64_t v; memcpy(&v, p, 8); return v; };
+    auto Read32 = [](uint8_t const *p) { uint32_t v; memcpy(&v, p, 4); return uint64_t(v); };
+    auto Round = [&](uint64_t acc, uint64_t input) { return Rotl(acc + input * P2, 31) * P1; };
+    auto Merge = [&](uint64_t acc, uint64_t lane) { return (acc ^ Round(0, lane)) * P1 + P4; };
+
+    uint8_t const *p = static_cast<uint8_t const *>(data);
+    uint8_t const *end = p + bytes;
+    uint64_t h;
+    if (bytes >= 32) {
+        uint64_t v1 = seed + P1 + P2, v2 = seed + P2, v3 = seed, v4 = seed - P1;
+        for (; p + 32 <= end; p += 32) {
+            v1 = Round(v1, Read64(p));
+            v2 = Round(v2, Read64(p + 8));
+            v3 = Round(v3, Read64(p + 16));
+            v4 = Round(v4, Read64(p + 24));
+        }
+        h = Rotl(v1, 1) + Rotl(v2, 7) + Rotl(v3, 12) + Rotl(v4, 18);
+        h = Merge(h, v1);
+        h = Merge(h, v2);
+        h = Merge(h, v3);
+        h = Merge(h, v4);
+    } else {
+        h = seed + P5;
+    }
+    h += bytes;
+    for (; p + 8 <= end; p += 8) h = Rotl(h ^ Round(0, Read64(p)), 27) * P1 + P4;
+    if (p + 4 <= end) {
+        h = Rotl(h ^ (Read32(p) * P1), 23) * P2 + P3;
+        p += 4;
+    }
+    for (; p < end; ++p) h = Rotl(h ^ (*p * P5), 11) * P1;
+    h ^= h >> 33;
+    h *= P2;
+    h ^= h >> 29;
+    h *= P3;
+    h ^= h >> 32;
+    return h;
+}
+
+static constexpr uint64_t TENSOR_HASH_BLOCK_BYTES = 4 * 1024;
+
+// Bytes of a hash block: whole rows, about TENSOR_HASH_BLOCK_BYTES
+inline uint64_t TensorHashBlockBytes(uint32_t rowBytes)
+{
+    uint64_t row = std::max(rowBytes, 1u);
+    return std::max<uint64_t>(1, TENSOR_HASH_BLOCK_BYTES / row) * row;
+}
+
+inline uint64_t TensorHashBlockCount(uint64_t bytes, uint64_t blockBytes)
+{
+    return (bytes + blockBytes - 1) / blockBytes;
+}
+
+// Rehashes the blocks of data that overlap bytes [begin, end); blocks must
+// have one slot per block. Returns the bytes hashed.
+inline uint64_t TensorBlockHashes(void const *data, uint64_t bytes, uint64_t blockBytes, uint64_t begin, uint64_t end,
+                                  std::vector<uint64_t> &blocks)
+{
+    uint8_t const *src = static_cast<uint8_t const *>(data);
+    uint64_t hashed = 0;
+    for (uint64_t b = begin / blockBytes; b * blockBytes < std::min(end, bytes); ++b) {
+        uint64_t offset = b * blockBytes, length = std::min(blockBytes, bytes - offset);
+        blocks[b] = ContentHash64(src + offset, length, b);
+        hashed += length;
+    }
+    return hashed;
+}
+
+inline uint64_t TensorContentHash(std::vector<uint64_t> const &blocks)
+{
+    return ContentHash64(blocks.data(), blocks.size() * sizeof(uint64_t));
+}
+
+inline uint64_t TensorContentHash(void const *data, uint64_t bytes, uint32_t rowBytes)
+{
+    uint64_t blockBytes = TensorHashBlockBytes(rowBytes);
+    std::vector<uint64_t> blocks(TensorHashBlockCount(bytes, blockBytes));
+    TensorBlockHashes(data, bytes, blockBytes, 0, bytes, blocks);
+    return TensorContentHash(blocks);
+}
+
+// Sorted, disjoint row ranges [begin, end). Ranges closer than mergeGap
+// rows are joined: copying a few clean rows is cheaper than another copy.
+class DirtyRows {
+public:
+    explicit DirtyRows(uint32_t mergeGap = 0) : mergeGap_(mergeGap) {}
+
+    void Add(uint32_t begin, uint32_t end)
+    {
+        if (begin >= end) return;
+        std::vector<std::pair<uint32_t, uint32_t>> merged;
+        bool placed = false;
+        for (auto const &r : ranges_) {
+            if (r.second + mergeGap_ < begin) {
+                merged.push_back(r);
+            } else if (end + mergeGap_ < r.first) {
+                if (!placed) merged.push_back({ begin, end });
+                placed = true;
+                merged.push_back(r);
+            } else {
+                begin = std::min(begin, r.first);
+                end = std::max(end, r.second);
+            }
+        }
+        if (!placed) merged.push_back({ begin, end });
+        ranges_.swap(merged);
+    }
+
+    void Clear() { ranges_.clear(); }
+    bool Empty() const { return ranges_.empty(); }
+    std::vector<std::pair<uint32_t, uint32_t>> const &Ranges() const { return ranges_; }
+
+    uint64_t Rows() const
+    {
+        uint64_t rows = 0;
+        for (auto const &r : ranges_) rows += r.second - r.first;
+        return rows;
+    }
+
+private:
+    uint32_t mergeGap_;
+    std::vector<std::pair<uint32_t, uint32_t>> ranges_;
+};
+
+// Device buffers of the CPU backend: plain host memory, Upload a memcpy.
+struct CpuWeightBackend {
+    using Buffer = std::vector<uint8_t>;
+
+    Buffer Create(uint64_t bytes) { return Buffer(bytes); }
+    void Upload(Buffer &buffer, uint64_t offset, void const *src, uint64_t bytes) { memcpy(buffer.data() + offset, src, bytes); }
+};
+
+template <typename Backend>
+class WeightResidencyCache {
+public:
+    using Buffer = typename Backend::Buffer;
+    using Handle = uint64_t; // 0 = refused by the memory budget
+
+    struct Stats {
+        uint64_t uploadedBytes = 0;
+        uint64_t skippedBytes = 0; // resident already: content hits and clean rows
+        uint64_t uploads = 0;      // Upload calls
+        uint64_t hits = 0;
+        uint64_t misses = 0;
+        uint64_t syncs = 0;
+        uint64_t detaches = 0;
+        uint64_t evictions = 0;
+        uint64_t hashedBytes = 0; // tensor bytes and block hashes
+        double hashMs = 0.0;
+    };
+
+    WeightResidencyCache(Backend &backend, MemoryAccount &memory, uint32_t mergeGapRows = 0)
+        : backend_(backend), memory_(memory), mergeGap_(mergeGapRows)
+    {
+    }
+
+    // Uploads data unless the same content is resident; rowBytes is the
+    // granularity of MarkDirty.
+    Handle Acquire(const char *name, void const *data, uint64_t bytes, uint32_t rowBytes)
+    {
+        const uint64_t blockBytes = TensorHashBlockBytes(rowBytes);
+        std::vector<uint64_t> blocks(TensorHashBlockCount(bytes, blockBytes));
+        uint64_t hash = Hashing([&] {
+            stats_.hashedBytes += TensorBlockHashes(data, bytes, blockBytes, 0, bytes, blocks);
+            return CombineBlocks(blocks);
+        });
+        auto found = byContent_.find(Key{ hash, bytes });
+        uint64_t entryId;
+        if (found != byContent_.end()) {
+            entryId = found->second;
+            Pin(entries_.at(entryId));
+            stats_.hits++;
+            stats_.skippedBytes += bytes;
+        } else {
+            entryId = Create(name, Key{ hash, bytes }, std::move(blocks), data, rowBytes);
+            if (!entryId) return 0;
+            stats_.misses++;
+        }
+        Handle handle = nextHandle_++;
+        handles_.emplace(handle, Binding{ entryId, DirtyRows(mergeGap_) });
+        return handle;
+    }
+
+    // The entry stays resident for the next Acquire of the same content
+    // until the budget needs the room.
+    void Release(Handle handle)
+    {
+        auto it = handles_.find(handle);
+        if (it == handles_.end()) return;
+        Unpin(it->second.entry);
+        handles_.erase(it);
+    }
+
+    // Rows [rowBegin, rowEnd) of the host tensor changed since the last
+    // Acquire or Sync.
+    void MarkDirty(Handle handle, uint32_t rowBegin, uint32_t rowEnd) { handles_.at(handle).dirty.Add(rowBegin, rowEnd); }
+
+    // Brings the device copy up to date with data: the dirty rows only,
+    // or all of it when the entry is shared and has to be detached. False
+    // when the budget refuses the private copy of a shared entry; the
+    // shared copy is left alone and the rows stay dirty.
+    bool Sync(Handle handle, void const *data)
+    {
+        Binding &binding = handles_.at(handle);
+        Entry &entry = entries_.at(binding.entry);
+        const uint64_t bytes = entry.key.bytes;
+        if (binding.dirty.Empty()) {
+            stats_.skippedBytes += bytes;
+            return true;
+        }
+        stats_.syncs++;
+        // Ranges are sorted; a block holding several of them is hashed once
+        const uint64_t blockBytes = TensorHashBlockBytes(entry.rowBytes);
+        std::vector<uint64_t> blocks = entry.blocks;
+        uint64_t hash = Hashing([&] {
+            uint64_t hashedEnd = 0;
+            for (auto const &range : binding.dirty.Ranges()) {
+                uint64_t begin = std::max(uint64_t(range.first) * entry.rowBytes, hashedEnd);
+                uint64_t end = uint64_t(range.second) * entry.rowBytes;
+                if (begin >= end) continue;
+                stats_.hashedBytes += TensorBlockHashes(data, bytes, blockBytes, begin, end, blocks);
+                hashedEnd = TensorHashBlockCount(end, blockBytes) * blockBytes;
+            }
+            return CombineBlocks(blocks);
+        });
+        Key key = { hash, bytes };
+
+        if (entry.refs > 1) {
+            uint64_t detached = Create(entry.name, key, blocks, data, entry.rowBytes);
+            if (!detached) return false;
+            Unpin(binding.entry);
+            binding.entry = detached;
+            stats_.detaches++;
+            binding.dirty.Clear();
+            return true;
+        }
+
+        uint8_t const *src = static_cast<uint8_t const *>(data);
+        uint64_t uploaded = 0;
+        for (auto const &range : binding.dirty.Ranges()) {
+            uint64_t offset = uint64_t(range.first) * entry.rowBytes;
+            uint64_t length = std::min<uint64_t>(uint64_t(range.second) * entry.rowBytes, bytes) - std::min(offset, bytes);
+            if (!length) continue;
+            backend_.Upload(entry.buffer, offset, src + offset, length);
+            uploaded += length;
+            stats_.uploads++;
+        }
+        stats_.uploadedBytes += uploaded;
+        stats_.skippedBytes += bytes - uploaded;
+        binding.dirty.Clear();
+
+        auto old = byContent_.find(entry.key);
+        if (old != byContent_.end() && old->second == binding.entry) byContent_.erase(old);
+        entry.blocks = std::move(blocks);
+        entry.key = key;
+        byContent_.emplace(entry.key, binding.entry);
+        return true;
+    }
+
+    Buffer const &DeviceBuffer(Handle handle) const { return entries_.at(handles_.at(handle).entry).buffer; }
+    uint64_t Hash(Handle handle) const { return entries_.at(handles_.at(handle).entry).key.hash; }
+    bool Shares(Handle a, Handle b) const { return handles_.at(a).entry == handles_.at(b).entry; }
+    size_t ResidentTensors() const { return entries_.size(); }
+    Stats const &GetStats() const { return stats_; }
+
+    void Report(std::ostream &os) const
+    {
+        uint64_t total = stats_.uploadedBytes + stats_.skippedBytes;
+        os << "weight cache: " << entries_.size() << " resident, " << stats_.hits << " hits, " << stats_.misses << " misses, "
+           << stats_.syncs << " syncs (" << stats_.detaches << " detached), " << stats_.evictions << " evictions; " << std::fixed
+           << std::setprecision(1) << stats_.uploadedBytes / 1024.0 << " KB uploaded in " << stats_.uploads << " copies, "
+           << stats_.skippedBytes / 1024.0 << " KB skipped (" << (total ? 100.0 * stats_.skippedBytes / total : 0.0) << "%); "
+           << stats_.hashedBytes / 1024.0 << " KB hashed in " << std::setprecision(3) << stats_.hashMs << " ms" << std::defaultfloat
+           << std::endl;
+    }
+
+private:
+    struct Key {
+        uint64_t hash;
+        uint64_t bytes;
+        bool operator<(Key const &other) const { return hash != other.hash ? hash < other.hash : bytes < other.bytes; }
+    };
+
+    struct Entry {
+        const char *name;
+        Key key;
+        std::vector<uint64_t> blocks;
+        uint32_t rowBytes;
+        Buffer buffer;
+        uint32_t refs;
+        MemoryCharge charge;
+    };
+
+    struct Binding {
+        uint64_t entry;
+        DirtyRows dirty;
+    };
+
+    // Times fn, which hashes, into the stats
+    template <typename Fn>
+    uint64_t Hashing(Fn &&fn)
+    {
+        auto start = std::chrono::steady_clock::now();
+        uint64_t hash = fn();
+        stats_.hashMs += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        return hash;
+    }
+
+    uint64_t CombineBlocks(std::vector<uint64_t> const &blocks)
+    {
+        stats_.hashedBytes += blocks.size() * sizeof(uint64_t);
+        return TensorContentHash(blocks);
+    }
+
+    // Charges (possibly evicting released entries), then uploads
+    uint64_t Create(const char *name, Key key, std::vector<uint64_t> blocks, void const *data, uint32_t rowBytes)
+    {
+        const uint64_t bytes = key.bytes;
+        MemoryCharge charge(memory_, MEMORY_POOL_DEVICE, MEMORY_WEIGHTS, bytes, name);
+        if (!charge.Ok()) return 0;
+        uint64_t id = nextEntry_++;
+        Entry &entry =
+            entries_.emplace(id, Entry{ name, key, std::move(blocks), rowBytes, backend_.Create(bytes), 1, std::move(charge) }).first->second;
+        backend_.Upload(entry.buffer, 0, data, bytes);
+        stats_.uploadedBytes += bytes;
+        stats_.uploads++;
+        byContent_.emplace(key, id);
+        return id;
+    }
+
+    // The first holder turns the evictable charge back into a pinned one;
+    // the bytes were just freed, so it always fits.
+    void Pin(Entry &entry)
+    {
+        if (entry.refs++ == 0) {
+            entry.charge.Reset();
+            entry.charge = MemoryCharge(memory_, MEMORY_POOL_DEVICE, MEMORY_WEIGHTS, entry.key.bytes, entry.name);
+        }
+    }
+
+    void Unpin(uint64_t id)
+    {
+        Entry &entry = entries_.at(id);
+        if (--entry.refs) return;
+        entry.charge.Reset();
+        entry.charge = MemoryCharge(memory_, MEMORY_POOL_DEVICE, MEMORY_WEIGHTS, entry.key.bytes, entry.name, [this, id] { Evict(id); });
+    }
+
+    // Called by the memory account, outside its lock
+    void Evict(uint64_t id)
+    {
+        auto it = entries_.find(id);
+        if (it == entries_.end()) return;
+        auto key = byContent_.find(it->second.key);
+        if (key != byContent_.end() && key->second == id) byContent_.erase(key);
+        entries_.erase(it);
+        stats_.evictions++;
+    }
+
+    Backend &backend_;
+    MemoryAccount &memory_;
+    uint32_t mergeGap_;
+    std::unordered_map<uint64_t, Entry> entries_;
+    std::map<Key, uint64_t> byContent_;
+    std::unordered_map<Handle, Binding> handles_;
+    uint64_t nextEntry_ = 1;
+    Handle nextHandle_ = 1;
+    Stats stats_;
+};
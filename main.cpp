@@ -5,10 +5,21 @@
 #include <wrl.h>
 #include <vector>
 #include <iostream>
+#include <cstring>
 #include <d3dcompiler.h>
 #include <dxcore.h> // Include for experimental features
 
 #include "include/util.h"
+#include "include/grouped_gemv.h"
+#include "include/sparse_util.h"
+#include "include/upload_util.h"
+#include "include/tiled_gemv.h"
+#include "include/trace.h"
+#include "include/startup_graph.h"
+#include "include/bench_util.h"
+#include "include/row_split.h"
+#include "include/memory_budget.h"
+#include "include/compute_graph.h"
 
 using namespace Microsoft::WRL;
 
@@ -25,64 +36,382 @@ void CheckHRFunc(HRESULT hr, const char* file, int line) {
 // Constants
 const UINT THREAD_GROUP_SIZE = 4; // Number of threads per group
 
-int main() {
-    // Enable the debug layer (optional, for debugging)
-#if defined(_DEBUG)
-    ComPtr<ID3D12Debug> debugController;
-    if (SUCCEEDED(D3D12GetDebugInterface(IID_PPV_ARGS(&debugController)))) {
-        debugController->EnableDebugLayer();
+// --precision configs: operand types of the CoopVectorMulAdd.hlsl
+// permutations built by compile.bat, after the RUN lines of the shader.
+// Their matrix_stride is 16 bytes.
+struct PrecisionConfig {
+    const char* name;
+    MatMulAddTypes types;
+    const wchar_t* shaderFile;
+};
+static const PrecisionConfig PRECISION_CONFIGS[] = {
+    { "f16", MatMulAddTypes::Uniform(DATA_TYPE_FLOAT16), L"CoopVectorMulAdd.cso" },
+    { "f16-e4m3", { DATA_TYPE_FLOAT16, DATA_TYPE_FLOAT8_E4M3, DATA_TYPE_FLOAT8_E4M3, DATA_TYPE_FLOAT16, DATA_TYPE_FLOAT32 }, L"CoopVectorMulAddF16E4M3.cso" },
+    { "i8", { DATA_TYPE_SINT8_T4_PACKED, DATA_TYPE_SINT8_T4_PACKED, DATA_TYPE_SINT8, DATA_TYPE_SINT32, DATA_TYPE_SINT32 }, L"CoopVectorMulAddI8.cso" },
+};
+const UINT COOP_MATRIX_STRIDE_ALIGN = 16;
+
+// --split: scale-out GEMV over every hardware adapter, with queuesPerDevice
+// compute queues on each (row_split.h). Every queue is a worker that owns
+// one output row slice. Each device keeps the whole input, matrix and bias
+// resident, so a new split only changes the tile constants of the
+// VectorMulAddTiled permutation: first row, row count and the slice's byte
+// offset in the matrix. Every worker writes its own output buffer and reads
+// back only its rows, so the queues never share a resource in a writable
+// state. The time between the timestamps around each dispatch feeds the
+// balancer, which re-sizes the slices for the next run.
+static int RunRowSplit(uint32_t queuesPerDevice, uint32_t runs)
+{
+    const DataType dt = DATA_TYPE_FLOAT32;
+    const uint32_t M = 4096, K = 8, strideK = 32; // K and STRIDE_K are fixed in VectorMulAdd.hlsl
+    const uint32_t inputSize = SizeofType(dt) * K, matrixSize = strideK * M, biasSize = SizeofType(dt) * M, outputSize = SizeofType(dt) * M;
+
+    std::vector<uint8_t> inputData(inputSize), matrixData(matrixSize, 0), biasData(biasSize), goldenData(outputSize);
+    for (uint32_t k = 0; k < K; ++k) SetDataFloat(inputData.data(), dt, 0, k, 4.0f);
+    for (uint32_t m = 0; m < M; ++m) {
+        for (uint32_t k = 0; k < K; ++k) SetDataFloat(matrixData.data(), dt, m * strideK, k, float((m + k) % 4));
+        SetDataFloat(biasData.data(), dt, 0, m, float(m % 3));
     }
-#endif
+    MatMulAdd(dt, goldenData.data(), matrixData.data(), inputData.data(), biasData.data(), M, K, strideK);
+
+    ComPtr<ID3DBlob> shaderBlob;
+    CheckHR(D3DReadFileToBlob(L"VectorMulAddTiled.cso", &shaderBlob));
+
+    auto CreateBuffer = [](ID3D12Device* device, D3D12_HEAP_TYPE heapType, uint32_t size, D3D12_RESOURCE_FLAGS flags, D3D12_RESOURCE_STATES initState, ComPtr<ID3D12Resource>& buffer) {
+        CD3DX12_HEAP_PROPERTIES heapProps(heapType);
+        CD3DX12_RESOURCE_DESC bufferDesc = CD3DX12_RESOURCE_DESC::Buffer(size, flags);
+        CheckHR(device->CreateCommittedResource(&heapProps, D3D12_HEAP_FLAG_NONE, &bufferDesc, initState, nullptr, IID_PPV_ARGS(&buffer)));
+    };
+    auto Transition = [](ID3D12GraphicsCommandList* list, ID3D12Resource* resource, D3D12_RESOURCE_STATES beforeState, D3D12_RESOURCE_STATES afterState) {
+        CD3DX12_RESOURCE_BARRIER barrier = CD3DX12_RESOURCE_BARRIER::Transition(resource, beforeState, afterState);
+        list->ResourceBarrier(1, &barrier);
+    };
 
+    struct SplitDevice {
+        std::wstring name;
+        ComPtr<ID3D12Device> device;
+        ComPtr<ID3D12RootSignature> rootSignature;
+        ComPtr<ID3D12PipelineState> pipelineState;
+        ComPtr<ID3D12Resource> input, matrix, bias;
+        ComPtr<ID3D12QueryHeap> timestampHeap;
+        ComPtr<ID3D12Resource> timestampReadback;
+    };
+    struct SplitWorker {
+        uint32_t device;
+        ComPtr<ID3D12CommandQueue> queue;
+        ComPtr<ID3D12CommandAllocator> allocator;
+        ComPtr<ID3D12GraphicsCommandList> list;
+        ComPtr<ID3D12Fence> fence;
+        uint64_t fenceValue = 0;
+        uint64_t frequency = 1;
+        ComPtr<ID3D12DescriptorHeap> descriptorHeap; // t0-t2 of the device, u0 = output
+        ComPtr<ID3D12Resource> output, readback;
+    };
+    std::vector<SplitDevice> devices;
+    std::vector<SplitWorker> workers;
 
-    // Create DXGI Factory
     ComPtr<IDXGIFactory6> factory;
     CheckHR(CreateDXGIFactory1(IID_PPV_ARGS(&factory)));
-
-    // Enumerate adapters and check for DirectX 12 support
     ComPtr<IDXGIAdapter1> adapter;
     for (UINT adapterIndex = 0; DXGI_ERROR_NOT_FOUND != factory->EnumAdapters1(adapterIndex, &adapter); ++adapterIndex) {
         DXGI_ADAPTER_DESC1 desc;
         adapter->GetDesc1(&desc);
-
         if (desc.Flags & DXGI_ADAPTER_FLAG_SOFTWARE) continue;
-
-        if (SUCCEEDED(D3D12CreateDevice(adapter.Get(), D3D_FEATURE_LEVEL_12_0, __uuidof(ID3D12Device), nullptr))) {
-            break;
-        }
+        SplitDevice d;
+        if (FAILED(D3D12CreateDevice(adapter.Get(), D3D_FEATURE_LEVEL_12_0, IID_PPV_ARGS(&d.device)))) continue;
+        d.name = desc.Description;
+        devices.push_back(std::move(d));
     }
-    if (!adapter) {
+    if (devices.empty()) {
         std::cerr << "No DirectX 12 compatible GPU found." << std::endl;
         return EXIT_FAILURE;
     }
 
-    // Create the DirectX 12 device
-    ComPtr<ID3D12Device> device;
-    CheckHR(D3D12CreateDevice(adapter.Get(), D3D_FEATURE_LEVEL_12_0, IID_PPV_ARGS(&device)));
+    // Same layout as the tiled mode: SRV table, UAV table, 3 tile constants
+    D3D12_DESCRIPTOR_RANGE ranges[2] = {};
+    ranges[0].RangeType = D3D12_DESCRIPTOR_RANGE_TYPE_SRV;
+    ranges[0].NumDescriptors = 3;
+    ranges[1].RangeType = D3D12_DESCRIPTOR_RANGE_TYPE_UAV;
+    ranges[1].NumDescriptors = 1;
+    D3D12_ROOT_PARAMETER rootParameters[3] = {};
+    for (uint32_t i = 0; i < 2; ++i) {
+        rootParameters[i].ParameterType = D3D12_ROOT_PARAMETER_TYPE_DESCRIPTOR_TABLE;
+        rootParameters[i].ShaderVisibility = D3D12_SHADER_VISIBILITY_ALL;
+        rootParameters[i].DescriptorTable.NumDescriptorRanges = 1;
+        rootParameters[i].DescriptorTable.pDescriptorRanges = &ranges[i];
+    }
+    rootParameters[2].ParameterType = D3D12_ROOT_PARAMETER_TYPE_32BIT_CONSTANTS;
+    rootParameters[2].ShaderVisibility = D3D12_SHADER_VISIBILITY_ALL;
+    rootParameters[2].Constants.Num32BitValues = 3;
+    D3D12_ROOT_SIGNATURE_DESC rootSignatureDesc = {};
+    rootSignatureDesc.NumParameters = 3;
+    rootSignatureDesc.pParameters = rootParameters;
+    ComPtr<ID3DBlob> serializedRootSignature, errorBlob;
+    CheckHR(D3D12SerializeRootSignature(&rootSignatureDesc, D3D_ROOT_SIGNATURE_VERSION_1, &serializedRootSignature, &errorBlob));
 
-    // D3D12_FEATURE_DATA_SHADER_MODEL shaderModel = { D3D_SHADER_MODEL_6_9 };
-    // if (FAILED(device->CheckFeatureSupport(D3D12_FEATURE_SHADER_MODEL, &shaderModel, sizeof(shaderModel)))) {
-    //     std::cerr << "Shader Model 6.9 is not supported by the current driver." << std::endl;
-    //     return EXIT_FAILURE;
-    // }
+    const uint32_t numWorkers = uint32_t(devices.size()) * queuesPerDevice;
+    for (uint32_t d = 0; d < devices.size(); ++d) {
+        SplitDevice& dev = devices[d];
+        ID3D12Device* device = dev.device.Get();
+        CheckHR(device->CreateRootSignature(0, serializedRootSignature->GetBufferPointer(), serializedRootSignature->GetBufferSize(), IID_PPV_ARGS(&dev.rootSignature)));
+        D3D12_COMPUTE_PIPELINE_STATE_DESC pipelineStateDesc = {};
+        pipelineStateDesc.pRootSignature = dev.rootSignature.Get();
+        pipelineStateDesc.CS = { shaderBlob->GetBufferPointer(), shaderBlob->GetBufferSize() };
+        CheckHR(device->CreateComputePipelineState(&pipelineStateDesc, IID_PPV_ARGS(&dev.pipelineState)));
 
-    // Create a command queue
-    D3D12_COMMAND_QUEUE_DESC queueDesc = {};
-    queueDesc.Type = D3D12_COMMAND_LIST_TYPE_COMPUTE;
-    queueDesc.Flags = D3D12_COMMAND_QUEUE_FLAG_NONE;
+        CreateBuffer(device, D3D12_HEAP_TYPE_DEFAULT, inputSize, D3D12_RESOURCE_FLAG_NONE, D3D12_RESOURCE_STATE_COPY_DEST, dev.input);
+        CreateBuffer(device, D3D12_HEAP_TYPE_DEFAULT, matrixSize, D3D12_RESOURCE_FLAG_NONE, D3D12_RESOURCE_STATE_COPY_DEST, dev.matrix);
+        CreateBuffer(device, D3D12_HEAP_TYPE_DEFAULT, biasSize, D3D12_RESOURCE_FLAG_NONE, D3D12_RESOURCE_STATE_COPY_DEST, dev.bias);
 
-    ComPtr<ID3D12CommandQueue> commandQueue;
-    CheckHR(device->CreateCommandQueue(&queueDesc, IID_PPV_ARGS(&commandQueue)));
+        // One timestamp pair per worker of the device
+        D3D12_QUERY_HEAP_DESC queryHeapDesc = {};
+        queryHeapDesc.Type = D3D12_QUERY_HEAP_TYPE_TIMESTAMP;
+        queryHeapDesc.Count = 2 * queuesPerDevice;
+        CheckHR(device->CreateQueryHeap(&queryHeapDesc, IID_PPV_ARGS(&dev.timestampHeap)));
+        CreateBuffer(device, D3D12_HEAP_TYPE_READBACK, queryHeapDesc.Count * sizeof(uint64_t), D3D12_RESOURCE_FLAG_NONE, D3D12_RESOURCE_STATE_COPY_DEST, dev.timestampReadback);
 
-    // Create a command allocator and command list
-    ComPtr<ID3D12CommandAllocator> commandAllocator;
-    CheckHR(device->CreateCommandAllocator(D3D12_COMMAND_LIST_TYPE_COMPUTE, IID_PPV_ARGS(&commandAllocator)));
+        for (uint32_t q = 0; q < queuesPerDevice; ++q) {
+            SplitWorker w;
+            w.device = d;
+            D3D12_COMMAND_QUEUE_DESC queueDesc = {};
+            queueDesc.Type = D3D12_COMMAND_LIST_TYPE_COMPUTE;
+            CheckHR(device->CreateCommandQueue(&queueDesc, IID_PPV_ARGS(&w.queue)));
+            CheckHR(w.queue->GetTimestampFrequency(&w.frequency));
+            CheckHR(device->CreateCommandAllocator(D3D12_COMMAND_LIST_TYPE_COMPUTE, IID_PPV_ARGS(&w.allocator)));
+            CheckHR(device->CreateCommandList(0, D3D12_COMMAND_LIST_TYPE_COMPUTE, w.allocator.Get(), nullptr, IID_PPV_ARGS(&w.list)));
+            CheckHR(w.list->Close());
+            CheckHR(device->CreateFence(0, D3D12_FENCE_FLAG_NONE, IID_PPV_ARGS(&w.fence)));
+            CreateBuffer(device, D3D12_HEAP_TYPE_DEFAULT, outputSize, D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS, D3D12_RESOURCE_STATE_COMMON, w.output);
+            CreateBuffer(device, D3D12_HEAP_TYPE_READBACK, outputSize, D3D12_RESOURCE_FLAG_NONE, D3D12_RESOURCE_STATE_COPY_DEST, w.readback);
 
-    ComPtr<ID3D12GraphicsCommandList> commandList;
-    CheckHR(device->CreateCommandList(0, D3D12_COMMAND_LIST_TYPE_COMPUTE, commandAllocator.Get(), nullptr, IID_PPV_ARGS(&commandList)));
+            D3D12_DESCRIPTOR_HEAP_DESC heapDesc = {};
+            heapDesc.NumDescriptors = 4;
+            heapDesc.Type = D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV;
+            heapDesc.Flags = D3D12_DESCRIPTOR_HEAP_FLAG_SHADER_VISIBLE;
+            CheckHR(device->CreateDescriptorHeap(&heapDesc, IID_PPV_ARGS(&w.descriptorHeap)));
+            D3D12_CPU_DESCRIPTOR_HANDLE handle = w.descriptorHeap->GetCPUDescriptorHandleForHeapStart();
+            const UINT increment = device->GetDescriptorHandleIncrementSize(D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV);
+            D3D12_SHADER_RESOURCE_VIEW_DESC srvDesc = {};
+            srvDesc.ViewDimension = D3D12_SRV_DIMENSION_BUFFER;
+            srvDesc.Shader4ComponentMapping = D3D12_DEFAULT_SHADER_4_COMPONENT_MAPPING;
+            srvDesc.Buffer.Flags = D3D12_BUFFER_SRV_FLAG_RAW;
+            srvDesc.Format = DXGI_FORMAT_R32_TYPELESS;
+            ID3D12Resource* srvs[3] = { dev.input.Get(), dev.matrix.Get(), dev.bias.Get() };
+            const uint32_t srvSizes[3] = { inputSize, matrixSize, biasSize };
+            for (uint32_t i = 0; i < 3; ++i) {
+                srvDesc.Buffer.NumElements = srvSizes[i] / sizeof(uint32_t);
+                device->CreateShaderResourceView(srvs[i], &srvDesc, handle);
+                handle.ptr += increment;
+            }
+            D3D12_UNORDERED_ACCESS_VIEW_DESC uavDesc = {};
+            uavDesc.ViewDimension = D3D12_UAV_DIMENSION_BUFFER;
+            uavDesc.Buffer.NumElements = outputSize / sizeof(uint32_t);
+            uavDesc.Buffer.Flags = D3D12_BUFFER_UAV_FLAG_RAW;
+            uavDesc.Format = DXGI_FORMAT_R32_TYPELESS;
+            device->CreateUnorderedAccessView(w.output.Get(), nullptr, &uavDesc, handle);
+            workers.push_back(std::move(w));
+        }
+    }
+
+    HANDLE fenceEvent = CreateEvent(nullptr, FALSE, FALSE, nullptr);
+    auto WaitWorker = [&](SplitWorker& w) {
+        if (w.fence->GetCompletedValue() < w.fenceValue) {
+            CheckHR(w.fence->SetEventOnCompletion(w.fenceValue, fenceEvent));
+            WaitForSingleObject(fenceEvent, INFINITE);
+        }
+    };
+
+    // One-time upload per device on its first queue. The upload buffers are
+    // released after the wait, the resident copies stay for every run.
+    {
+        TRACE_SCOPE("split upload");
+        std::vector<ComPtr<ID3D12Resource>> uploads;
+        for (SplitDevice& dev : devices) {
+            SplitWorker& w = workers[(&dev - devices.data()) * queuesPerDevice];
+            CheckHR(w.allocator->Reset());
+            CheckHR(w.list->Reset(w.allocator.Get(), nullptr));
+            ID3D12Resource* targets[3] = { dev.input.Get(), dev.matrix.Get(), dev.bias.Get() };
+            const std::vector<uint8_t>* sources[3] = { &inputData, &matrixData, &biasData };
+            for (uint32_t i = 0; i < 3; ++i) {
+                ComPtr<ID3D12Resource> upload;
+                CreateBuffer(dev.device.Get(), D3D12_HEAP_TYPE_UPLOAD, uint32_t(sources[i]->size()), D3D12_RESOURCE_FLAG_NONE, D3D12_RESOURCE_STATE_GENERIC_READ, upload);
+                void* mapped;
+                CheckHR(upload->Map(0, nullptr, &mapped));
+                memcpy(mapped, sources[i]->data(), sources[i]->size());
+                upload->Unmap(0, nullptr);
+                w.list->CopyBufferRegion(targets[i], 0, upload.Get(), 0, sources[i]->size());
+                Transition(w.list.Get(), targets[i], D3D12_RESOURCE_STATE_COPY_DEST, D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE);
+                uploads.push_back(upload);
+            }
+            CheckHR(w.list->Close());
+            ID3D12CommandList* lists[] = { w.list.Get() };
+            w.queue->ExecuteCommandLists(_countof(lists), lists);
+            CheckHR(w.queue->Signal(w.fence.Get(), ++w.fenceValue));
+        }
+        for (SplitDevice& dev : devices) WaitWorker(workers[(&dev - devices.data()) * queuesPerDevice]);
+    }
+
+    std::cout << "Split: " << M << " rows over " << devices.size() << " device(s) x " << queuesPerDevice << " queue(s)" << std::endl;
+    for (uint32_t d = 0; d < devices.size(); ++d) std::wcout << L"  device " << d << L": " << devices[d].name << std::endl;
+
+    RowSplitBalancer balancer(numWorkers);
+    std::vector<uint8_t> outputData(outputSize);
+    for (uint32_t run = 0; run < runs; ++run) {
+        TRACE_SCOPE_ARG("split run", "run", run);
+        std::vector<RowSlice> slices = balancer.Split(M, THREAD_GROUP_SIZE);
+        for (uint32_t i = 0; i < numWorkers; ++i) {
+            SplitWorker& w = workers[i];
+            SplitDevice& dev = devices[w.device];
+            const RowSlice slice = slices[i];
+            if (slice.Rows() == 0) continue;
+            const uint32_t query = 2 * (i % queuesPerDevice);
+            ID3D12GraphicsCommandList* list = w.list.Get();
+            CheckHR(w.allocator->Reset());
+            CheckHR(list->Reset(w.allocator.Get(), dev.pipelineState.Get()));
+            list->SetComputeRootSignature(dev.rootSignature.Get());
+            ID3D12DescriptorHeap* heaps[] = { w.descriptorHeap.Get() };
+            list->SetDescriptorHeaps(_countof(heaps), heaps);
+            list->SetComputeRootDescriptorTable(0, w.descriptorHeap->GetGPUDescriptorHandleForHeapStart());
+            list->SetComputeRootDescriptorTable(1, CD3DX12_GPU_DESCRIPTOR_HANDLE(
+                w.descriptorHeap->GetGPUDescriptorHandleForHeapStart(), 3, dev.device->GetDescriptorHandleIncrementSize(D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV)));
+            UINT tileConstants[3] = { slice.begin, slice.Rows(), slice.begin * strideK };
+            list->SetComputeRoot32BitConstants(2, _countof(tileConstants), tileConstants, 0);
+            list->EndQuery(dev.timestampHeap.Get(), D3D12_QUERY_TYPE_TIMESTAMP, query);
+            list->Dispatch((slice.Rows() + THREAD_GROUP_SIZE - 1) / THREAD_GROUP_SIZE, 1, 1);
+            list->EndQuery(dev.timestampHeap.Get(), D3D12_QUERY_TYPE_TIMESTAMP, query + 1);
+
+            // The output was promoted from COMMON to UNORDERED_ACCESS by the
+            // dispatch and decays back once the list completes.
+            Transition(list, w.output.Get(), D3D12_RESOURCE_STATE_UNORDERED_ACCESS, D3D12_RESOURCE_STATE_COPY_SOURCE);
+            const uint64_t sliceOffset = uint64_t(slice.begin) * SizeofType(dt);
+            list->CopyBufferRegion(w.readback.Get(), sliceOffset, w.output.Get(), sliceOffset, uint64_t(slice.Rows()) * SizeofType(dt));
+            list->ResolveQueryData(dev.timestampHeap.Get(), D3D12_QUERY_TYPE_TIMESTAMP, query, 2, dev.timestampReadback.Get(), query * sizeof(uint64_t));
+            CheckHR(list->Close());
+            ID3D12CommandList* lists[] = { list };
+            w.queue->ExecuteCommandLists(_countof(lists), lists);
+            CheckHR(w.queue->Signal(w.fence.Get(), ++w.fenceValue));
+        }
+
+        // Gather the slices and the GPU time of every worker
+        std::vector<double> ms(numWorkers, 0.0);
+        for (uint32_t i = 0; i < numWorkers; ++i) {
+            SplitWorker& w = workers[i];
+            const RowSlice slice = slices[i];
+            if (slice.Rows() == 0) continue;
+            WaitWorker(w);
+            const uint64_t sliceOffset = uint64_t(slice.begin) * SizeofType(dt), sliceBytes = uint64_t(slice.Rows()) * SizeofType(dt);
+            D3D12_RANGE readRange = { SIZE_T(sliceOffset), SIZE_T(sliceOffset + sliceBytes) };
+            uint8_t* mapped;
+            CheckHR(w.readback->Map(0, &readRange, (void**)&mapped));
+            memcpy(outputData.data() + sliceOffset, mapped + sliceOffset, sliceBytes);
+            w.readback->Unmap(0, nullptr);
+
+            const uint32_t query = 2 * (i % queuesPerDevice);
+            D3D12_RANGE ticksRange = { query * sizeof(uint64_t), (query + 2) * sizeof(uint64_t) };
+            uint64_t* ticks;
+            CheckHR(devices[w.device].timestampReadback->Map(0, &ticksRange, (void**)&ticks));
+            ms[i] = double(ticks[query + 1] - ticks[query]) * 1000.0 / double(w.frequency);
+            devices[w.device].timestampReadback->Unmap(0, nullptr);
+            balancer.Record(i, slice.Rows(), ms[i]);
+        }
+
+        std::cout << "run " << run << ":";
+        for (uint32_t i = 0; i < numWorkers; ++i) {
+            std::cout << " [" << workers[i].device << "." << i % queuesPerDevice << " " << slices[i].begin << "-" << slices[i].end << " " << ms[i] << " ms]";
+        }
+        std::cout << " imbalance " << RowSplitBalancer::Imbalance(ms) << std::endl;
+
+        for (uint32_t m = 0; m < M; ++m) {
+            float v = GetDataFloat(outputData.data(), dt, 0, m);
+            float golden = GetDataFloat(goldenData.data(), dt, 0, m);
+            if (v != golden) {
+                std::cout << "Output[" << m << "] = " << v << "; Golden[" << m << "] = " << golden << std::endl;
+                CloseHandle(fenceEvent);
+                return EXIT_FAILURE;
+            }
+        }
+    }
+    CloseHandle(fenceEvent);
+
+    std::cout << "Row split executed successfully and results are correct!" << std::endl;
+    return 0;
+}
+
+int main(int argc, char** argv) {
+    // --grouped runs several differently sized GEMVs in one dispatch
+    // --sparse runs the 2:4 structured-sparse GEMV
+    // --fused runs VectorMulAdd with the row-scale + ReLU epilogue, F16 output
+    // --tiled BUDGET_BYTES streams the matrix through a two-slot row-tile
+    //   window so that all device buffers fit in the budget
+    // --trace FILE writes a Chrome trace_event JSON of every phase, with the
+    //   GPU timestamps of the command lists on their own tracks
+    // --precision f16|f16-e4m3|i8 runs the cooperative vector GEMV with
+    //   per-operand types (PRECISION_CONFIGS)
+    // --budget BYTES caps the device memory budget of the adapter
+    //   (memory_budget.h); a dense matrix that does not fit runs tiled
+    // --split QUEUES splits the rows over every GPU with QUEUES compute
+    //   queues each, rebalanced by measured time (--split-runs N, default 4)
+    // --split-barriers lets the compute graph split transitions that have
+    //   a level of work in between (compute_graph.h)
+    bool grouped = false;
+    bool sparse = false;
+    bool fused = false;
+    uint64_t tileBudget = 0;
+    uint64_t deviceBudget = 0;
+    const PrecisionConfig* precision = nullptr;
+    const char* tracePath = "";
+    uint32_t splitQueues = 0;
+    uint32_t splitRuns = 4;
+    bool splitBarriers = false;
+    for (int i = 1; i < argc; ++i) {
+        if (strcmp(argv[i], "--grouped") == 0) grouped = true;
+        else if (strcmp(argv[i], "--sparse") == 0) sparse = true;
+        else if (strcmp(argv[i], "--fused") == 0) fused = true;
+        else if (strcmp(argv[i], "--tiled") == 0 && i + 1 < argc) tileBudget = strtoull(argv[++i], nullptr, 10);
+        else if (strcmp(argv[i], "--trace") == 0 && i + 1 < argc) tracePath = argv[++i];
+        else if (strcmp(argv[i], "--budget") == 0 && i + 1 < argc) deviceBudget = strtoull(argv[++i], nullptr, 10);
+        else if (strcmp(argv[i], "--precision") == 0 && i + 1 < argc) {
+            const char* name = argv[++i];
+            for (const PrecisionConfig& config : PRECISION_CONFIGS) {
+                if (strcmp(config.name, name) == 0) precision = &config;
+            }
+            if (!precision) {
+                std::cerr << "Unknown --precision " << name << std::endl;
+                return EXIT_FAILURE;
+            }
+        }
+        else if (strcmp(argv[i], "--split") == 0 && i + 1 < argc) splitQueues = std::max(1u, uint32_t(strtoul(argv[++i], nullptr, 10)));
+        else if (strcmp(argv[i], "--split-runs") == 0 && i + 1 < argc) splitRuns = uint32_t(strtoul(argv[++i], nullptr, 10));
+        else if (strcmp(argv[i], "--split-barriers") == 0) splitBarriers = true;
+    }
+    if (tileBudget && (grouped || sparse || fused)) {
+        std::cerr << "--tiled runs the plain dense GEMV only" << std::endl;
+        return EXIT_FAILURE;
+    }
+    if (precision && (grouped || sparse || fused || tileBudget)) {
+        std::cerr << "--precision runs the plain dense GEMV only" << std::endl;
+        return EXIT_FAILURE;
+    }
+    if (splitQueues && (grouped || sparse || fused || tileBudget || precision)) {
+        std::cerr << "--split runs the plain dense GEMV only" << std::endl;
+        return EXIT_FAILURE;
+    }
+    Timer startupTimer;
+    TraceSession traceSession(tracePath);
+    if (splitQueues) return RunRowSplit(splitQueues, splitRuns);
+    const bool gpuTimestamps = Trace::Enabled();
+    ThreadPool pool;
 
+    // Enable the debug layer (optional, for debugging)
+#if defined(_DEBUG)
+    ComPtr<ID3D12Debug> debugController;
+    if (SUCCEEDED(D3D12GetDebugInterface(IID_PPV_ARGS(&debugController)))) {
+        debugController->EnableDebugLayer();
+    }
+#endif
 
-    // Define buffer sizes
+    // Sizes, tables and the tile plan: cheap and needed to lay out the
+    // startup graph below, so they are computed up front.
     auto AlignTo = [](uint32_t size, uint32_t alignment) {
         return (size + alignment - 1) & ~(alignment - 1);
     };
@@ -99,19 +428,132 @@ int main() {
     uint32_t M = 8;
     uint32_t K = 8;
 
-    uint32_t inputVectorBufferSize = SizeofType(dt) * K;
-    uint32_t matrixBufferSize = AlignTo(SizeofType(dt) * K, STRIDE_ALIGH_BYTES) * M;
-    uint32_t biasBufferSize = SizeofType(dt) * M;
-    uint32_t outputVectorBufferSize = SizeofType(dt) * M;
+    // Every operand is sized by its own type; raw views need whole words.
+    MatMulAddTypes types = precision ? precision->types : MatMulAddTypes::Uniform(dt);
+    const uint32_t matrixStride = AlignTo(SizeofType(types.matrix) * K, precision ? COOP_MATRIX_STRIDE_ALIGN : STRIDE_ALIGH_BYTES);
+    uint32_t inputVectorBufferSize = AlignTo(SizeofType(types.input) * K, 4);
+    uint32_t matrixBufferSize = matrixStride * M;
+    uint32_t biasBufferSize = AlignTo(SizeofType(types.bias) * M, 4);
+    uint32_t outputVectorBufferSize = AlignTo(SizeofType(types.output) * M, 4);
+    if (precision) {
+        std::cout << "Precision " << precision->name << ": input " << DataTypeName(types.input) << " as " << DataTypeName(types.inputInterpretation)
+                  << ", matrix " << DataTypeName(types.matrix) << ", bias " << DataTypeName(types.bias) << ", output " << DataTypeName(types.output)
+                  << "; " << inputVectorBufferSize + matrixBufferSize + biasBufferSize + outputVectorBufferSize << " bytes" << std::endl;
+    }
 
-    std::vector<uint8_t> inputVectorData(inputVectorBufferSize, 0);
-    std::vector<uint8_t> matrixData(matrixBufferSize, 0);
-    std::vector<uint8_t> biasData(biasBufferSize, 0);
-    std::vector<uint8_t> outputData(outputVectorBufferSize, 0);
+    // Grouped mode: ragged items packed into the same four buffers,
+    // described by an entry table and split into balanced row tiles.
+    std::vector<GemvGroupEntry> groupEntries;
+    std::vector<GemvGroupTile> groupTiles;
+    if (grouped) {
+        const uint32_t shapes[][2] = { { 64, 8 }, { 8, 64 }, { 16, 16 }, { 200, 24 }, { 3, 5 } };
+        for (auto& shape : shapes) {
+            GemvGroupEntry e = {};
+            e.M = shape[0];
+            e.K = shape[1];
+            groupEntries.push_back(e);
+        }
+        GemvGroupBufferSizes sizes = AssignGemvGroupOffsets(dt, groupEntries, STRIDE_ALIGH_BYTES);
+        inputVectorBufferSize = sizes.input;
+        matrixBufferSize = sizes.matrix;
+        biasBufferSize = sizes.bias;
+        outputVectorBufferSize = sizes.output;
+        groupTiles = BuildGemvGroupTiles(groupEntries, ChooseGemvGroupTileCost(groupEntries, 16));
+        M = outputVectorBufferSize / SizeofType(dt);
+    }
+
+    // Sparse mode: the device matrix buffer holds only the 2:4 values; the
+    // host keeps the dense matrix to pack and to compute the golden from.
+    const uint32_t hostMatrixSize = matrixBufferSize;
+    if (sparse) matrixBufferSize = uint32_t(Sparse24ValueBytes(dt, M, K, STRIDE_ALIGH_BYTES));
+
+    // Dense modes write the matrix straight into the mapped upload buffer
+    // (see upload_util.h) and never hold a host copy of it. Grouped and
+    // sparse mode still build it on the host: the tile tables and the 2:4
+    // packing need the whole matrix.
+    const bool zeroCopy = !grouped && !sparse && !precision;
+
+    // Fused mode: the epilogue scales every row (scale_buffer at t3), applies
+    // ReLU and stores F16, all inside the shader.
+    using FusedEpilogue = Epilogue<EpilogueRowScale, EpilogueRelu>;
+    DataType outputType = fused ? DATA_TYPE_FLOAT16 : types.output;
+    if (fused) outputVectorBufferSize = AlignTo(SizeofType(outputType) * M, 4);
+
+    // Extra read-only tables bound after bias_buffer (t3, t4, ...): the
+    // grouped entry and tile tables, the 2:4 metadata or the row scales.
+    struct ExtraSrv {
+        std::vector<uint8_t> data;
+        ComPtr<ID3D12Resource> buffer, uploadBuffer;
+    };
+    std::vector<ExtraSrv> extraSrvs(grouped ? 2 : (sparse || fused) ? 1 : 0);
+    const uint32_t numSrvs = 3 + uint32_t(extraSrvs.size());
+
+    // Memory budgets (memory_budget.h) of the first hardware adapter, the
+    // one the device stage normally picks: the local segment is the device
+    // pool, the non-local one (upload and readback heaps) the host pool.
+    // Plain host vectors go to the unbudgeted system pool.
+    // --budget lowers the device budget. Asked before the startup graph,
+    // because it decides whether the matrix has to be tiled.
+    ComPtr<IDXGIFactory6> factory;
+    CheckHR(CreateDXGIFactory1(IID_PPV_ARGS(&factory)));
+    MemoryAccount memory;
+    {
+        ComPtr<IDXGIAdapter1> budgetAdapter;
+        for (UINT adapterIndex = 0; DXGI_ERROR_NOT_FOUND != factory->EnumAdapters1(adapterIndex, &budgetAdapter); ++adapterIndex) {
+            DXGI_ADAPTER_DESC1 desc;
+            budgetAdapter->GetDesc1(&desc);
+            if (desc.Flags & DXGI_ADAPTER_FLAG_SOFTWARE) continue;
+            ComPtr<IDXGIAdapter3> adapter3;
+            DXGI_QUERY_VIDEO_MEMORY_INFO local = {}, nonLocal = {};
+            if (SUCCEEDED(budgetAdapter.As(&adapter3)) &&
+                SUCCEEDED(adapter3->QueryVideoMemoryInfo(0, DXGI_MEMORY_SEGMENT_GROUP_LOCAL, &local)) &&
+                SUCCEEDED(adapter3->QueryVideoMemoryInfo(0, DXGI_MEMORY_SEGMENT_GROUP_NON_LOCAL, &nonLocal))) {
+                // Budgets are for the whole process, minus what it already uses
+                memory.SetBudget(MEMORY_POOL_DEVICE, local.Budget > local.CurrentUsage ? local.Budget - local.CurrentUsage : 0);
+                memory.SetBudget(MEMORY_POOL_HOST, nonLocal.Budget > nonLocal.CurrentUsage ? nonLocal.Budget - nonLocal.CurrentUsage : 0);
+            }
+            break;
+        }
+    }
+    if (deviceBudget) memory.SetBudget(MEMORY_POOL_DEVICE, std::min(deviceBudget, memory.Budget(MEMORY_POOL_DEVICE)));
+    if (memory.Budget(MEMORY_POOL_DEVICE) != MemoryAccount::Unlimited) {
+        std::cout << "Memory budget: " << memory.Budget(MEMORY_POOL_DEVICE) / (1024 * 1024) << " MB device, "
+                  << memory.Budget(MEMORY_POOL_HOST) / (1024 * 1024) << " MB host" << std::endl;
+    }
 
-    InitilizeBuffer(dt, inputVectorData, 1, K, STRIDE_ALIGH_BYTES, 4.0f);
-    InitilizeBuffer(dt, matrixData, M, K, STRIDE_ALIGH_BYTES, 2.0f);
-    InitilizeBuffer(dt, biasData, 1, M, STRIDE_ALIGH_BYTES, 3.0f);
+    // Tiled mode: the full matrix only lives in the upload heap, the default
+    // heap holds a two-slot window of row tiles (tiled_gemv.h). The plain
+    // dense GEMV switches to it when the budget cannot hold the matrix next
+    // to the vectors. The tiled shader is F32 only, so --precision runs are
+    // left to fail on the budget like the other modes.
+    const uint64_t denseDeviceBytes = uint64_t(inputVectorBufferSize) + matrixBufferSize + biasBufferSize + outputVectorBufferSize;
+    if (!tileBudget && !grouped && !sparse && !fused && !precision && denseDeviceBytes > memory.Budget(MEMORY_POOL_DEVICE)) {
+        tileBudget = memory.Budget(MEMORY_POOL_DEVICE);
+        std::cout << "Matrix does not fit the device budget, running tiled" << std::endl;
+    }
+    RowTilePlan tilePlan = {};
+    if (tileBudget) {
+        uint64_t residentBytes = uint64_t(inputVectorBufferSize) + biasBufferSize + outputVectorBufferSize;
+        tilePlan = PlanRowTiles(M, matrixStride, residentBytes, tileBudget);
+        if (tilePlan.numTiles == 0) {
+            std::cerr << "Budget of " << tileBudget << " bytes cannot hold " << residentBytes << " resident bytes plus two matrix rows" << std::endl;
+            return EXIT_FAILURE;
+        }
+        std::cout << "Tiled: " << tilePlan.numTiles << " tiles of " << tilePlan.rowsPerTile << " rows, "
+                  << tilePlan.WindowBytes() << " byte window for a " << matrixBufferSize << " byte matrix" << std::endl;
+    }
+    const bool tiled = tilePlan.numTiles != 0;
+    const uint32_t matrixWindowSize = tiled ? uint32_t(tilePlan.WindowBytes()) : matrixBufferSize;
+
+    // GPU timestamps when tracing: queries 0-1 bracket the upload copies,
+    // 2-3 the dispatch and readback copy, 4 + 2 * i the i-th tile step.
+    // Copy queues only support them with CopyQueueTimestampQueriesSupported.
+    const uint32_t numTileSteps = tiled ? uint32_t(BuildRowTileSchedule(tilePlan).size()) : 0;
+    const uint32_t numTimestamps = 4 + 2 * numTileSteps;
+
+    const wchar_t* shaderFile = grouped ? L"GroupedVectorMulAdd.cso" : sparse ? L"SparseVectorMulAdd.cso"
+                              : fused ? L"VectorMulAddScaleRelu.cso" : precision ? precision->shaderFile
+                              : tiled ? L"VectorMulAddTiled.cso" : L"CoopVectorMulAdd.cso";
 
     auto CreateBuffer = [](ComPtr<ID3D12Device>& device, uint32_t size, D3D12_RESOURCE_FLAGS flags, D3D12_RESOURCE_STATES initState, ComPtr<ID3D12Resource>& buffer) {
         CD3DX12_HEAP_PROPERTIES heapProps(D3D12_HEAP_TYPE_DEFAULT);
@@ -131,145 +573,385 @@ int main() {
         CheckHR(device->CreateCommittedResource(&heapProps, D3D12_HEAP_FLAG_NONE, &bufferDesc, D3D12_RESOURCE_STATE_COPY_DEST, nullptr, IID_PPV_ARGS(&buffer)));
     };
 
-    // Create input_vector_buffer
+    auto UploadData = [](ComPtr<ID3D12Resource>& uploadBuffer, const void* data, uint32_t size) {
+        void* mappedData;
+        CheckHR(uploadBuffer->Map(0, nullptr, &mappedData));
+        memcpy(mappedData, data, size);
+        uploadBuffer->Unmap(0, nullptr);
+    };
+
+    // Every buffer is charged to the memory account; a charge the budget
+    // refuses ends the run before the driver is asked for the memory.
+    std::mutex chargesMutex;
+    std::vector<MemoryCharge> charges;
+    auto Charge = [&](MemoryPool pool, MemoryCategory category, uint64_t bytes, const char* name) {
+        MemoryCharge charge(memory, pool, category, bytes, name);
+        if (!charge.Ok()) {
+            std::cerr << "The " << bytes << " byte " << name << " does not fit the " << MemoryPoolName(pool) << " memory budget" << std::endl;
+            exit(EXIT_FAILURE);
+        }
+        std::lock_guard<std::mutex> lock(chargesMutex);
+        charges.push_back(std::move(charge));
+    };
+
+    // Everything the startup stages produce
+    ComPtr<IDXGIAdapter1> adapter;
+    ComPtr<ID3D12Device> device;
+    ComPtr<ID3D12CommandQueue> commandQueue;
+    ComPtr<ID3D12CommandAllocator> commandAllocator;
+    ComPtr<ID3D12GraphicsCommandList> commandList;
+    ComPtr<ID3DBlob> computeShaderBlob;
+    ComPtr<ID3DBlob> serializedRootSignature;
+    ComPtr<ID3D12RootSignature> rootSignature;
+    ComPtr<ID3D12PipelineState> pipelineState;
     ComPtr<ID3D12Resource> inputVectorBuffer, matrixBuffer, biasBuffer, outputVectorBuffer;
     ComPtr<ID3D12Resource> inputVectorUploadBuffer, matrixUploadBuffer, biasUploadBuffer, outputReadbackBuffer;
+    ComPtr<ID3D12QueryHeap> timestampHeap;
+    ComPtr<ID3D12Resource> timestampReadbackBuffer;
+    bool copyQueueTimestamps = false;
+    ComPtr<ID3D12DescriptorHeap> descriptorHeap;
 
-    CreateBuffer(device, inputVectorBufferSize, D3D12_RESOURCE_FLAG_NONE, D3D12_RESOURCE_STATE_COMMON, inputVectorBuffer);
-    CreateBuffer(device, matrixBufferSize, D3D12_RESOURCE_FLAG_NONE, D3D12_RESOURCE_STATE_COMMON, matrixBuffer);
-    CreateBuffer(device, biasBufferSize, D3D12_RESOURCE_FLAG_NONE, D3D12_RESOURCE_STATE_COMMON, biasBuffer);
-    CreateBuffer(device, outputVectorBufferSize, D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS, D3D12_RESOURCE_STATE_COMMON, outputVectorBuffer);
+    std::vector<uint8_t> inputVectorData(inputVectorBufferSize, 0);
+    std::vector<uint8_t> matrixData(zeroCopy ? 0 : hostMatrixSize, 0);
+    std::vector<uint8_t> biasData(biasBufferSize, 0);
+    std::vector<uint8_t> outputData(outputVectorBufferSize, 0);
+    GemvGoldenStream goldenStream(dt, nullptr, 0, 0);
+    Sparse24Matrix sparseMatrix = {};
+    std::vector<float> rowScale;
+    EpilogueParams epilogueParams;
 
-    CreateUploadBuffer(device, inputVectorBufferSize, inputVectorUploadBuffer);
-    CreateUploadBuffer(device, matrixBufferSize, matrixUploadBuffer);
-    CreateUploadBuffer(device, biasBufferSize, biasUploadBuffer);
+    // Startup as a task graph (startup_graph.h). The device, the shader file
+    // and the root signature blob do not depend on each other, and host data
+    // only feeds buffer creation and upload, so all four start at once; the
+    // dense matrix is generated on all executors straight into the upload
+    // heap.
+    StartupGraph startup;
 
-    CreateReadBackBuffer(device, outputVectorBufferSize, outputReadbackBuffer);
+    // The first adapter that takes a device keeps it: no probe device that
+    // is thrown away and created again.
+    StartupGraph::StageId deviceStage = startup.Add("create device", {}, [&] {
+        for (UINT adapterIndex = 0; DXGI_ERROR_NOT_FOUND != factory->EnumAdapters1(adapterIndex, &adapter); ++adapterIndex) {
+            DXGI_ADAPTER_DESC1 desc;
+            adapter->GetDesc1(&desc);
 
-    D3D12_DESCRIPTOR_HEAP_DESC heapDesc = {};
-    heapDesc.NumDescriptors = 4; // Number of descriptors
-    heapDesc.Type = D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV;
-    heapDesc.Flags = D3D12_DESCRIPTOR_HEAP_FLAG_SHADER_VISIBLE;
-    
-    ComPtr<ID3D12DescriptorHeap> descriptorHeap;
-    CheckHR(device->CreateDescriptorHeap(&heapDesc, IID_PPV_ARGS(&descriptorHeap)));
-
-    // Populate the descriptor heap with SRVs
-    D3D12_CPU_DESCRIPTOR_HANDLE handle = descriptorHeap->GetCPUDescriptorHandleForHeapStart();
-
-    // SRV for inputVectorBuffer
-    D3D12_SHADER_RESOURCE_VIEW_DESC srvDesc = {};
-    srvDesc.ViewDimension = D3D12_SRV_DIMENSION_BUFFER;
-    srvDesc.Shader4ComponentMapping = D3D12_DEFAULT_SHADER_4_COMPONENT_MAPPING;
-    srvDesc.Buffer.FirstElement = 0;
-    srvDesc.Buffer.StructureByteStride = 0;
-    srvDesc.Buffer.Flags = D3D12_BUFFER_SRV_FLAG_RAW; // Use raw buffer flag for raw buffers
-    srvDesc.Format = DXGI_FORMAT_R32_TYPELESS; // Use a typeless format for raw buffers
-
-    srvDesc.Buffer.NumElements = inputVectorBufferSize / SizeofType(dt);
-    device->CreateShaderResourceView(inputVectorBuffer.Get(), &srvDesc, handle);
-    handle.ptr += device->GetDescriptorHandleIncrementSize(D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV);
-
-    srvDesc.Buffer.NumElements = matrixBufferSize / SizeofType(dt);
-    device->CreateShaderResourceView(matrixBuffer.Get(), &srvDesc, handle);
-    handle.ptr += device->GetDescriptorHandleIncrementSize(D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV);
-
-    srvDesc.Buffer.NumElements = biasBufferSize / SizeofType(dt);
-    device->CreateShaderResourceView(biasBuffer.Get(), &srvDesc, handle);
-    handle.ptr += device->GetDescriptorHandleIncrementSize(D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV);
-
-    // Add UAV for output_vector_buffer
-    D3D12_UNORDERED_ACCESS_VIEW_DESC uavDesc = {};
-    uavDesc.ViewDimension = D3D12_UAV_DIMENSION_BUFFER;
-    uavDesc.Buffer.FirstElement = 0;
-    uavDesc.Buffer.CounterOffsetInBytes = 0;
-    uavDesc.Buffer.NumElements = outputVectorBufferSize / SizeofType(dt); // Assuming float elements
-    // uavDesc.Buffer.StructureByteStride = SizeofType(dt);
-    // uavDesc.Format = DXGI_FORMAT_UNKNOWN;
-    uavDesc.Buffer.StructureByteStride = 0;
-    uavDesc.Buffer.Flags = D3D12_BUFFER_UAV_FLAG_RAW; // Use raw buffer flag for raw buffers
-    uavDesc.Format = DXGI_FORMAT_R32_TYPELESS;
-    device->CreateUnorderedAccessView(outputVectorBuffer.Get(), nullptr, &uavDesc, handle);
+            if (desc.Flags & DXGI_ADAPTER_FLAG_SOFTWARE) continue;
 
-    auto UploadData = [](ComPtr<ID3D12Resource>& uploadBuffer, const void* data, uint32_t size) {
-        void* mappedData;
-        CheckHR(uploadBuffer->Map(0, nullptr, &mappedData));
-        memcpy(mappedData, data, size);
-        uploadBuffer->Unmap(0, nullptr);
-    };
+            if (SUCCEEDED(D3D12CreateDevice(adapter.Get(), D3D_FEATURE_LEVEL_12_0, IID_PPV_ARGS(&device)))) {
+                break;
+            }
+        }
+        if (!device) {
+            std::cerr << "No DirectX 12 compatible GPU found." << std::endl;
+            exit(EXIT_FAILURE);
+        }
 
-    UploadData(inputVectorUploadBuffer, inputVectorData.data(), inputVectorBufferSize);
-    UploadData(matrixUploadBuffer, matrixData.data(), matrixBufferSize);
-    UploadData(biasUploadBuffer, biasData.data(), biasBufferSize);
+        // D3D12_FEATURE_DATA_SHADER_MODEL shaderModel = { D3D_SHADER_MODEL_6_9 };
+        // if (FAILED(device->CheckFeatureSupport(D3D12_FEATURE_SHADER_MODEL, &shaderModel, sizeof(shaderModel)))) {
+        //     std::cerr << "Shader Model 6.9 is not supported by the current driver." << std::endl;
+        //     exit(EXIT_FAILURE);
+        // }
+    });
 
-    auto TransitionResource = [](ComPtr<ID3D12GraphicsCommandList>& commandList, ComPtr<ID3D12Resource>& resource, D3D12_RESOURCE_STATES beforeState, D3D12_RESOURCE_STATES afterState) {
-        CD3DX12_RESOURCE_BARRIER barrier = CD3DX12_RESOURCE_BARRIER::Transition(resource.Get(), beforeState, afterState);
-        commandList->ResourceBarrier(1, &barrier);
-    };
+    StartupGraph::StageId shaderStage = startup.Add("read shader", {}, [&] {
+        CheckHR(D3DReadFileToBlob(shaderFile, &computeShaderBlob));
+    });
 
-    TransitionResource(commandList, inputVectorBuffer, D3D12_RESOURCE_STATE_COMMON, D3D12_RESOURCE_STATE_COPY_DEST);
-    TransitionResource(commandList, matrixBuffer, D3D12_RESOURCE_STATE_COMMON, D3D12_RESOURCE_STATE_COPY_DEST);
-    TransitionResource(commandList, biasBuffer, D3D12_RESOURCE_STATE_COMMON, D3D12_RESOURCE_STATE_COPY_DEST);
-    TransitionResource(commandList, outputVectorBuffer, D3D12_RESOURCE_STATE_COMMON, D3D12_RESOURCE_STATE_UNORDERED_ACCESS);
+    StartupGraph::StageId rootBlobStage = startup.Add("serialize root signature", {}, [&] {
+        D3D12_DESCRIPTOR_RANGE srvRange = {};
+        srvRange.RangeType = D3D12_DESCRIPTOR_RANGE_TYPE_SRV;
+        srvRange.NumDescriptors = numSrvs; // input_vector_buffer, matrix_buffer, bias_buffer + extraSrvs
+        srvRange.BaseShaderRegister = 0;
+        srvRange.RegisterSpace = 0;
+        srvRange.OffsetInDescriptorsFromTableStart = D3D12_DESCRIPTOR_RANGE_OFFSET_APPEND;
 
-    commandList->CopyBufferRegion(inputVectorBuffer.Get(), 0, inputVectorUploadBuffer.Get(), 0, inputVectorBufferSize);
-    commandList->CopyBufferRegion(matrixBuffer.Get(), 0, matrixUploadBuffer.Get(), 0, matrixBufferSize);
-    commandList->CopyBufferRegion(biasBuffer.Get(), 0, biasUploadBuffer.Get(), 0, biasBufferSize);
+        D3D12_ROOT_PARAMETER rootParameters[3] = {};
+        rootParameters[0].ParameterType = D3D12_ROOT_PARAMETER_TYPE_DESCRIPTOR_TABLE;
+        rootParameters[0].ShaderVisibility = D3D12_SHADER_VISIBILITY_ALL;
+        rootParameters[0].DescriptorTable.NumDescriptorRanges = 1;
+        rootParameters[0].DescriptorTable.pDescriptorRanges = &srvRange;
 
-    TransitionResource(commandList, inputVectorBuffer, D3D12_RESOURCE_STATE_COPY_DEST, D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE);
-    TransitionResource(commandList, matrixBuffer, D3D12_RESOURCE_STATE_COPY_DEST, D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE);
-    TransitionResource(commandList, biasBuffer, D3D12_RESOURCE_STATE_COPY_DEST, D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE);
+        D3D12_DESCRIPTOR_RANGE uavRange = {};
+        uavRange.RangeType = D3D12_DESCRIPTOR_RANGE_TYPE_UAV;
+        uavRange.NumDescriptors = 1;
+        uavRange.BaseShaderRegister = 0;
+        uavRange.RegisterSpace = 0;
+        uavRange.OffsetInDescriptorsFromTableStart = D3D12_DESCRIPTOR_RANGE_OFFSET_APPEND;
 
-    // Load and create the compute shader
-    ComPtr<ID3DBlob> computeShaderBlob;
-    ComPtr<ID3D12PipelineState> pipelineState;
-    ComPtr<ID3D12RootSignature> rootSignature;
+        rootParameters[1].ParameterType = D3D12_ROOT_PARAMETER_TYPE_DESCRIPTOR_TABLE;
+        rootParameters[1].ShaderVisibility = D3D12_SHADER_VISIBILITY_ALL;
+        rootParameters[1].DescriptorTable.NumDescriptorRanges = 1;
+        rootParameters[1].DescriptorTable.pDescriptorRanges = &uavRange;
+
+        // Tile constants at b0: row begin, row count, slot offset in the window
+        rootParameters[2].ParameterType = D3D12_ROOT_PARAMETER_TYPE_32BIT_CONSTANTS;
+        rootParameters[2].ShaderVisibility = D3D12_SHADER_VISIBILITY_ALL;
+        rootParameters[2].Constants.ShaderRegister = 0;
+        rootParameters[2].Constants.RegisterSpace = 0;
+        rootParameters[2].Constants.Num32BitValues = 3;
+
+        D3D12_ROOT_SIGNATURE_DESC rootSignatureDesc = {};
+        rootSignatureDesc.NumParameters = tiled ? 3 : 2;
+        rootSignatureDesc.pParameters = rootParameters;
+        rootSignatureDesc.Flags = D3D12_ROOT_SIGNATURE_FLAG_NONE;
+
+        ComPtr<ID3DBlob> errorBlob;
+        CheckHR(D3D12SerializeRootSignature(&rootSignatureDesc, D3D_ROOT_SIGNATURE_VERSION_1, &serializedRootSignature, &errorBlob));
+    });
+
+    StartupGraph::StageId hostStage = startup.Add("host data", {}, [&] {
+        Charge(MEMORY_POOL_SYSTEM, MEMORY_ACTIVATIONS, inputVectorData.size() + biasData.size() + outputData.size(), "host vectors");
+        Charge(MEMORY_POOL_SYSTEM, MEMORY_WEIGHTS, matrixData.size(), "host matrix");
+        if (grouped) {
+            for (uint32_t i = 0; i < groupEntries.size(); ++i) {
+                const GemvGroupEntry& e = groupEntries[i];
+                for (uint32_t k = 0; k < e.K; ++k) {
+                    SetDataFloat(inputVectorData.data(), dt, e.inputOffset, k, 1.0f + i);
+                }
+                for (uint32_t m = 0; m < e.M; ++m) {
+                    for (uint32_t k = 0; k < e.K; ++k) {
+                        SetDataFloat(matrixData.data(), dt, e.matrixOffset + m * e.strideK, k, float((m + k) % 4));
+                    }
+                    SetDataFloat(biasData.data(), dt, e.biasOffset, m, float(i));
+                }
+            }
+            extraSrvs[0].data.assign((uint8_t*)groupEntries.data(), (uint8_t*)(groupEntries.data() + groupEntries.size()));
+            extraSrvs[1].data.assign((uint8_t*)groupTiles.data(), (uint8_t*)(groupTiles.data() + groupTiles.size()));
+        } else {
+            InitilizeBuffer(types.input, inputVectorData, 1, K, matrixStride, 4.0f);
+            if (!zeroCopy) InitilizeBuffer(types.matrix, matrixData, M, K, matrixStride, 2.0f);
+            InitilizeBuffer(types.bias, biasData, 1, M, matrixStride, 3.0f);
+        }
+
+        // Sparse mode: the matrix buffer holds the 2:4 compressed values and
+        // the metadata goes to t3. matrixData becomes the pruned dense
+        // matrix, which is what the golden is computed from.
+        if (sparse) {
+            uint32_t strideK = AlignTo(SizeofType(dt) * K, STRIDE_ALIGH_BYTES);
+            sparseMatrix = PackSparse24(dt, matrixData.data(), M, K, strideK, STRIDE_ALIGH_BYTES);
+            UnpackSparse24(sparseMatrix, matrixData.data(), strideK);
+            extraSrvs[0].data = sparseMatrix.metadata;
+        }
+
+        if (fused) {
+            for (uint32_t m = 0; m < M; ++m) {
+                rowScale.push_back(0.5f + 0.25f * (m % 4));
+                SetDataFloat(biasData.data(), dt, 0, m, m % 2 ? -1000.0f : 3.0f);
+            }
+            epilogueParams.rowScale = rowScale.data();
+            extraSrvs[0].data.assign((uint8_t*)rowScale.data(), (uint8_t*)(rowScale.data() + rowScale.size()));
+        }
+    });
+
+    startup.Add("create queue and command list", { deviceStage }, [&] {
+        D3D12_COMMAND_QUEUE_DESC queueDesc = {};
+        queueDesc.Type = D3D12_COMMAND_LIST_TYPE_COMPUTE;
+        queueDesc.Flags = D3D12_COMMAND_QUEUE_FLAG_NONE;
+        CheckHR(device->CreateCommandQueue(&queueDesc, IID_PPV_ARGS(&commandQueue)));
+        CheckHR(device->CreateCommandAllocator(D3D12_COMMAND_LIST_TYPE_COMPUTE, IID_PPV_ARGS(&commandAllocator)));
+        CheckHR(device->CreateCommandList(0, D3D12_COMMAND_LIST_TYPE_COMPUTE, commandAllocator.Get(), nullptr, IID_PPV_ARGS(&commandList)));
+    });
+
+    StartupGraph::StageId buffersStage = startup.Add("create buffers", { deviceStage, hostStage }, [&] {
+        uint64_t extraBytes = 0;
+        for (ExtraSrv& extra : extraSrvs) extraBytes += extra.data.size();
+        Charge(MEMORY_POOL_DEVICE, MEMORY_ACTIVATIONS, uint64_t(inputVectorBufferSize) + biasBufferSize + outputVectorBufferSize, "vector buffers");
+        Charge(MEMORY_POOL_DEVICE, MEMORY_WEIGHTS, uint64_t(matrixWindowSize) + extraBytes, tiled ? "tile window" : "matrix buffer");
+        Charge(MEMORY_POOL_HOST, MEMORY_UPLOAD, uint64_t(inputVectorBufferSize) + matrixBufferSize + biasBufferSize + extraBytes, "upload buffers");
+        Charge(MEMORY_POOL_HOST, MEMORY_READBACK, outputVectorBufferSize + (gpuTimestamps ? numTimestamps * sizeof(uint64_t) : 0), "readback buffers");
+
+        CreateBuffer(device, inputVectorBufferSize, D3D12_RESOURCE_FLAG_NONE, D3D12_RESOURCE_STATE_COMMON, inputVectorBuffer);
+        CreateBuffer(device, matrixWindowSize, D3D12_RESOURCE_FLAG_NONE, D3D12_RESOURCE_STATE_COMMON, matrixBuffer);
+        CreateBuffer(device, biasBufferSize, D3D12_RESOURCE_FLAG_NONE, D3D12_RESOURCE_STATE_COMMON, biasBuffer);
+        CreateBuffer(device, outputVectorBufferSize, D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS, D3D12_RESOURCE_STATE_COMMON, outputVectorBuffer);
+
+        CreateUploadBuffer(device, inputVectorBufferSize, inputVectorUploadBuffer);
+        CreateUploadBuffer(device, matrixBufferSize, matrixUploadBuffer);
+        CreateUploadBuffer(device, biasBufferSize, biasUploadBuffer);
+
+        CreateReadBackBuffer(device, outputVectorBufferSize, outputReadbackBuffer);
 
-    CheckHR(D3DReadFileToBlob(L"CoopVectorMulAdd.cso", &computeShaderBlob));
+        for (ExtraSrv& extra : extraSrvs) {
+            CreateBuffer(device, uint32_t(extra.data.size()), D3D12_RESOURCE_FLAG_NONE, D3D12_RESOURCE_STATE_COMMON, extra.buffer);
+            CreateUploadBuffer(device, uint32_t(extra.data.size()), extra.uploadBuffer);
+        }
+
+        if (gpuTimestamps) {
+            D3D12_QUERY_HEAP_DESC queryHeapDesc = {};
+            queryHeapDesc.Type = D3D12_QUERY_HEAP_TYPE_TIMESTAMP;
+            queryHeapDesc.Count = numTimestamps;
+            CheckHR(device->CreateQueryHeap(&queryHeapDesc, IID_PPV_ARGS(&timestampHeap)));
+            CreateReadBackBuffer(device, numTimestamps * sizeof(uint64_t), timestampReadbackBuffer);
+            D3D12_FEATURE_DATA_D3D12_OPTIONS3 options3 = {};
+            if (SUCCEEDED(device->CheckFeatureSupport(D3D12_FEATURE_D3D12_OPTIONS3, &options3, sizeof(options3)))) {
+                copyQueueTimestamps = options3.CopyQueueTimestampQueriesSupported;
+            }
+        }
+    });
+
+    startup.Add("create descriptors", { buffersStage }, [&] {
+        D3D12_DESCRIPTOR_HEAP_DESC heapDesc = {};
+        heapDesc.NumDescriptors = numSrvs + 1; // Number of descriptors
+        heapDesc.Type = D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV;
+        heapDesc.Flags = D3D12_DESCRIPTOR_HEAP_FLAG_SHADER_VISIBLE;
+        Charge(MEMORY_POOL_DEVICE, MEMORY_DESCRIPTORS, uint64_t(heapDesc.NumDescriptors) * device->GetDescriptorHandleIncrementSize(D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV), "descriptor heap");
+        CheckHR(device->CreateDescriptorHeap(&heapDesc, IID_PPV_ARGS(&descriptorHeap)));
+
+        // Populate the descriptor heap with SRVs
+        D3D12_CPU_DESCRIPTOR_HANDLE handle = descriptorHeap->GetCPUDescriptorHandleForHeapStart();
+
+        // SRV for inputVectorBuffer
+        D3D12_SHADER_RESOURCE_VIEW_DESC srvDesc = {};
+        srvDesc.ViewDimension = D3D12_SRV_DIMENSION_BUFFER;
+        srvDesc.Shader4ComponentMapping = D3D12_DEFAULT_SHADER_4_COMPONENT_MAPPING;
+        srvDesc.Buffer.FirstElement = 0;
+        srvDesc.Buffer.StructureByteStride = 0;
+        srvDesc.Buffer.Flags = D3D12_BUFFER_SRV_FLAG_RAW; // Use raw buffer flag for raw buffers
+        srvDesc.Format = DXGI_FORMAT_R32_TYPELESS; // Use a typeless format for raw buffers
+
+        srvDesc.Buffer.NumElements = inputVectorBufferSize / sizeof(uint32_t);
+        device->CreateShaderResourceView(inputVectorBuffer.Get(), &srvDesc, handle);
+        handle.ptr += device->GetDescriptorHandleIncrementSize(D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV);
+
+        srvDesc.Buffer.NumElements = matrixWindowSize / sizeof(uint32_t);
+        device->CreateShaderResourceView(matrixBuffer.Get(), &srvDesc, handle);
+        handle.ptr += device->GetDescriptorHandleIncrementSize(D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV);
+
+        srvDesc.Buffer.NumElements = biasBufferSize / sizeof(uint32_t);
+        device->CreateShaderResourceView(biasBuffer.Get(), &srvDesc, handle);
+        handle.ptr += device->GetDescriptorHandleIncrementSize(D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV);
+
+        for (ExtraSrv& extra : extraSrvs) {
+            srvDesc.Buffer.NumElements = uint32_t(extra.data.size() / sizeof(uint32_t));
+            device->CreateShaderResourceView(extra.buffer.Get(), &srvDesc, handle);
+            handle.ptr += device->GetDescriptorHandleIncrementSize(D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV);
+        }
+
+        // Add UAV for output_vector_buffer
+        D3D12_UNORDERED_ACCESS_VIEW_DESC uavDesc = {};
+        uavDesc.ViewDimension = D3D12_UAV_DIMENSION_BUFFER;
+        uavDesc.Buffer.FirstElement = 0;
+        uavDesc.Buffer.CounterOffsetInBytes = 0;
+        uavDesc.Buffer.NumElements = outputVectorBufferSize / sizeof(uint32_t); // 32-bit words of the raw view
+        // uavDesc.Buffer.StructureByteStride = SizeofType(dt);
+        // uavDesc.Format = DXGI_FORMAT_UNKNOWN;
+        uavDesc.Buffer.StructureByteStride = 0;
+        uavDesc.Buffer.Flags = D3D12_BUFFER_UAV_FLAG_RAW; // Use raw buffer flag for raw buffers
+        uavDesc.Format = DXGI_FORMAT_R32_TYPELESS;
+        device->CreateUnorderedAccessView(outputVectorBuffer.Get(), nullptr, &uavDesc, handle);
+    });
+
+    startup.Add("upload", { buffersStage, hostStage }, [&] {
+        UploadData(inputVectorUploadBuffer, inputVectorData.data(), inputVectorBufferSize);
+        if (zeroCopy) {
+            goldenStream = GemvGoldenStream(dt, inputVectorData.data(), M, K);
+            void* mappedMatrix;
+            CheckHR(matrixUploadBuffer->Map(0, nullptr, &mappedMatrix));
+            ParallelStreamRows(pool, mappedMatrix, M, STRIDE_ALIGH_BYTES, STRIDE_ALIGH_BYTES,
+                [&](uint32_t, uint8_t* row) {
+                    for (uint32_t k = 0; k < K; ++k) SetDataFloat(row, dt, 0, k, 2.0f);
+                },
+                [&](uint32_t m, uint8_t const* row) { goldenStream.Row(m, row); });
+            matrixUploadBuffer->Unmap(0, nullptr);
+        } else {
+            UploadData(matrixUploadBuffer, sparse ? sparseMatrix.values.data() : matrixData.data(), matrixBufferSize);
+        }
+        UploadData(biasUploadBuffer, biasData.data(), biasBufferSize);
+        for (ExtraSrv& extra : extraSrvs) {
+            UploadData(extra.uploadBuffer, extra.data.data(), uint32_t(extra.data.size()));
+        }
+    });
+
+    StartupGraph::StageId rootSignatureStage = startup.Add("create root signature", { deviceStage, rootBlobStage }, [&] {
+        CheckHR(device->CreateRootSignature(0, serializedRootSignature->GetBufferPointer(), serializedRootSignature->GetBufferSize(), IID_PPV_ARGS(&rootSignature)));
+    });
+
+    startup.Add("create pipeline state", { rootSignatureStage, shaderStage }, [&] {
+        D3D12_COMPUTE_PIPELINE_STATE_DESC pipelineStateDesc = {};
+        pipelineStateDesc.pRootSignature = rootSignature.Get();
+        pipelineStateDesc.CS = { computeShaderBlob->GetBufferPointer(), computeShaderBlob->GetBufferSize() };
+        CheckHR(device->CreateComputePipelineState(&pipelineStateDesc, IID_PPV_ARGS(&pipelineState)));
+    });
+
+    startup.Run(pool);
     std::cout << "Compute shader loaded successfully!" << std::endl;
-    
-    D3D12_DESCRIPTOR_RANGE srvRange = {};
-    srvRange.RangeType = D3D12_DESCRIPTOR_RANGE_TYPE_SRV;
-    srvRange.NumDescriptors = 3; // Number of SRVs: input_vector_buffer, matrix_buffer, bias_buffer
-    srvRange.BaseShaderRegister = 0;
-    srvRange.RegisterSpace = 0;
-    srvRange.OffsetInDescriptorsFromTableStart = D3D12_DESCRIPTOR_RANGE_OFFSET_APPEND;
-    
-    D3D12_ROOT_PARAMETER rootParameters[2] = {};
-    rootParameters[0].ParameterType = D3D12_ROOT_PARAMETER_TYPE_DESCRIPTOR_TABLE;
-    rootParameters[0].ShaderVisibility = D3D12_SHADER_VISIBILITY_ALL;
-    rootParameters[0].DescriptorTable.NumDescriptorRanges = 1;
-    rootParameters[0].DescriptorTable.pDescriptorRanges = &srvRange;
-    
-    D3D12_DESCRIPTOR_RANGE uavRange = {};
-    uavRange.RangeType = D3D12_DESCRIPTOR_RANGE_TYPE_UAV;
-    uavRange.NumDescriptors = 1;
-    uavRange.BaseShaderRegister = 0;
-    uavRange.RegisterSpace = 0;
-    uavRange.OffsetInDescriptorsFromTableStart = D3D12_DESCRIPTOR_RANGE_OFFSET_APPEND;
-
-    rootParameters[1].ParameterType = D3D12_ROOT_PARAMETER_TYPE_DESCRIPTOR_TABLE;
-    rootParameters[1].ShaderVisibility = D3D12_SHADER_VISIBILITY_ALL;
-    rootParameters[1].DescriptorTable.NumDescriptorRanges = 1;
-    rootParameters[1].DescriptorTable.pDescriptorRanges = &uavRange;
+    if (sparse) {
+        std::cout << "2:4 sparse matrix: " << sparseMatrix.SizeInBytes() << " bytes instead of " << matrixData.size() << std::endl;
+    }
+    startup.Report(std::cout);
 
-    D3D12_ROOT_SIGNATURE_DESC rootSignatureDesc = {};
-    rootSignatureDesc.NumParameters = _countof(rootParameters);
-    rootSignatureDesc.pParameters = rootParameters;
-    rootSignatureDesc.Flags = D3D12_ROOT_SIGNATURE_FLAG_NONE;
+    auto Timestamp = [&](ComPtr<ID3D12GraphicsCommandList>& list, uint32_t index) {
+        if (gpuTimestamps) list->EndQuery(timestampHeap.Get(), D3D12_QUERY_TYPE_TIMESTAMP, index);
+    };
+    auto ResolveTimestamps = [&](ComPtr<ID3D12GraphicsCommandList>& list, uint32_t first) {
+        if (gpuTimestamps) list->ResolveQueryData(timestampHeap.Get(), D3D12_QUERY_TYPE_TIMESTAMP, first, 2, timestampReadbackBuffer.Get(), first * sizeof(uint64_t));
+    };
 
-    ComPtr<ID3DBlob> serializedRootSignature;
-    ComPtr<ID3DBlob> errorBlob;
-    CheckHR(D3D12SerializeRootSignature(&rootSignatureDesc, D3D_ROOT_SIGNATURE_VERSION_1, &serializedRootSignature, &errorBlob));
-    CheckHR(device->CreateRootSignature(0, serializedRootSignature->GetBufferPointer(), serializedRootSignature->GetBufferSize(), IID_PPV_ARGS(&rootSignature)));
+    // Every state change of the main list comes from the compute graph
+    // (compute_graph.h): the ops declare what they read and write, and the
+    // transitions of one level go out in a single ResourceBarrier call.
+    ComputeGraph graph;
+    graph.SetSplitBarriers(splitBarriers);
+    std::vector<ID3D12Resource*> graphResources;
+    auto AddGraphResource = [&](const char* name, ComPtr<ID3D12Resource>& resource) {
+        graphResources.push_back(resource.Get());
+        return graph.AddResource(name, GRAPH_STATE_COMMON);
+    };
+    auto ToD3D12State = [](GraphState state) {
+        D3D12_RESOURCE_STATES d3dState = D3D12_RESOURCE_STATE_COMMON;
+        if (state & GRAPH_STATE_COPY_DEST) d3dState |= D3D12_RESOURCE_STATE_COPY_DEST;
+        if (state & GRAPH_STATE_COPY_SOURCE) d3dState |= D3D12_RESOURCE_STATE_COPY_SOURCE;
+        if (state & GRAPH_STATE_SHADER_READ) d3dState |= D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE;
+        if (state & GRAPH_STATE_UNORDERED_ACCESS) d3dState |= D3D12_RESOURCE_STATE_UNORDERED_ACCESS;
+        return d3dState;
+    };
+    auto IssueBarriers = [&](std::vector<GraphBarrier> const& batch) {
+        std::vector<D3D12_RESOURCE_BARRIER> barriers;
+        for (GraphBarrier const& b : batch) {
+            ID3D12Resource* resource = graphResources[b.resource];
+            if (b.type == GRAPH_BARRIER_UAV) {
+                barriers.push_back(CD3DX12_RESOURCE_BARRIER::UAV(resource));
+                continue;
+            }
+            D3D12_RESOURCE_BARRIER_FLAGS flags = b.split == GRAPH_BARRIER_BEGIN_ONLY ? D3D12_RESOURCE_BARRIER_FLAG_BEGIN_ONLY
+                                               : b.split == GRAPH_BARRIER_END_ONLY   ? D3D12_RESOURCE_BARRIER_FLAG_END_ONLY
+                                                                                     : D3D12_RESOURCE_BARRIER_FLAG_NONE;
+            barriers.push_back(CD3DX12_RESOURCE_BARRIER::Transition(resource, ToD3D12State(b.before), ToD3D12State(b.after),
+                                                                    D3D12_RESOURCE_BARRIER_ALL_SUBRESOURCES, flags));
+        }
+        commandList->ResourceBarrier(UINT(barriers.size()), barriers.data());
+    };
+    auto inputRes = AddGraphResource("input", inputVectorBuffer);
+    auto matrixRes = AddGraphResource("matrix", matrixBuffer);
+    auto biasRes = AddGraphResource("bias", biasBuffer);
+    auto outputRes = AddGraphResource("output", outputVectorBuffer);
+    std::vector<ComputeGraph::ResourceId> extraRes;
+    for (ExtraSrv& extra : extraSrvs) extraRes.push_back(AddGraphResource("extra srv", extra.buffer));
 
-    // Create pipeline state
-    D3D12_COMPUTE_PIPELINE_STATE_DESC pipelineStateDesc = {};
-    pipelineStateDesc.pRootSignature = rootSignature.Get();
-    pipelineStateDesc.CS = { computeShaderBlob->GetBufferPointer(), computeShaderBlob->GetBufferSize() };
-    CheckHR(device->CreateComputePipelineState(&pipelineStateDesc, IID_PPV_ARGS(&pipelineState)));
+    TraceScope recordSpan("record commands");
+    Timestamp(commandList, 0);
+    graph.AddOp("upload input", { GraphWrite(inputRes, GRAPH_STATE_COPY_DEST) }, [&] {
+        commandList->CopyBufferRegion(inputVectorBuffer.Get(), 0, inputVectorUploadBuffer.Get(), 0, inputVectorBufferSize);
+    });
+    if (!tiled) {
+        graph.AddOp("upload matrix", { GraphWrite(matrixRes, GRAPH_STATE_COPY_DEST) }, [&] {
+            commandList->CopyBufferRegion(matrixBuffer.Get(), 0, matrixUploadBuffer.Get(), 0, matrixBufferSize);
+        });
+    }
+    graph.AddOp("upload bias", { GraphWrite(biasRes, GRAPH_STATE_COPY_DEST) }, [&] {
+        commandList->CopyBufferRegion(biasBuffer.Get(), 0, biasUploadBuffer.Get(), 0, biasBufferSize);
+    });
+    for (uint32_t i = 0; i < extraSrvs.size(); ++i) {
+        graph.AddOp("upload extra srv", { GraphWrite(extraRes[i], GRAPH_STATE_COPY_DEST) }, [&, &extra = extraSrvs[i]] {
+            commandList->CopyBufferRegion(extra.buffer.Get(), 0, extra.uploadBuffer.Get(), 0, extra.data.size());
+        });
+    }
+    graph.Execute(IssueBarriers);
+    Timestamp(commandList, 1);
+    ResolveTimestamps(commandList, 0);
+    recordSpan.End();
 
     // Set up the compute shader
+    TraceScope submitSpan("record and submit dispatch");
     commandList->SetPipelineState(pipelineState.Get());
     commandList->SetComputeRootSignature(rootSignature.Get());
 
@@ -278,21 +960,115 @@ int main() {
     commandList->SetDescriptorHeaps(_countof(heaps), heaps);
     commandList->SetComputeRootDescriptorTable(0, descriptorHeap->GetGPUDescriptorHandleForHeapStart());
     commandList->SetComputeRootDescriptorTable(1, CD3DX12_GPU_DESCRIPTOR_HANDLE(
-        descriptorHeap->GetGPUDescriptorHandleForHeapStart(), 3, device->GetDescriptorHandleIncrementSize(D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV)));
+        descriptorHeap->GetGPUDescriptorHandleForHeapStart(), numSrvs, device->GetDescriptorHandleIncrementSize(D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV)));
 
-    // Dispatch compute shader
-    commandList->Dispatch(1, 1, 1);
-
-    // Transition output buffer to copy source
-    TransitionResource(commandList, outputVectorBuffer, D3D12_RESOURCE_STATE_UNORDERED_ACCESS, D3D12_RESOURCE_STATE_COPY_SOURCE);
-    commandList->CopyBufferRegion(outputReadbackBuffer.Get(), 0, outputVectorBuffer.Get(), 0, outputVectorBufferSize);
+    // Dispatch compute shader, then copy the output to the readback buffer
+    if (!tiled) {
+        UINT groupCountX = grouped ? UINT(groupTiles.size()) : (sparse || fused) ? (M + THREAD_GROUP_SIZE - 1) / THREAD_GROUP_SIZE : 1;
+        std::vector<GraphAccess> dispatchAccesses = { GraphRead(inputRes, GRAPH_STATE_SHADER_READ), GraphRead(matrixRes, GRAPH_STATE_SHADER_READ),
+                                                      GraphRead(biasRes, GRAPH_STATE_SHADER_READ), GraphWrite(outputRes, GRAPH_STATE_UNORDERED_ACCESS) };
+        for (ComputeGraph::ResourceId res : extraRes) dispatchAccesses.push_back(GraphRead(res, GRAPH_STATE_SHADER_READ));
+        graph.AddOp("dispatch", dispatchAccesses, [&] {
+            Timestamp(commandList, 2);
+            commandList->Dispatch(groupCountX, 1, 1);
+        });
+        graph.AddOp("readback output", { GraphRead(outputRes, GRAPH_STATE_COPY_SOURCE) }, [&] {
+            commandList->CopyBufferRegion(outputReadbackBuffer.Get(), 0, outputVectorBuffer.Get(), 0, outputVectorBufferSize);
+            Timestamp(commandList, 3);
+            ResolveTimestamps(commandList, 2);
+        });
+        graph.Execute(IssueBarriers);
+    }
 
     // Close and execute command list
     CheckHR(commandList->Close());
     ID3D12CommandList* commandLists[] = { commandList.Get() };
     commandQueue->ExecuteCommandLists(_countof(commandLists), commandLists);
+    graph.Decay();
+    submitSpan.End();
+    if (!tiled) std::cout << "Time to first dispatch: " << startupTimer.ElapsedMs() << " ms" << std::endl;
+
+    // Tiled mode: a copy queue streams tile t + 1 into the window while the
+    // compute queue multiplies tile t, ordered by the two fences of
+    // BuildRowTileSchedule. Buffers are promoted from and decay to COMMON
+    // implicitly, so no barriers are needed between the queues. One
+    // allocator and list per step, alive until the final fence wait.
+    std::vector<ComPtr<ID3D12CommandAllocator>> tileAllocators;
+    std::vector<ComPtr<ID3D12GraphicsCommandList>> tileLists;
+    ComPtr<ID3D12CommandQueue> copyQueue;
+    ComPtr<ID3D12Fence> copyFence, computeFence;
+    if (tiled) {
+        TRACE_SCOPE("record and submit tile steps");
+        D3D12_COMMAND_QUEUE_DESC copyQueueDesc = {};
+        copyQueueDesc.Type = D3D12_COMMAND_LIST_TYPE_COPY;
+        copyQueueDesc.Flags = D3D12_COMMAND_QUEUE_FLAG_NONE;
+        CheckHR(device->CreateCommandQueue(&copyQueueDesc, IID_PPV_ARGS(&copyQueue)));
+        CheckHR(device->CreateFence(0, D3D12_FENCE_FLAG_NONE, IID_PPV_ARGS(&copyFence)));
+        CheckHR(device->CreateFence(0, D3D12_FENCE_FLAG_NONE, IID_PPV_ARGS(&computeFence)));
+
+        auto CreateTileList = [&](D3D12_COMMAND_LIST_TYPE type, ID3D12PipelineState* pso) {
+            ComPtr<ID3D12CommandAllocator> allocator;
+            ComPtr<ID3D12GraphicsCommandList> list;
+            CheckHR(device->CreateCommandAllocator(type, IID_PPV_ARGS(&allocator)));
+            CheckHR(device->CreateCommandList(0, type, allocator.Get(), pso, IID_PPV_ARGS(&list)));
+            tileAllocators.push_back(allocator);
+            tileLists.push_back(list);
+            return list;
+        };
+
+        std::vector<RowTileStep> tileSteps = BuildRowTileSchedule(tilePlan);
+        for (uint32_t i = 0; i < tileSteps.size(); ++i) {
+            const RowTileStep& step = tileSteps[i];
+            const bool isCopy = step.kind == RowTileStep::TILE_COPY;
+            const bool stepTimestamps = !isCopy || copyQueueTimestamps;
+            const uint32_t rowBegin = tilePlan.RowBegin(step.tile);
+            const uint32_t rows = tilePlan.RowEnd(step.tile) - rowBegin;
+            const uint64_t slotOffset = tilePlan.Slot(step.tile) * tilePlan.SlotBytes();
+
+            ComPtr<ID3D12GraphicsCommandList> list;
+            if (isCopy) {
+                list = CreateTileList(D3D12_COMMAND_LIST_TYPE_COPY, nullptr);
+                if (stepTimestamps) Timestamp(list, 4 + 2 * i);
+                list->CopyBufferRegion(matrixBuffer.Get(), slotOffset, matrixUploadBuffer.Get(),
+                                       uint64_t(rowBegin) * tilePlan.strideK, uint64_t(rows) * tilePlan.strideK);
+            } else {
+                list = CreateTileList(D3D12_COMMAND_LIST_TYPE_COMPUTE, pipelineState.Get());
+                list->SetComputeRootSignature(rootSignature.Get());
+                list->SetDescriptorHeaps(_countof(heaps), heaps);
+                list->SetComputeRootDescriptorTable(0, descriptorHeap->GetGPUDescriptorHandleForHeapStart());
+                list->SetComputeRootDescriptorTable(1, CD3DX12_GPU_DESCRIPTOR_HANDLE(
+                    descriptorHeap->GetGPUDescriptorHandleForHeapStart(), numSrvs, device->GetDescriptorHandleIncrementSize(D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV)));
+                UINT tileConstants[3] = { rowBegin, rows, UINT(slotOffset) };
+                list->SetComputeRoot32BitConstants(2, _countof(tileConstants), tileConstants, 0);
+                Timestamp(list, 4 + 2 * i);
+                list->Dispatch((rows + THREAD_GROUP_SIZE - 1) / THREAD_GROUP_SIZE, 1, 1);
+            }
+            if (stepTimestamps) Timestamp(list, 4 + 2 * i + 1);
+            CheckHR(list->Close());
+
+            ID3D12CommandQueue* queue = isCopy ? copyQueue.Get() : commandQueue.Get();
+            ID3D12Fence* waitFence = isCopy ? computeFence.Get() : copyFence.Get();
+            ID3D12Fence* signalFence = isCopy ? copyFence.Get() : computeFence.Get();
+            if (step.waitValue) CheckHR(queue->Wait(waitFence, step.waitValue));
+            ID3D12CommandList* stepLists[] = { list.Get() };
+            queue->ExecuteCommandLists(_countof(stepLists), stepLists);
+            if (!isCopy && step.tile == 0) std::cout << "Time to first dispatch: " << startupTimer.ElapsedMs() << " ms" << std::endl;
+            CheckHR(queue->Signal(signalFence, step.signalValue));
+        }
+
+        // The output decayed to COMMON and is promoted to COPY_SOURCE here.
+        ComPtr<ID3D12GraphicsCommandList> readbackList = CreateTileList(D3D12_COMMAND_LIST_TYPE_COMPUTE, nullptr);
+        readbackList->CopyBufferRegion(outputReadbackBuffer.Get(), 0, outputVectorBuffer.Get(), 0, outputVectorBufferSize);
+        for (uint32_t i = 0; i < tileSteps.size(); ++i) {
+            if (tileSteps[i].kind == RowTileStep::TILE_COMPUTE || copyQueueTimestamps) ResolveTimestamps(readbackList, 4 + 2 * i);
+        }
+        CheckHR(readbackList->Close());
+        ID3D12CommandList* readbackLists[] = { readbackList.Get() };
+        commandQueue->ExecuteCommandLists(_countof(readbackLists), readbackLists);
+    }
 
     // Wait for GPU to finish
+    TraceScope waitSpan("wait for GPU");
     ComPtr<ID3D12Fence> fence;
     HANDLE fenceEvent = CreateEvent(nullptr, FALSE, FALSE, nullptr);
     uint32_t fenceValue = 1;
@@ -303,22 +1079,82 @@ int main() {
         WaitForSingleObject(fenceEvent, INFINITE);
     }
     CloseHandle(fenceEvent);
+    waitSpan.End();
+
+    // GPU spans onto the trace timeline. steady_clock (TraceNowNs) counts
+    // QueryPerformanceCounter ticks on Windows, so the calibration pair of
+    // each queue maps its timestamps to the host clock.
+    if (gpuTimestamps) {
+        LARGE_INTEGER qpcFrequency;
+        QueryPerformanceFrequency(&qpcFrequency);
+        auto TicksToNs = [](uint64_t ticks, uint64_t frequency) {
+            return ticks / frequency * 1000000000ull + ticks % frequency * 1000000000ull / frequency;
+        };
+        struct GpuClock {
+            uint64_t frequency, gpuTicks, cpuNs;
+        };
+        auto Calibrate = [&](ID3D12CommandQueue* queue) {
+            GpuClock clock = {};
+            uint64_t cpuTicks = 0;
+            CheckHR(queue->GetTimestampFrequency(&clock.frequency));
+            CheckHR(queue->GetClockCalibration(&clock.gpuTicks, &cpuTicks));
+            clock.cpuNs = TicksToNs(cpuTicks, uint64_t(qpcFrequency.QuadPart));
+            return clock;
+        };
+        auto ToHostNs = [&](GpuClock const& clock, uint64_t ticks) {
+            return ticks >= clock.gpuTicks ? clock.cpuNs + TicksToNs(ticks - clock.gpuTicks, clock.frequency)
+                                           : clock.cpuNs - TicksToNs(clock.gpuTicks - ticks, clock.frequency);
+        };
+
+        uint64_t* ticks;
+        CheckHR(timestampReadbackBuffer->Map(0, nullptr, (void**)&ticks));
+        GpuClock computeClock = Calibrate(commandQueue.Get());
+        TraceRing* computeTrack = Trace::GpuTrack("GPU compute queue");
+        Trace::AddGpuSpan(computeTrack, "upload copies", ToHostNs(computeClock, ticks[0]), ToHostNs(computeClock, ticks[1]));
+        if (!tiled) {
+            Trace::AddGpuSpan(computeTrack, "dispatch + readback", ToHostNs(computeClock, ticks[2]), ToHostNs(computeClock, ticks[3]));
+        } else {
+            GpuClock copyClock = copyQueueTimestamps ? Calibrate(copyQueue.Get()) : GpuClock{ 1, 0, 0 };
+            TraceRing* copyTrack = copyQueueTimestamps ? Trace::GpuTrack("GPU copy queue") : nullptr;
+            std::vector<RowTileStep> tileSteps = BuildRowTileSchedule(tilePlan);
+            for (uint32_t i = 0; i < tileSteps.size(); ++i) {
+                uint64_t begin = ticks[4 + 2 * i], end = ticks[4 + 2 * i + 1];
+                if (tileSteps[i].kind == RowTileStep::TILE_COMPUTE) {
+                    Trace::AddGpuSpan(computeTrack, "tile compute", ToHostNs(computeClock, begin), ToHostNs(computeClock, end), "tile", tileSteps[i].tile);
+                } else {
+                    Trace::AddGpuSpan(copyTrack, "tile copy", ToHostNs(copyClock, begin), ToHostNs(copyClock, end), "tile", tileSteps[i].tile);
+                }
+            }
+        }
+        timestampReadbackBuffer->Unmap(0, nullptr);
+    }
 
     // Read back data
+    TraceScope readbackSpan("read back");
     void* mappedData;
     CheckHR(outputReadbackBuffer->Map(0, nullptr, &mappedData));
     memcpy(outputData.data(), mappedData, outputVectorBufferSize);
     outputReadbackBuffer->Unmap(0, nullptr);
+    readbackSpan.End();
 
     // Verify results
     {
+        TRACE_SCOPE("verify");
         std::vector<uint8_t> goldenData(outputVectorBufferSize, 0);
-        MatMulAdd(dt, goldenData.data(), matrixData.data(), inputVectorData.data(), biasData.data(), M, K, STRIDE_ALIGH_BYTES);
+        if (grouped) {
+            GroupedMatMulAdd(dt, goldenData.data(), matrixData.data(), inputVectorData.data(), biasData.data(), groupEntries);
+        } else if (fused) {
+            goldenStream.Finish<FusedEpilogue>(goldenData.data(), outputType, biasData.data(), epilogueParams);
+        } else if (zeroCopy) {
+            goldenStream.Finish(goldenData.data(), outputType, biasData.data());
+        } else {
+            MatMulAdd(types, goldenData.data(), matrixData.data(), inputVectorData.data(), biasData.data(), M, K, matrixStride);
+        }
 
         int err = 0;
         for (size_t i = 0; i < M; ++i) {
-            float v = GetDataFloat(outputData.data(), dt, 0, i);
-            float golden = GetDataFloat(goldenData.data(), dt, 0, i);
+            float v = GetDataFloat(outputData.data(), outputType, 0, i);
+            float golden = GetDataFloat(goldenData.data(), outputType, 0, i);
 
             if (v != golden) {
                 std::cout << "Output[" << i << "] = " << v << "; ";
@@ -330,5 +1166,8 @@ int main() {
     }
 
     std::cout << "Compute shader executed successfully and results are correct!" << std::endl;
+    graph.Report(std::cout);
+    memory.Report(std::cout);
+    std::cout << "Peak host memory: " << PeakHostMemoryBytes() / (1024 * 1024) << " MB" << std::endl;
     return 0;
 }
\ No newline at end of file
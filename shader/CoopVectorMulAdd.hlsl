@@ -7,6 +7,8 @@ ByteAddressBuffer matrix_buffer;
 ByteAddressBuffer bias_buffer;
 RWByteAddressBuffer output_vector_buffer;
 
+#include "epilogue.hlsli"
+
 enum CompType {
   Invalid = 0,
   I1 = 1,
@@ -42,17 +44,41 @@ enum MatLayout {
   OuterProductOptimal = 3,
 };
 
+// Operand types, one permutation per MatMulAddTypes of main.cpp
+// --precision (see compile.bat); the defaults are the all-F16 config.
+#ifndef OTY
 #define OTY float16_t
+#endif
+#ifndef OU
 #define OU 0
+#endif
 
+#ifndef ITY
 #define ITY float16_t
+#endif
+#ifndef IU
 #define IU 0
+#endif
+#ifndef II
 #define II F16
+#endif
+// Input vector length: 8, or 2 words of four elements for PackedS8x32
+#ifndef IN_N
+#define IN_N 8
+#endif
 
+#ifndef ML
 #define ML RowMajor
+#endif
+#ifndef MT
 #define MT 0
+#endif
+#ifndef MI
 #define MI F16
+#endif
+#ifndef BI
 #define BI F16
+#endif
 
 [NumThreads(1,1,1)]
 void main()
@@ -60,7 +86,7 @@ void main()
     vector<OTY, 8> output_vector;
     static const uint is_output_unsigned = OU;
     
-    vector<ITY, 8> input_vector = input_vector_buffer.Load<vector<ITY, 8> >(0);
+    vector<ITY, IN_N> input_vector = input_vector_buffer.Load<vector<ITY, IN_N> >(0);
     const uint is_input_unsigned = IU;
     const uint input_interpretation = II;
     
@@ -77,6 +103,13 @@ void main()
 
     __builtin_MatVecMulAdd(output_vector, is_output_unsigned, input_vector, is_input_unsigned, input_interpretation, matrix_buffer, matrix_offset, matrix_interpretation, 
         matrix_dimM, matrix_dimK, matrix_layout, matrix_is_transposed, matrix_stride, bias_buffer, bias_offset, bias_interpretation);
+#if EPI_SCALE || EPI_ACT != ACT_NONE
+    // Fused epilogue, in registers before the only store
+    [unroll]
+    for (uint m = 0; m < 8; m++) {
+        output_vector[m] = (OTY)ApplyEpilogue((float)output_vector[m], m);
+    }
+#endif
     output_vector_buffer.Store(0, output_vector);
 }
 
@@ -0,0 +1,36 @@
+ByteAddressBuffer input_vector_buffer : register(t0);
+ByteAddressBuffer matrix_buffer : register(t1);
+ByteAddressBuffer bias_buffer : register(t2);
+ByteAddressBuffer entry_buffer : register(t3); // GemvGroupEntry[]
+ByteAddressBuffer tile_buffer : register(t4);  // GemvGroupTile[]
+RWByteAddressBuffer output_vector_buffer : register(u0);
+
+// Grouped (ragged) GEMV: every thread group runs one tile, i.e. a range of
+// rows of one entry. Entries carry their own shape and buffer offsets, so
+// matrices of different sizes run in a single Dispatch(numTiles, 1, 1).
+
+#define BYTES_OF_ITY 4
+#define BYTES_OF_OTY 4
+#define GROUP_SIZE 32
+#define ENTRY_BYTES 32
+#define TILE_BYTES 16
+
+[numthreads(GROUP_SIZE, 1, 1)]
+void main(uint3 Gid : SV_GroupID, uint GI : SV_GroupIndex)
+{
+    uint4 tile = tile_buffer.Load4(Gid.x * TILE_BYTES);     // entryIndex, rowBegin, rowEnd, -
+    uint4 offsets = entry_buffer.Load4(tile.x * ENTRY_BYTES);    // matrix, bias, input, output
+    uint4 shape = entry_buffer.Load4(tile.x * ENTRY_BYTES + 16); // M, K, strideK, -
+
+    for (uint m = tile.y + GI; m < tile.z; m += GROUP_SIZE) {
+        float sum = 0.0f;
+        for (uint k = 0; k < shape.y; k++) {
+            float v1 = asfloat(matrix_buffer.Load(offsets.x + m * shape.z + k * BYTES_OF_ITY));
+            float v2 = asfloat(input_vector_buffer.Load(offsets.z + k * BYTES_OF_ITY));
+            sum += v1 * v2;
+        }
+        float bias = asfloat(bias_buffer.Load(offsets.y + m * BYTES_OF_ITY));
+        sum += bias;
+        output_vector_buffer.Store(offsets.w + m * BYTES_OF_OTY, asuint(sum));
+    }
+}
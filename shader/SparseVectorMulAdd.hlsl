@@ -0,0 +1,37 @@
+ByteAddressBuffer input_vector_buffer : register(t0);
+ByteAddressBuffer matrix_buffer : register(t1);   // 2:4 compressed values
+ByteAddressBuffer bias_buffer : register(t2);
+ByteAddressBuffer metadata_buffer : register(t3); // 2-bit column indices
+RWByteAddressBuffer output_vector_buffer : register(u0);
+
+// 2:4 structured-sparse GEMV, see include/sparse_util.h for the layout:
+// each group of 4 columns keeps 2 values, and a 4-bit metadata nibble
+// (idx0 | idx1 << 2) per group, 8 groups per uint, says where they came from.
+
+#define BYTES_OF_ITY 4
+#define BYTES_OF_OTY 4
+#define M 8
+#define K 8
+#define VALUE_STRIDE 16
+#define META_STRIDE 4
+
+[numthreads(4, 1, 1)]
+void main(uint3 DTid : SV_DispatchThreadID)
+{
+    uint m = DTid.x;
+    if (m >= M) return;
+
+    float sum = 0.0f;
+    for (uint g = 0; g < (K + 3) / 4; g++) {
+        uint meta = metadata_buffer.Load(m * META_STRIDE + (g / 8) * 4);
+        uint nibble = (meta >> ((g % 8) * 4)) & 0xF;
+        uint k0 = g * 4 + (nibble & 3);
+        uint k1 = g * 4 + (nibble >> 2);
+        float2 v = asfloat(matrix_buffer.Load2(m * VALUE_STRIDE + g * 2 * BYTES_OF_ITY));
+        if (k0 < K) sum += v.x * asfloat(input_vector_buffer.Load(k0 * BYTES_OF_ITY));
+        if (k1 < K) sum += v.y * asfloat(input_vector_buffer.Load(k1 * BYTES_OF_ITY));
+    }
+    float bias = asfloat(bias_buffer.Load(m * BYTES_OF_ITY));
+    sum += bias;
+    output_vector_buffer.Store(m * BYTES_OF_OTY, asuint(sum));
+}
@@ -8,25 +8,60 @@ RWByteAddressBuffer output_vector_buffer : register(u0);
 // StructuredBuffer<float> bias_buffer : register(t2);
 // RWStructuredBuffer<float> output_vector_buffer : register(u0);
 
+#include "epilogue.hlsli"
+
 #define BYTES_OF_ITY 4
+#ifndef OUT_F16
+#define OUT_F16 0
+#endif
+#if OUT_F16
+#define BYTES_OF_OTY 2
+#else
 #define BYTES_OF_OTY 4
+#endif
 #define M 8
 #define K 8
 #define STRIDE_K 32
 
+#ifndef TILED
+#define TILED 0
+#endif
+#if TILED
+// Out-of-core permutation (include/tiled_gemv.h): matrix_buffer is the
+// two-slot row-tile window and there is one dispatch per tile.
+cbuffer TileConstants : register(b0)
+{
+    uint tile_row_begin;     // first output row of the tile
+    uint tile_rows;
+    uint tile_matrix_offset; // byte offset of the tile's slot in the window
+};
+#endif
+
 [numthreads(4, 1, 1)]
 void main(uint3 DTid : SV_DispatchThreadID)
 {
+#if TILED
+    if (DTid.x >= tile_rows) return;
+    uint m = tile_row_begin + DTid.x;
+    uint matrix_row = tile_matrix_offset + DTid.x * STRIDE_K;
+#else
     uint m = DTid.x;
+    uint matrix_row = m * STRIDE_K;
+#endif
     // for (uint32_t m = 0; m < M; m++) {
         float sum = 0.0f;
         for (uint32_t k = 0; k < K; k++) {
-            float v1 = asfloat(matrix_buffer.Load(m * STRIDE_K + k * BYTES_OF_ITY));
+            float v1 = asfloat(matrix_buffer.Load(matrix_row + k * BYTES_OF_ITY));
             float v2 = asfloat(input_vector_buffer.Load(k * BYTES_OF_ITY));
             sum += v1 * v2;
         }
         float bias = asfloat(bias_buffer.Load(m * BYTES_OF_ITY));
         sum += bias;
-        output_vector_buffer.Store(m * BYTES_OF_OTY, sum);
+        sum = ApplyEpilogue(sum, m);
+#if OUT_F16
+        output_vector_buffer.Store<float16_t>(m * BYTES_OF_OTY, (float16_t)sum);
+#else
+        output_vector_buffer.Store(m * BYTES_OF_OTY, asuint(sum));
+#endif
     // }
 }
\ No newline at end of file
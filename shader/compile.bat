@@ -10,5 +10,25 @@ cd /d %~dp0
 .\dxc.exe -T cs_6_9 -enable-16bit-types -E main -Fo .\CoopVectorMulAdd.cso .\CoopVectorMulAdd.hlsl
 copy .\CoopVectorMulAdd.cso ..\out\build\x64-Debug\
 
+@REM Mixed-precision permutations (main.cpp --precision, MatMulAddTypes in include/util.h)
+.\dxc.exe -T cs_6_9 -enable-16bit-types -E main -DOTY=float -DII=F8_E4M3 -DMI=F8_E4M3 -DBI=F16 -Fo .\CoopVectorMulAddF16E4M3.cso .\CoopVectorMulAdd.hlsl
+copy .\CoopVectorMulAddF16E4M3.cso ..\out\build\x64-Debug\
+.\dxc.exe -T cs_6_9 -enable-16bit-types -E main -DOTY=int -DITY=uint -DII=PackedS8x32 -DIN_N=2 -DMI=I8 -DBI=I32 -Fo .\CoopVectorMulAddI8.cso .\CoopVectorMulAdd.hlsl
+copy .\CoopVectorMulAddI8.cso ..\out\build\x64-Debug\
+
 .\dxc.exe -T cs_6_0 -E main -Fo .\VectorMulAdd.cso .\VectorMulAdd.hlsl
-copy .\VectorMulAdd.cso ..\out\build\x64-Debug\
\ No newline at end of file
+copy .\VectorMulAdd.cso ..\out\build\x64-Debug\
+
+.\dxc.exe -T cs_6_0 -E main -Fo .\GroupedVectorMulAdd.cso .\GroupedVectorMulAdd.hlsl
+copy .\GroupedVectorMulAdd.cso ..\out\build\x64-Debug\
+
+.\dxc.exe -T cs_6_0 -E main -Fo .\SparseVectorMulAdd.cso .\SparseVectorMulAdd.hlsl
+copy .\SparseVectorMulAdd.cso ..\out\build\x64-Debug\
+
+@REM Fused epilogue permutation: row scale + ReLU, F16 output (main.cpp --fused)
+.\dxc.exe -T cs_6_2 -enable-16bit-types -E main -DEPI_SCALE=1 -DEPI_ACT=ACT_RELU -DOUT_F16=1 -Fo .\VectorMulAddScaleRelu.cso .\VectorMulAdd.hlsl
+copy .\VectorMulAddScaleRelu.cso ..\out\build\x64-Debug\
+
+@REM Out-of-core row-tile permutation (main.cpp --tiled)
+.\dxc.exe -T cs_6_0 -E main -DTILED=1 -Fo .\VectorMulAddTiled.cso .\VectorMulAdd.hlsl
+copy .\VectorMulAddTiled.cso ..\out\build\x64-Debug\
@@ -0,0 +1,44 @@
+// Fused epilogue applied to (matrix * input + bias) before the store.
+// Matches Epilogue<...> in include/epilogue.h, in this order:
+//
+//   EPI_SCALE=1        multiply row m by scale_buffer[m] (EpilogueRowScale)
+//   EPI_ACT=ACT_xxx    activation (EpilogueRelu, EpilogueLeakyRelu, ...)
+//
+// e.g. -DEPI_SCALE=1 -DEPI_ACT=ACT_RELU is Epilogue<EpilogueRowScale, EpilogueRelu>.
+
+#define ACT_NONE 0
+#define ACT_RELU 1
+#define ACT_LEAKY_RELU 2
+#define ACT_SIGMOID 3
+#define ACT_SILU 4
+
+#ifndef EPI_SCALE
+#define EPI_SCALE 0
+#endif
+#ifndef EPI_ACT
+#define EPI_ACT ACT_NONE
+#endif
+#ifndef EPI_LEAKY_ALPHA
+#define EPI_LEAKY_ALPHA 0.01f
+#endif
+
+#if EPI_SCALE
+ByteAddressBuffer scale_buffer : register(t3); // float per output row
+#endif
+
+float ApplyEpilogue(float v, uint m)
+{
+#if EPI_SCALE
+    v *= asfloat(scale_buffer.Load(m * 4));
+#endif
+#if EPI_ACT == ACT_RELU
+    v = max(v, 0.0f);
+#elif EPI_ACT == ACT_LEAKY_RELU
+    v = v > 0.0f ? v : v * EPI_LEAKY_ALPHA;
+#elif EPI_ACT == ACT_SIGMOID
+    v = 1.0f / (1.0f + exp(-v));
+#elif EPI_ACT == ACT_SILU
+    v = v / (1.0f + exp(-v));
+#endif
+    return v;
+}